@@ -0,0 +1,213 @@
+#include "batch.h"
+
+#include <glob.h>
+
+#include <algorithm>
+#include <numeric>
+
+#include "tins/exceptions.h"
+
+#include "exception.h"
+
+using namespace Envoy;
+using namespace Tins;
+
+namespace MySQL {
+
+std::vector<std::string> BatchReplay::expand(const std::vector<std::string>& patterns) {
+  std::vector<std::string> files;
+  for (const auto& pattern : patterns) {
+    glob_t matches;
+    if (glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+      // glob() sorts its matches.
+      files.insert(files.end(), matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+    } else {
+      files.push_back(pattern);
+    }
+    globfree(&matches);
+  }
+  return files;
+}
+
+BatchReplay::BatchReplay(const std::vector<std::string>& files, const Options& options)
+    : options_(options), steals_(0), failed_(false), merged_(0), bytes_(0), elapsed_(0) {
+  for (const auto& file : files) {
+    files_.emplace_back();
+    files_.back().path_ = file;
+  }
+  for (size_t i = 0; i < std::max<size_t>(options_.workers_, 1); i++) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+}
+
+BatchReplay::~BatchReplay() { stop(); }
+
+void BatchReplay::run() {
+  auto start = std::chrono::steady_clock::now();
+
+  // Splitting only reads a little around each split point, so it is left to this thread.
+  PcapReader::Options split_options = options_.reader_;
+  split_options.mmap_ = true;
+  for (size_t i = 0; i < files_.size(); i++) {
+    FileStats& file = files_[i];
+    try {
+      PcapReader reader(file.path_, split_options);
+      size_t parts = 1;
+      if (options_.splitSize_ > 0) {
+        parts = (reader.size() + options_.splitSize_ - 1) / options_.splitSize_;
+      }
+      for (const auto& range : reader.split(parts)) {
+        tasks_.push_back(Task{i, range});
+        file.ranges_++;
+      }
+    } catch (EnvoyException& ex) {
+      file.error_ = ex.what();
+    }
+  }
+  results_.resize(tasks_.size());
+
+  // Deal the tasks largest first, so that the ones left to steal at the end are small.
+  std::vector<size_t> order(tasks_.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return tasks_[a].range_.end_ - tasks_[a].range_.begin_ >
+           tasks_[b].range_.end_ - tasks_[b].range_.begin_;
+  });
+  for (size_t i = 0; i < order.size(); i++) {
+    workers_[i % workers_.size()]->tasks_.push_back(order[i]);
+  }
+
+  for (size_t i = 0; i < workers_.size(); i++) {
+    workers_[i]->thread_ = std::thread([this, i]() { work(i); });
+  }
+  stop();
+
+  elapsed_ = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+}
+
+double BatchReplay::megabytesPerSecond() const {
+  return elapsed_.count() > 0 ? static_cast<double>(bytes_) / elapsed_.count() : 0;
+}
+
+void BatchReplay::work(size_t index) {
+  try {
+    size_t task;
+    while (!failed_ && next(index, task)) {
+      complete(task, runTask(task));
+    }
+  } catch (...) {
+    if (!failed_.exchange(true)) {
+      error_ = std::current_exception();
+    }
+  }
+}
+
+bool BatchReplay::next(size_t index, size_t& task) {
+  {
+    Worker& own = *workers_[index];
+    std::lock_guard<std::mutex> lock(own.mutex_);
+    if (!own.tasks_.empty()) {
+      task = own.tasks_.front();
+      own.tasks_.pop_front();
+      return true;
+    }
+  }
+
+  // No task is ever added once the workers start, so one pass over the others is enough.
+  for (size_t i = 1; i < workers_.size(); i++) {
+    Worker& victim = *workers_[(index + i) % workers_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex_);
+    if (!victim.tasks_.empty()) {
+      task = victim.tasks_.back();
+      victim.tasks_.pop_back();
+      steals_++;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::unique_ptr<BatchReplay::Result> BatchReplay::runTask(size_t index) {
+  const Task& task = tasks_[index];
+  auto result = std::make_unique<Result>();
+  SessionManager sessions(options_.sessions_.shard(index, tasks_.size()));
+  try {
+    PcapReader reader(files_[task.file_].path_, options_.reader_);
+    reader.read(
+        [&](const PacketView& view) {
+          try {
+            if (PDU* pdu = view.pdu()) {
+              Packet packet(pdu, Timestamp(view.timestamp_));
+              sessions.processPacket(packet);
+            }
+          } catch (malformed_packet&) {
+            // Skipped, as libtins' own sniffers do.
+          }
+          return !failed_;
+        },
+        task.range_);
+    result->bytes_ = reader.stats().bytes_;
+    result->packets_ = reader.stats().packets_;
+    sessions.finish();
+  } catch (SinkException&) {
+    // The event file, not the capture.
+    throw;
+  } catch (EnvoyException& ex) {
+    result->error_ = ex.what();
+  }
+
+  result->streams_ = sessions.streams();
+  result->flowStats_ = sessions.flowStats();
+  mergeLatencies(result->latencies_, sessions.latencies());
+  result->topQueries_ = sessions.topQueries();
+  return result;
+}
+
+void BatchReplay::complete(size_t task, std::unique_ptr<Result> result) {
+  std::lock_guard<std::mutex> lock(mergeMutex_);
+  results_[task] = std::move(result);
+  while (merged_ < results_.size() && results_[merged_] != nullptr) {
+    merge(tasks_[merged_], *results_[merged_]);
+    results_[merged_].reset();
+    merged_++;
+  }
+}
+
+void BatchReplay::merge(const Task& task, const Result& result) {
+  FileStats& file = files_[task.file_];
+  file.bytes_ += result.bytes_;
+  file.packets_ += result.packets_;
+  file.streams_ += result.streams_;
+  if (file.error_.empty()) {
+    file.error_ = result.error_;
+  }
+  bytes_ += result.bytes_;
+
+  const SessionManager::FlowStats& from = result.flowStats_;
+  flowStats_.flows_ += from.flows_;
+  flowStats_.bufferedBytes_ += from.bufferedBytes_;
+  flowStats_.peakBufferedBytes_ = std::max(flowStats_.peakBufferedBytes_, from.peakBufferedBytes_);
+  flowStats_.fullEvictions_ += from.fullEvictions_;
+  flowStats_.idleEvictions_ += from.idleEvictions_;
+  flowStats_.memoryEvictions_ += from.memoryEvictions_;
+  flowStats_.watermarkEvictions_ += from.watermarkEvictions_;
+  flowStats_.partialFlows_ += from.partialFlows_;
+  flowStats_.resyncs_ += from.resyncs_;
+
+  mergeLatencies(latencies_, result.latencies_);
+  topQueries_.merge(result.topQueries_);
+}
+
+void BatchReplay::stop() {
+  for (auto& worker : workers_) {
+    if (worker->thread_.joinable()) {
+      worker->thread_.join();
+    }
+  }
+}
+
+}; // namespace MySQL
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pcap_reader.h"
+#include "session.h"
+
+namespace MySQL {
+
+/**
+ * Decodes a batch of capture files, e.g. an archive of rotated captures, on a pool of threads.
+ * Every file, or every range of a file larger than splitSize_ (see PcapReader::split()), is a
+ * task of its own with a SessionManager of its own. Tasks are dealt to the workers largest
+ * first; a worker that runs out of tasks steals from the others.
+ *
+ * The results of the tasks are merged in file and range order, not in the order the tasks
+ * finish, so they don't depend on the number of workers or on scheduling. Connections that cross
+ * a file or range boundary are joined mid-stream by the task after it (see
+ * SessionManager::Options::resync_); commands in flight at the boundary are lost.
+ */
+class BatchReplay {
+public:
+  struct Options {
+    size_t workers_ = 1;
+    // Files larger than this are split into ranges of about this size; 0 never splits them.
+    uint64_t splitSize_ = 256ULL << 20;
+    PcapReader::Options reader_;
+    // Each task's flow table gets these limits; see SessionManager::Options::shard() for its
+    // event file, numbered by task.
+    SessionManager::Options sessions_;
+  };
+
+  struct FileStats {
+    std::string path_;
+    uint64_t bytes_ = 0;
+    uint64_t ranges_ = 0;
+    uint64_t packets_ = 0;
+    uint64_t streams_ = 0;
+    // The first error reading or decoding the file, if any; the rest of its range is skipped.
+    std::string error_;
+  };
+
+  /**
+   * Expands the glob patterns in <patterns>, e.g. "archive/mysql-*.pcap", each into its matches in
+   * sorted order. A pattern without a match is kept as is, for opening it to report the error.
+   */
+  static std::vector<std::string> expand(const std::vector<std::string>& patterns);
+
+  BatchReplay(const std::vector<std::string>& files, const Options& options);
+  ~BatchReplay();
+
+  /**
+   * Decodes every file and returns once all tasks are done. A file that can't be opened, read or
+   * decoded has the error recorded in its FileStats, and doesn't stop the others. Rethrows any
+   * other exception raised by a worker.
+   */
+  void run();
+
+  // Valid after run() returns.
+  const std::vector<FileStats>& files() const { return files_; }
+  const SessionManager::FlowStats& flowStats() const { return flowStats_; }
+  const ServerLatencies& latencies() const { return latencies_; }
+  const QueryTopN& topQueries() const { return topQueries_; }
+  size_t tasks() const { return tasks_.size(); }
+  uint64_t steals() const { return steals_; }
+  // Bytes read per second across all workers, from the start to the end of run().
+  double megabytesPerSecond() const;
+
+private:
+  struct Task {
+    size_t file_;
+    PcapReader::Range range_;
+  };
+
+  // What a task leaves to be merged.
+  struct Result {
+    uint64_t bytes_ = 0;
+    uint64_t packets_ = 0;
+    uint64_t streams_ = 0;
+    std::string error_;
+    SessionManager::FlowStats flowStats_;
+    ServerLatencies latencies_;
+    QueryTopN topQueries_;
+  };
+
+  struct Worker {
+    // Task indices; the owner takes them from the front, thieves from the back.
+    std::deque<size_t> tasks_;
+    std::mutex mutex_;
+    std::thread thread_;
+  };
+
+  void work(size_t index);
+  // Takes a task from the worker's own queue, or steals one. Returns false once all are taken.
+  bool next(size_t index, size_t& task);
+  std::unique_ptr<Result> runTask(size_t task);
+  // Stores the result of <task>, and merges every result up to the first task not done yet.
+  void complete(size_t task, std::unique_ptr<Result> result);
+  void merge(const Task& task, const Result& result);
+  void stop();
+
+  const Options options_;
+  std::vector<FileStats> files_;
+  std::vector<Task> tasks_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<uint64_t> steals_;
+  std::atomic<bool> failed_;
+  std::exception_ptr error_;
+
+  // Guards the results waiting to be merged and everything merged.
+  std::mutex mergeMutex_;
+  std::vector<std::unique_ptr<Result>> results_;
+  size_t merged_;
+  SessionManager::FlowStats flowStats_;
+  ServerLatencies latencies_;
+  QueryTopN topQueries_;
+  uint64_t bytes_;
+  std::chrono::microseconds elapsed_;
+};
+
+}; // namespace MySQL
@@ -0,0 +1,117 @@
+// Compares the evbuffer based OwnedImpl with the native SlabImpl on the access patterns of the
+// decoder: segments appended and drained, whole buffers moved, packets framed off a stream the
+// way Packet::fromBuffer() does it, and headers copied out.
+//
+//   make bench && ./bench/buffer_bench
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "common/buffer/buffer_impl.h"
+#include "common/buffer/slab_impl.h"
+
+using namespace Envoy;
+
+namespace {
+
+// Typical TCP segment payload.
+constexpr size_t SegmentSize = 1448;
+
+const std::string Segment(SegmentSize, 'x');
+
+template <class BufferType> void BM_AddDrain(benchmark::State& state) {
+  const std::string data(state.range(0), 'x');
+  BufferType buffer;
+  for (auto _ : state) {
+    for (int i = 0; i < 16; i++) {
+      buffer.add(data.data(), data.size());
+    }
+    buffer.drain(buffer.length());
+  }
+  state.SetBytesProcessed(state.iterations() * 16 * data.size());
+}
+BENCHMARK_TEMPLATE(BM_AddDrain, Buffer::OwnedImpl)->Arg(16)->Arg(128)->Arg(SegmentSize);
+BENCHMARK_TEMPLATE(BM_AddDrain, Buffer::SlabImpl)->Arg(16)->Arg(128)->Arg(SegmentSize);
+
+template <class BufferType> void BM_Move(benchmark::State& state) {
+  // A segment handed from the connection's buffer to the decoder's.
+  BufferType in, out;
+  for (auto _ : state) {
+    for (int i = 0; i < state.range(0); i++) {
+      in.add(Segment.data(), Segment.size());
+    }
+    out.move(in);
+    out.drain(out.length());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0) * SegmentSize);
+}
+BENCHMARK_TEMPLATE(BM_Move, Buffer::OwnedImpl)->Arg(1)->Arg(16);
+BENCHMARK_TEMPLATE(BM_Move, Buffer::SlabImpl)->Arg(1)->Arg(16);
+
+// A stream of packets with <payload> byte payloads.
+std::string packets(size_t payload, size_t bytes) {
+  std::string data;
+  while (data.size() < bytes) {
+    uint8_t header[4] = {static_cast<uint8_t>(payload), static_cast<uint8_t>(payload >> 8),
+                         static_cast<uint8_t>(payload >> 16), 0};
+    data.append(reinterpret_cast<const char*>(header), sizeof(header));
+    data.append(payload, 'r');
+  }
+  return data;
+}
+
+template <class BufferType> void BM_FramePackets(benchmark::State& state) {
+  // Segments arrive in the stream buffer; each packet is moved into a packet buffer of its own,
+  // its header byte peeked and the payload drained once handled.
+  const size_t payload = state.range(0);
+  const std::string data = packets(payload, 64 * SegmentSize);
+  const size_t count = data.size() / (payload + 4);
+  BufferType stream, pkt;
+  for (auto _ : state) {
+    for (size_t i = 0; i < data.size(); i += SegmentSize) {
+      stream.add(data.data() + i, std::min(SegmentSize, data.size() - i));
+    }
+    uint8_t header[4];
+    while (stream.length() >= sizeof(header)) {
+      stream.copyOut(0, sizeof(header), header);
+      uint64_t length = header[0] | header[1] << 8 | header[2] << 16;
+      if (stream.length() < length + sizeof(header)) {
+        break;
+      }
+      stream.drain(sizeof(header));
+      pkt.move(stream, length);
+      benchmark::DoNotOptimize(*static_cast<uint8_t*>(pkt.linearize(1)));
+      pkt.drain(pkt.length());
+    }
+    stream.drain(stream.length());
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK_TEMPLATE(BM_FramePackets, Buffer::OwnedImpl)->Arg(16)->Arg(100)->Arg(1000)->Arg(8192);
+BENCHMARK_TEMPLATE(BM_FramePackets, Buffer::SlabImpl)->Arg(16)->Arg(100)->Arg(1000)->Arg(8192);
+
+template <class BufferType> void BM_CopyOut(benchmark::State& state) {
+  // Headers read at every offset of a chain of segments.
+  BufferType buffer;
+  for (int i = 0; i < 16; i++) {
+    buffer.add(Segment.data(), Segment.size());
+  }
+  const size_t size = state.range(0);
+  char out[64];
+  for (auto _ : state) {
+    for (size_t start = 0; start + size <= buffer.length(); start += 97) {
+      buffer.copyOut(start, size, out);
+      benchmark::DoNotOptimize(out[0]);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * ((buffer.length() - size) / 97 + 1));
+}
+BENCHMARK_TEMPLATE(BM_CopyOut, Buffer::OwnedImpl)->Arg(4)->Arg(64);
+BENCHMARK_TEMPLATE(BM_CopyOut, Buffer::SlabImpl)->Arg(4)->Arg(64);
+
+} // namespace
+
+BENCHMARK_MAIN();
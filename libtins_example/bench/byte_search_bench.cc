@@ -0,0 +1,90 @@
+// Compares the NUL search behind getCString(): libevent's evbuffer_search() against the
+// vectorized ByteSearch kernels, on lengths typical of protocol strings (user, schema and auth
+// plugin names, server versions) and a few longer ones.
+//
+//   make bench && ./bench/byte_search_bench
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "common/buffer/buffer_impl.h"
+#include "common/common/byte_search.h"
+#include "event2/buffer.h"
+
+using namespace Envoy;
+
+namespace {
+
+const std::vector<int64_t> Lengths = {8, 16, 24, 48, 128, 1024};
+
+std::string cstring(size_t length) {
+  std::string s(length, 'a');
+  for (size_t i = 0; i < length; i++) {
+    s[i] = 'a' + i % 26;
+  }
+  s.push_back('\0');
+  return s;
+}
+
+void BM_EvbufferSearch(benchmark::State& state) {
+  Buffer::OwnedImpl buffer(cstring(state.range(0)));
+  char nul = '\0';
+  for (auto _ : state) {
+    evbuffer_ptr ptr = evbuffer_search(buffer.buffer().get(), &nul, 1, nullptr);
+    benchmark::DoNotOptimize(ptr.pos);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void BM_OwnedImplSearch(benchmark::State& state) {
+  Buffer::OwnedImpl buffer(cstring(state.range(0)));
+  char nul = '\0';
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(buffer.search(&nul, 1, 0));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+template <const void* (*Find)(const void*, size_t, uint8_t)>
+void BM_Kernel(benchmark::State& state) {
+  std::string s = cstring(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Find(s.data(), s.size(), 0));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+const void* findMemchr(const void* data, size_t size, uint8_t byte) {
+  return std::memchr(data, byte, size);
+}
+
+} // namespace
+
+BENCHMARK(BM_EvbufferSearch)->ArgsProduct({Lengths});
+BENCHMARK(BM_OwnedImplSearch)->ArgsProduct({Lengths});
+BENCHMARK_TEMPLATE(BM_Kernel, ByteSearch::findScalar)->ArgsProduct({Lengths});
+BENCHMARK_TEMPLATE(BM_Kernel, findMemchr)->ArgsProduct({Lengths});
+
+int main(int argc, char** argv) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    benchmark::RegisterBenchmark("BM_Kernel<ByteSearch::findSse2>",
+                                 BM_Kernel<ByteSearch::findSse2>)
+        ->ArgsProduct({Lengths});
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    benchmark::RegisterBenchmark("BM_Kernel<ByteSearch::findAvx2>",
+                                 BM_Kernel<ByteSearch::findAvx2>)
+        ->ArgsProduct({Lengths});
+  }
+#endif
+  benchmark::AddCustomContext("byte_search", ByteSearch::implementation());
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
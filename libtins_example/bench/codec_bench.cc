@@ -0,0 +1,268 @@
+// Synthetic workloads for the codec hot paths: packet framing, row and handshake decoding,
+// length encoded integers, inflating the compressed protocol, and whole MySQLDecoder
+// conversations over generated result sets, plain and compressed. Rates are reported as items/s
+// (packets, rows or integers) and bytes/s of wire data; compressed runs also report the inflated
+// bytes/s.
+//
+//   make bench && ./bench/codec_bench
+//
+// Decoders run without tracing, as in production. Use --benchmark_out=<file> for machine
+// readable output.
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "codec.h"
+#include "packet_builder.h"
+#include "workload.h"
+
+using namespace Envoy;
+using namespace MySQL;
+
+namespace {
+
+const uint32_t Capabilities = WorkloadOptions().capabilities_;
+
+// Typical TCP segment payload; the decoder is fed in chunks of this size.
+constexpr size_t SegmentSize = 1448;
+
+std::string row(size_t cols, size_t width, size_t n) {
+  std::vector<std::string> values;
+  for (size_t c = 0; c < cols; c++) {
+    values.push_back(std::string(width, 'a' + (n + c) % 26));
+  }
+  return PacketBuilder::textRow(values);
+}
+
+// Counts the packets in framed wire data.
+size_t countPackets(const std::string& data) {
+  size_t packets = 0;
+  for (size_t offset = 0; offset + 4 <= data.size(); packets++) {
+    const uint8_t* header = reinterpret_cast<const uint8_t*>(data.data() + offset);
+    offset += 4 + (header[0] | header[1] << 8 | header[2] << 16);
+  }
+  return packets;
+}
+
+WorkloadOptions workload(size_t queries, size_t rows, size_t cols, size_t width) {
+  WorkloadOptions options;
+  options.queries_ = queries;
+  options.rows_ = rows;
+  options.columns_ = cols;
+  options.width_ = width;
+  return options;
+}
+
+// Appends <data> to <buffer> without copying it; <data> has to outlive the buffer's use of it.
+void addBorrowed(Buffer::Instance& buffer, const std::string& data,
+                 std::vector<std::unique_ptr<Buffer::BufferFragmentImpl>>& fragments) {
+  fragments.push_back(std::make_unique<Buffer::BufferFragmentImpl>(
+      data.data(), data.size(), [](const void*, size_t, const Buffer::BufferFragmentImpl*) {}));
+  buffer.addBufferFragment(*fragments.back());
+}
+
+void BM_FramePackets(benchmark::State& state) {
+  // The server side of a session with a single 1000 row result set.
+  std::string data;
+  for (const auto& segment : buildSession(workload(1, 1000, state.range(0), state.range(1)), 0)) {
+    if (segment.fromServer_) {
+      data += segment.data_;
+    }
+  }
+  size_t packets = countPackets(data);
+  Packet pkt(Capabilities);
+  std::vector<std::unique_ptr<Buffer::BufferFragmentImpl>> fragments;
+  for (auto _ : state) {
+    Buffer::OwnedImpl buffer;
+    addBorrowed(buffer, data, fragments);
+    while (Packet::containsFullPkt(buffer)) {
+      pkt.reset(Capabilities);
+      pkt.fromBuffer(buffer);
+    }
+    pkt.reset(Capabilities);
+    fragments.clear();
+  }
+  state.SetItemsProcessed(state.iterations() * packets);
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_FramePackets)->ArgsProduct({{4, 16}, {8, 64, 512}});
+
+template <class Decode> void decodeRows(benchmark::State& state, Decode decode) {
+  std::string payload = row(state.range(0), state.range(1), 0);
+  Packet pkt(Capabilities);
+  std::vector<std::unique_ptr<Buffer::BufferFragmentImpl>> fragments;
+  for (auto _ : state) {
+    addBorrowed(pkt.buffer_, payload, fragments);
+    decode(pkt);
+    pkt.reset(Capabilities);
+    fragments.clear();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * payload.size());
+}
+
+void BM_RowMessage(benchmark::State& state) {
+  RowMessage msg;
+  decodeRows(state, [&msg](Packet& pkt) {
+    msg.info_.clear();
+    msg.fromPacket(pkt);
+    benchmark::DoNotOptimize(msg.info_.data());
+  });
+}
+BENCHMARK(BM_RowMessage)->ArgsProduct({{4, 16}, {8, 64, 512}});
+
+void BM_RowView(benchmark::State& state) {
+  RowView view;
+  decodeRows(state, [&view](Packet& pkt) {
+    view.fromPacket(pkt);
+    benchmark::DoNotOptimize(view.bytes());
+  });
+}
+BENCHMARK(BM_RowView)->ArgsProduct({{4, 16}, {8, 64, 512}});
+
+void BM_RowCount(benchmark::State& state) {
+  decodeRows(state, [](Packet& pkt) {
+    uint64_t bytes = 0;
+    benchmark::DoNotOptimize(RowView::count(pkt, bytes));
+  });
+}
+BENCHMARK(BM_RowCount)->ArgsProduct({{4, 16}, {8, 64, 512}});
+
+void BM_ClientHandshakeMessage(benchmark::State& state) {
+  std::string payload =
+      PacketBuilder::clientHandshake(Capabilities, "app_user", "shop", "mysql_native_password");
+  Packet pkt(Capabilities);
+  std::vector<std::unique_ptr<Buffer::BufferFragmentImpl>> fragments;
+  for (auto _ : state) {
+    addBorrowed(pkt.buffer_, payload, fragments);
+    ClientHandshakeMessage msg;
+    msg.fromPacket(pkt);
+    benchmark::DoNotOptimize(msg.userName_.data());
+    pkt.reset(Capabilities);
+    fragments.clear();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_ClientHandshakeMessage);
+
+void BM_GetLenEncInt(benchmark::State& state) {
+  // A mix of the 1, 3, 4 and 9 byte encodings, weighted towards the short ones like real rows.
+  std::string data;
+  const uint64_t values[] = {5, 17, 250, 251, 1000, 70000, 200, 1ULL << 32};
+  const size_t count = 1024;
+  for (size_t i = 0; i < count; i++) {
+    data += PacketBuilder::lenEncInt(values[i % 8]);
+  }
+
+  std::vector<std::unique_ptr<Buffer::BufferFragmentImpl>> fragments;
+  for (auto _ : state) {
+    Buffer::OwnedImpl buffer;
+    addBorrowed(buffer, data, fragments);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+      sum += BufferHelper::getLenEncInt(buffer);
+    }
+    benchmark::DoNotOptimize(sum);
+    fragments.clear();
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_GetLenEncInt);
+
+void BM_Inflate(benchmark::State& state) {
+  // The server side of a session's result sets, one compressed packet per write.
+  std::string data;
+  uint64_t inflated = 0;
+  uint8_t seq = 0;
+  for (const auto& segment : buildSession(workload(8, state.range(0), 4, state.range(1)), 0)) {
+    if (segment.fromServer_) {
+      data += PacketBuilder::compress(seq, segment.data_);
+      inflated += segment.data_.size();
+    }
+  }
+
+  // Every pass ends on a packet boundary, so one inflater serves them all, as it would a
+  // connection.
+  Inflater inflater;
+  Buffer::OwnedImpl out;
+  for (auto _ : state) {
+    for (size_t i = 0; i < data.size(); i += SegmentSize) {
+      inflater.inflate(reinterpret_cast<const uint8_t*>(data.data()) + i,
+                       std::min(SegmentSize, data.size() - i), out);
+      out.drain(out.length());
+    }
+    benchmark::DoNotOptimize(inflater.bytesOut());
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+  state.counters["inflated"] =
+      benchmark::Counter(state.iterations() * inflated, benchmark::Counter::kIsRate,
+                         benchmark::Counter::kIs1024);
+}
+BENCHMARK(BM_Inflate)->ArgsProduct({{10, 1000}, {8, 256}});
+
+void decodeSession(benchmark::State& state, const WorkloadOptions& options, RowDecodeMode mode) {
+  auto segments = buildSession(options, 0);
+  size_t packets = 0, bytes = 0;
+  for (const auto& segment : segments) {
+    bytes += segment.data_.size();
+  }
+  // The MySQL packets, which compressed packets would hide.
+  WorkloadOptions plain = options;
+  plain.compress_ = false;
+  for (const auto& segment : buildSession(plain, 0)) {
+    packets += countPackets(segment.data_);
+  }
+
+  uint64_t inflated = 0;
+  for (auto _ : state) {
+    MySQLDecoder decoder;
+    decoder.setRowDecodeMode(mode);
+    for (const auto& segment : segments) {
+      const std::string& data = segment.data_;
+      for (size_t i = 0; i < data.size(); i += SegmentSize) {
+        size_t n = std::min(SegmentSize, data.size() - i);
+        if (segment.fromServer_) {
+          decoder.onServerData(data.data() + i, n);
+        } else {
+          decoder.onClientData(data.data() + i, n);
+        }
+      }
+    }
+    benchmark::DoNotOptimize(decoder.rowsDecoded());
+    inflated += decoder.inflatedBytes();
+  }
+  state.SetItemsProcessed(state.iterations() * packets);
+  state.SetBytesProcessed(state.iterations() * bytes);
+  if (options.compress_) {
+    state.counters["inflated"] = benchmark::Counter(inflated, benchmark::Counter::kIsRate,
+                                                    benchmark::Counter::kIs1024);
+  }
+}
+
+template <RowDecodeMode Mode> void BM_Decoder(benchmark::State& state) {
+  decodeSession(state, workload(8, state.range(0), state.range(1), state.range(2)), Mode);
+}
+BENCHMARK_TEMPLATE(BM_Decoder, RowDecodeMode::View)
+    ->ArgsProduct({{10, 1000}, {4, 16}, {8, 256}});
+BENCHMARK_TEMPLATE(BM_Decoder, RowDecodeMode::CountOnly)
+    ->ArgsProduct({{10, 1000}, {4, 16}, {8, 256}});
+
+template <RowDecodeMode Mode> void BM_DecoderCompressed(benchmark::State& state) {
+  WorkloadOptions options = workload(8, state.range(0), state.range(1), state.range(2));
+  options.compress_ = true;
+  decodeSession(state, options, Mode);
+}
+BENCHMARK_TEMPLATE(BM_DecoderCompressed, RowDecodeMode::View)
+    ->ArgsProduct({{10, 1000}, {4, 16}, {8, 256}});
+BENCHMARK_TEMPLATE(BM_DecoderCompressed, RowDecodeMode::CountOnly)
+    ->ArgsProduct({{10, 1000}, {4, 16}, {8, 256}});
+
+} // namespace
+
+BENCHMARK_MAIN();
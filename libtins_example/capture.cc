@@ -0,0 +1,220 @@
+#include "capture.h"
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "tins/ethernetII.h"
+#include "tins/exceptions.h"
+#include "tins/packet.h"
+
+#include "fmt/format.h"
+#include "exception.h"
+
+using namespace Envoy;
+
+namespace MySQL {
+
+LiveCapture::Ring::~Ring() {
+  if (map_ != nullptr) {
+    munmap(map_, mapSize_);
+  }
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+LiveCapture::LiveCapture(const Options& options)
+    : options_(options), loopback_(false), stopped_(false), failed_(false) {
+  if (options_.blockSize_ % getpagesize() != 0 || options_.blockSize_ % options_.frameSize_ != 0) {
+    throw EnvoyException(fmt::format("Block size {} must be a multiple of the page and frame size",
+                                     options_.blockSize_));
+  }
+
+  // The fanout group id only has to be unique among the sockets on this host.
+  int fanout_group = getpid() & 0xffff;
+  const size_t rings = std::max<size_t>(options_.rings_, 1);
+  for (size_t i = 0; i < rings; i++) {
+    rings_.push_back(std::make_unique<Ring>(options_.sessions_.shard(i, rings)));
+    open(*rings_.back(), fanout_group);
+  }
+}
+
+LiveCapture::~LiveCapture() {
+  stop();
+  for (auto& ring : rings_) {
+    if (ring->thread_.joinable()) {
+      ring->thread_.join();
+    }
+  }
+}
+
+void LiveCapture::open(Ring& ring, int fanout_group) {
+  ring.fd_ = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  if (ring.fd_ == -1) {
+    throw EnvoyException(fmt::format("Unable to open packet socket: {}", strerror(errno)));
+  }
+
+  int version = TPACKET_V3;
+  if (setsockopt(ring.fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == -1) {
+    throw EnvoyException(fmt::format("Unable to select TPACKET_V3: {}", strerror(errno)));
+  }
+
+  tpacket_req3 req;
+  memset(&req, 0, sizeof(req));
+  req.tp_block_size = options_.blockSize_;
+  req.tp_block_nr = options_.blockCount_;
+  req.tp_frame_size = options_.frameSize_;
+  req.tp_frame_nr = (options_.blockSize_ / options_.frameSize_) * options_.blockCount_;
+  req.tp_retire_blk_tov = options_.blockTimeoutMs_;
+  if (setsockopt(ring.fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) == -1) {
+    throw EnvoyException(fmt::format("Unable to set up the receive ring: {}", strerror(errno)));
+  }
+
+  ring.mapSize_ = static_cast<size_t>(options_.blockSize_) * options_.blockCount_;
+  void* map = mmap(nullptr, ring.mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED, ring.fd_, 0);
+  if (map == MAP_FAILED) {
+    throw EnvoyException(fmt::format("Unable to map the receive ring: {}", strerror(errno)));
+  }
+  ring.map_ = static_cast<uint8_t*>(map);
+
+  sockaddr_ll addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_ALL);
+  addr.sll_ifindex = if_nametoindex(options_.interface_.c_str());
+  if (addr.sll_ifindex == 0) {
+    throw EnvoyException(fmt::format("Unknown interface {}", options_.interface_));
+  }
+  if (bind(ring.fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+    throw EnvoyException(
+        fmt::format("Unable to bind to {}: {}", options_.interface_, strerror(errno)));
+  }
+
+  ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  strncpy(ifr.ifr_name, options_.interface_.c_str(), IFNAMSIZ - 1);
+  if (ioctl(ring.fd_, SIOCGIFFLAGS, &ifr) == 0) {
+    loopback_ = ifr.ifr_flags & IFF_LOOPBACK;
+  }
+
+  int fanout = fanout_group | (PACKET_FANOUT_HASH << 16);
+  if (setsockopt(ring.fd_, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) == -1) {
+    throw EnvoyException(fmt::format("Unable to join fanout group: {}", strerror(errno)));
+  }
+}
+
+void LiveCapture::run() {
+  for (auto& ring : rings_) {
+    Ring* r = ring.get();
+    r->thread_ = std::thread([this, r]() {
+      try {
+        loop(*r);
+        r->sessions_.finish();
+      } catch (...) {
+        if (!failed_.exchange(true)) {
+          error_ = std::current_exception();
+        }
+        stop();
+      }
+    });
+  }
+
+  for (auto& ring : rings_) {
+    ring->thread_.join();
+    updateStats(*ring);
+  }
+
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+}
+
+ServerLatencies LiveCapture::latencies() const {
+  ServerLatencies latencies;
+  for (const auto& ring : rings_) {
+    mergeLatencies(latencies, ring->sessions_.latencies());
+  }
+  return latencies;
+}
+
+QueryTopN LiveCapture::topQueries() const {
+  QueryTopN queries;
+  for (const auto& ring : rings_) {
+    queries.merge(ring->sessions_.topQueries());
+  }
+  return queries;
+}
+
+void LiveCapture::loop(Ring& ring) {
+  size_t block = 0;
+  while (!stopped_) {
+    auto* desc = reinterpret_cast<tpacket_block_desc*>(ring.map_ + block * options_.blockSize_);
+
+    // The kernel hands a block over by setting TP_STATUS_USER; pair that with an acquire load so
+    // the packet data written before it is visible.
+    if (!(__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+      pollfd pfd;
+      pfd.fd = ring.fd_;
+      pfd.events = POLLIN | POLLERR;
+      pfd.revents = 0;
+      poll(&pfd, 1, options_.blockTimeoutMs_);
+      updateStats(ring);
+      continue;
+    }
+
+    processBlock(ring, reinterpret_cast<uint8_t*>(desc));
+
+    __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    block = (block + 1) % options_.blockCount_;
+  }
+}
+
+void LiveCapture::processBlock(Ring& ring, uint8_t* block) {
+  auto* desc = reinterpret_cast<tpacket_block_desc*>(block);
+  uint32_t num_pkts = desc->hdr.bh1.num_pkts;
+  auto* hdr = reinterpret_cast<tpacket3_hdr*>(block + desc->hdr.bh1.offset_to_first_pkt);
+
+  for (uint32_t i = 0; i < num_pkts; i++) {
+    // On loopback every packet shows up twice, once on its way out and once on its way in.
+    auto* ll = reinterpret_cast<sockaddr_ll*>(reinterpret_cast<uint8_t*>(hdr) +
+                                              TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+    if (!(loopback_ && ll->sll_pkttype == PACKET_OUTGOING)) {
+      const uint8_t* data = reinterpret_cast<uint8_t*>(hdr) + hdr->tp_mac;
+      timeval ts;
+      ts.tv_sec = hdr->tp_sec;
+      ts.tv_usec = hdr->tp_nsec / 1000;
+
+      try {
+        Tins::Packet packet(new Tins::EthernetII(data, hdr->tp_snaplen), Tins::Timestamp(ts));
+        ring.sessions_.processPacket(packet);
+      } catch (Tins::malformed_packet&) {
+        // Not something we can follow, e.g. a truncated frame.
+      }
+    }
+
+    hdr = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(hdr) + hdr->tp_next_offset);
+  }
+}
+
+void LiveCapture::updateStats(Ring& ring) {
+  // Reading the statistics resets them in the kernel, so accumulate.
+  tpacket_stats_v3 stats;
+  socklen_t len = sizeof(stats);
+  if (getsockopt(ring.fd_, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0) {
+    ring.stats_.packets_ += stats.tp_packets;
+    ring.stats_.drops_ += stats.tp_drops;
+    ring.stats_.freezes_ += stats.tp_freeze_q_cnt;
+  }
+}
+
+}; // namespace MySQL
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "session.h"
+
+namespace MySQL {
+
+/**
+ * Live capture through memory-mapped AF_PACKET TPACKET_V3 rings. Each ring has its own socket,
+ * thread and SessionManager, and all rings join one PACKET_FANOUT_HASH group. The kernel hashes
+ * flows symmetrically, so both directions of a connection land on the same ring.
+ *
+ * Capturing needs CAP_NET_RAW. To try it without a production server, capture on "lo" next to a
+ * local MySQL stand-in, or replay a capture onto one end of a veth pair
+ * (tcpreplay -i veth0 file.pcap) and capture on the other.
+ */
+class LiveCapture {
+public:
+  struct Options {
+    std::string interface_;
+    size_t rings_ = 1;
+    // Per ring memory is blockSize_ * blockCount_.
+    uint32_t blockSize_ = 1 << 22;
+    uint32_t blockCount_ = 64;
+    uint32_t frameSize_ = 1 << 11;
+    // How long the kernel may hold a partially filled block before handing it to us.
+    uint32_t blockTimeoutMs_ = 100;
+    // Limits of each ring's flow table; see SessionManager::Options::shard() for its event file.
+    SessionManager::Options sessions_;
+  };
+
+  struct RingStats {
+    uint64_t packets_ = 0;
+    uint64_t drops_ = 0;
+    uint64_t freezes_ = 0;
+  };
+
+  LiveCapture(const Options& options);
+  ~LiveCapture();
+
+  /**
+   * Captures until stop() is called. Rethrows the first exception raised by a ring thread.
+   */
+  void run();
+
+  /**
+   * Asks the ring threads to finish. Only touches an atomic flag, so it may be called from a
+   * signal handler.
+   */
+  void stop() { stopped_ = true; }
+
+  // Per ring counters as reported by PACKET_STATISTICS. Valid after run() returns.
+  const RingStats& stats(size_t ring) const { return rings_[ring]->stats_; }
+  const SessionManager::FlowStats& flowStats(size_t ring) const {
+    return rings_[ring]->sessions_.flowStats();
+  }
+  size_t rings() const { return rings_.size(); }
+
+  // Query latencies merged across rings, valid after run() returns.
+  ServerLatencies latencies() const;
+  // Query statistics merged across rings, valid after run() returns.
+  QueryTopN topQueries() const;
+
+private:
+  struct Ring {
+    Ring(const SessionManager::Options& sessions) : sessions_(sessions) {}
+    ~Ring();
+
+    int fd_ = -1;
+    uint8_t* map_ = nullptr;
+    size_t mapSize_ = 0;
+    SessionManager sessions_;
+    RingStats stats_;
+    std::thread thread_;
+  };
+
+  void open(Ring& ring, int fanout_group);
+  void loop(Ring& ring);
+  void processBlock(Ring& ring, uint8_t* block);
+  void updateStats(Ring& ring);
+
+  const Options options_;
+  bool loopback_;
+  std::vector<std::unique_ptr<Ring>> rings_;
+  std::atomic<bool> stopped_;
+  std::atomic<bool> failed_;
+  std::exception_ptr error_;
+};
+
+}; // namespace MySQL
@@ -1,116 +1,628 @@
 #include <iostream>
+#include <algorithm>
+#include <cctype>
 #include <cstring>
 #include <assert.h>
 
 #include "codec.h"
+#include "common/common/byte_search.h"
+#include "common/common/logger.h"
 #include "fmt/printf.h"
 #include "exception.h"
 
 #include "mysql.h"
 
-#define ENVOY_LOG(LEVEL, ...)                      \
-  do {                                             \
-    fmt::print(__VA_ARGS__);                       \
-  } while (0)
-
 using namespace Envoy;
 using namespace std;
 
 namespace MySQL {
  
 MySQLDecoder::MySQLDecoder()
-  : sniffing_(true), sequenceId_(0), connState_(ConnectionState::ReadServerHandshake),
-    queryState_(QueryState::Idle) {}
+  : capabilities_(0), connState_(ConnectionState::ReadServerHandshake),
+    queryState_(QueryState::Idle), sniffing_(true), compressed_(false), sequenceId_(0),
+    clientBuffer_([this]() { watermarkChanged_ = true; }, [this]() { watermarkChanged_ = true; }),
+    serverBuffer_([this]() { watermarkChanged_ = true; }, [this]() { watermarkChanged_ = true; }),
+    watermarkChanged_(false), aboveHighWatermark_(false), highWatermarks_(0), lowWatermarks_(0),
+    streamingWindow_(MAX_PAYLOAD_LEN), payloadsStreamed_(0), bytesStreamed_(0), streamCommand_(0),
+    streamColumnRemaining_(0), streamLenEncSize_(0), streamColumn_(0), resyncOnError_(false),
+    resyncs_(0), bytesSkipped_(0), preparingId_(0), preparingParams_(0), preparingColumns_(0),
+    binaryRows_(false), rowTypes_(nullptr), columnCountRead_(false), resultColumns_(0),
+    schema_(nullptr), schemaHits_(0), schemaMisses_(0), rowMode_(RowDecodeMode::View),
+    callbacks_(nullptr), now_(0), queryStart_(0), queryCommand_(0), queryFingerprint_(0),
+    queryStatementId_(0), queryRows_(0), queryRowBytes_(0), totalRows_(0), totalRowBytes_(0) {}
 
 MySQLDecoder::~MySQLDecoder() { }
 
+// Whether <size> more bytes still leave the packet at the front of <buffer> incomplete.
+static bool staysPartial(Buffer::Instance& buffer, uint64_t size) {
+  if (buffer.length() < sizeof(uint32_t)) {
+    return false;
+  }
+
+  BufferCursor cursor(buffer);
+  uint32_t pkt_len = cursor.peekInt24();
+  return buffer.length() + size < pkt_len + sizeof(uint32_t);
+}
+
 void MySQLDecoder::onClientData(Buffer::Instance& buffer) {
   if (!sniffing_) {
     return;
   }
 
-  clientBuffer_.add(buffer);
+  if (compressed_) {
+    inflate(*clientInflater_, buffer, clientBuffer_);
+  } else {
+    clientBuffer_.move(buffer);
+  }
+  processClientData();
+}
+
+void MySQLDecoder::onServerData(Buffer::Instance& buffer) {
+  if (!sniffing_) {
+    return;
+  }
+
+  if (compressed_) {
+    inflate(*serverInflater_, buffer, serverBuffer_);
+  } else {
+    serverBuffer_.move(buffer);
+  }
+  processServerData();
+}
+
+void MySQLDecoder::onClientData(const void* data, uint64_t size) {
+  if (!sniffing_) {
+    return;
+  }
+
+  // The data is only read while being inflated, so there is nothing to borrow.
+  if (compressed_) {
+    inflate(*clientInflater_, data, size, clientBuffer_);
+    processClientData();
+    return;
+  }
 
-  while (Packet::containsFullPkt(clientBuffer_)) {
-    if (!clientPkts_.empty() && clientPkts_.back()->moreData_) {
-      clientPkts_.back()->fromBuffer(clientBuffer_);
+  // When the data can't complete the packet already buffered, borrowing it would only mean
+  // copying it out again on return. Append a copy right away instead, which also keeps a large
+  // packet from fragmenting into one slice per call.
+  if (!clientStream_.active_ && staysPartial(clientBuffer_, size)) {
+    clientBuffer_.add(data, size);
+    processClientData();
+    return;
+  }
+
+  bool released = false;
+  Buffer::BufferFragmentImpl fragment(
+      data, size, [&released](const void*, size_t, const Buffer::BufferFragmentImpl*) {
+        released = true;
+      });
+  clientBuffer_.addBufferFragment(fragment);
+
+  try {
+    processClientData();
+  } catch (...) {
+    ownBorrowedData(clientBuffer_, clientPkts_, size);
+    throw;
+  }
+
+  if (!released) {
+    ownBorrowedData(clientBuffer_, clientPkts_, size);
+  }
+  assert(released);
+}
+
+void MySQLDecoder::onServerData(const void* data, uint64_t size) {
+  if (!sniffing_) {
+    return;
+  }
+
+  if (compressed_) {
+    inflate(*serverInflater_, data, size, serverBuffer_);
+    processServerData();
+    return;
+  }
+
+  // When the data can't complete the packet already buffered, borrowing it would only mean
+  // copying it out again on return. Append a copy right away instead, which also keeps a large
+  // packet from fragmenting into one slice per call.
+  if (!serverStream_.active_ && staysPartial(serverBuffer_, size)) {
+    serverBuffer_.add(data, size);
+    processServerData();
+    return;
+  }
+
+  bool released = false;
+  Buffer::BufferFragmentImpl fragment(
+      data, size, [&released](const void*, size_t, const Buffer::BufferFragmentImpl*) {
+        released = true;
+      });
+  serverBuffer_.addBufferFragment(fragment);
+
+  try {
+    processServerData();
+  } catch (...) {
+    ownBorrowedData(serverBuffer_, serverPkts_, size);
+    throw;
+  }
+
+  if (!released) {
+    ownBorrowedData(serverBuffer_, serverPkts_, size);
+  }
+  assert(released);
+}
+
+void MySQLDecoder::processClientData() {
+  while (true) {
+    try {
+      decodeClientData();
+      reportWatermarks();
+      return;
+    } catch (SinkException&) {
+      // Not a decoding error, and the callbacks that raised it were not finished.
+      throw;
+    } catch (EnvoyException& ex) {
+      if (!resyncOnError_) {
+        throw;
+      }
+      // Every error is raised after the offending packet left the buffer, so this terminates.
+      startResync(ex.what());
+    }
+  }
+}
+
+void MySQLDecoder::processServerData() {
+  while (true) {
+    try {
+      decodeServerData();
+      reportWatermarks();
+      return;
+    } catch (SinkException&) {
+      // Not a decoding error, and the callbacks that raised it were not finished.
+      throw;
+    } catch (EnvoyException& ex) {
+      if (!resyncOnError_) {
+        throw;
+      }
+      startResync(ex.what());
+    }
+  }
+}
+
+void MySQLDecoder::decodeClientData() {
+  if (connState_ == ConnectionState::Resync && !resyncClient()) {
+    return;
+  }
+
+  while (true) {
+    // Handle what can be handled before framing more, so that a large payload queued behind
+    // these packets can still be streamed.
+    while (!clientPkts_.empty() && !clientPkts_.front().moreData_ && shouldProcessClientPkts()) {
+      handlePacket(clientPkts_.front());
+      clientPkts_.pop();
+    }
+
+    if (clientStream_.active_ || startStream(clientBuffer_, clientPkts_, clientStream_, false)) {
+      if (!continueStream(clientBuffer_, clientStream_, "client")) {
+        break;
+      }
+      continue;
+    }
+
+    if (!Packet::containsFullPkt(clientBuffer_)) {
+      break;
+    }
+
+    if (!clientPkts_.empty() && clientPkts_.back().moreData_) {
+      clientPkts_.back().fromBuffer(clientBuffer_);
     } else {
-      PacketPtr pkt = std::make_unique<Packet>(capabilities_);
-      pkt->fromBuffer(clientBuffer_);
-      clientPkts_.push_back(std::move(pkt));
+      clientPkts_.push(capabilities_).fromBuffer(clientBuffer_);
     }
 
-    if (sequenceId_ != clientPkts_.back()->seqId_) {
+    if (sequenceId_ != clientPkts_.back().seqId_) {
       throw EnvoyException(fmt::format("Wrong sequence ID from client. Expected {} but got {}",
-                                       sequenceId_, clientPkts_.back()->seqId_));
+                                       sequenceId_, clientPkts_.back().seqId_));
     }
 
     sequenceId_++;
   }
-
-  while (!clientPkts_.empty() && !clientPkts_.front()->moreData_ && shouldProcessClientPkts()) {
-    handlePacket(clientPkts_.front());
-    clientPkts_.pop_front();
-  }
 }
 
-void MySQLDecoder::onServerData(Buffer::Instance& buffer) {
-  if (!sniffing_) {
+void MySQLDecoder::decodeServerData() {
+  if (connState_ == ConnectionState::Resync) {
+    // There is no telling where a response starts before knowing the command it answers.
+    bytesSkipped_ += serverBuffer_.length();
+    serverBuffer_.drain(serverBuffer_.length());
     return;
   }
-    
-  serverBuffer_.add(buffer);
 
-  while (Packet::containsFullPkt(serverBuffer_)) {
-    if (!serverPkts_.empty() && serverPkts_.back()->moreData_) {
-      serverPkts_.back()->fromBuffer(serverBuffer_);
+  while (true) {
+    while (!serverPkts_.empty() && !serverPkts_.front().moreData_ && shouldProcessServerPkts()) {
+      handlePacket(serverPkts_.front());
+      serverPkts_.pop();
+    }
+
+    if (serverStream_.active_ || startStream(serverBuffer_, serverPkts_, serverStream_, true)) {
+      if (!continueStream(serverBuffer_, serverStream_, "server")) {
+        break;
+      }
+      continue;
+    }
+
+    if (!Packet::containsFullPkt(serverBuffer_)) {
+      break;
+    }
+
+    if (!serverPkts_.empty() && serverPkts_.back().moreData_) {
+      serverPkts_.back().fromBuffer(serverBuffer_);
     } else {
-      PacketPtr pkt = std::make_unique<Packet>(capabilities_);
-      pkt->fromBuffer(serverBuffer_);
-      serverPkts_.push_back(std::move(pkt));
+      serverPkts_.push(capabilities_).fromBuffer(serverBuffer_);
     }
 
-    if (sequenceId_ != serverPkts_.back()->seqId_) {
+    if (sequenceId_ != serverPkts_.back().seqId_) {
       throw EnvoyException(fmt::format("Wrong sequence ID from server. Expected {} but got {}",
-                                       sequenceId_, clientPkts_.back()->seqId_));
+                                       sequenceId_, serverPkts_.back().seqId_));
     }
     sequenceId_++;
   }
+}
+
+void MySQLDecoder::setBufferLimit(uint64_t limit) {
+  clientBuffer_.setWatermarks(limit);
+  serverBuffer_.setWatermarks(limit);
+  reportWatermarks();
+}
+
+void MySQLDecoder::reportWatermarks() {
+  // Borrowed data, and copying it out in ownBorrowedData(), can take the buffers across their
+  // watermarks and back within a call, so only where they ended up counts.
+  if (!watermarkChanged_) {
+    return;
+  }
+  watermarkChanged_ = false;
+
+  bool above = clientBuffer_.highWatermarkTriggered() || serverBuffer_.highWatermarkTriggered();
+  if (above == aboveHighWatermark_) {
+    return;
+  }
+  aboveHighWatermark_ = above;
+  if (above) {
+    highWatermarks_++;
+    ENVOY_LOG(debug, "Unframed data over the buffer limit: {} client, {} server bytes\n",
+              clientBuffer_.length(), serverBuffer_.length());
+    if (callbacks_ != nullptr) {
+      callbacks_->onAboveHighWatermark();
+    }
+  } else {
+    lowWatermarks_++;
+    if (callbacks_ != nullptr) {
+      callbacks_->onBelowLowWatermark();
+    }
+  }
+}
+
+void MySQLDecoder::ownBorrowedData(DecoderBuffer& buffer, PacketQueue& pkts,
+                                   uint64_t borrowed) {
+  // Borrowed slices can end up either in the unframed remainder or, via Packet::fromBuffer(), in
+  // packets still waiting for their turn. Copy both into memory owned by the buffers so the
+  // caller is free to reuse its memory once we return. Only the last <borrowed> bytes of the
+  // stream came from the caller, so only that tail of each buffer is copied; the rest was owned
+  // by an earlier call, and copying it again would make feeding a large packet in small pieces
+  // quadratic.
+  auto own = [borrowed](DecoderBuffer& b) {
+    uint64_t tail = std::min(b.length(), borrowed);
+    if (tail == 0) {
+      return;
+    }
+    DecoderBuffer owned;
+    owned.move(b, b.length() - tail);
+    owned.add(b);
+    b.drain(b.length());
+    b.move(owned);
+  };
+
+  own(buffer);
+  for (size_t i = 0; i < pkts.size(); i++) {
+    own(pkts[i].buffer_);
+  }
+}
+
+void MySQLDecoder::startCompression() {
+  ENVOY_LOG(trace, "Compression enabled\n");
+  compressed_ = true;
+  clientInflater_ = std::make_unique<Inflater>();
+  serverInflater_ = std::make_unique<Inflater>();
+
+  // Anything already buffered past the handshake was compressed. It is copied out first, as it
+  // may be borrowed.
+  for (auto* side : {&clientBuffer_, &serverBuffer_}) {
+    if (side->length() > 0) {
+      DecoderBuffer compressed;
+      compressed.add(*side);
+      side->drain(side->length());
+      inflate(side == &clientBuffer_ ? *clientInflater_ : *serverInflater_, compressed, *side);
+    }
+  }
+}
+
+void MySQLDecoder::inflate(Inflater& inflater, const void* data, uint64_t size,
+                           Buffer::Instance& out) {
+  if (!sniffing_) {
+    return;
+  }
+
+  try {
+    inflater.inflate(static_cast<const uint8_t*>(data), size, out);
+  } catch (EnvoyException& ex) {
+    if (!resyncOnError_) {
+      throw;
+    }
+    // Unlike plain packets, compressed ones can't be found again by scanning the stream.
+    ENVOY_LOG(trace, "Giving up on compressed stream: {}\n", ex.what());
+    sniffing_ = false;
+  }
+}
+
+void MySQLDecoder::inflate(Inflater& inflater, Buffer::Instance& in, Buffer::Instance& out) {
+  while (in.length() > 0) {
+    Buffer::RawSlice slice;
+    in.getRawSlices(&slice, 1);
+    uint64_t len = std::min<uint64_t>(slice.len_, in.length());
+    inflate(inflater, slice.mem_, len, out);
+    in.drain(len);
+  }
+}
+
+void MySQLDecoder::resync() { startResync("resync requested"); }
+
+void MySQLDecoder::startResync(const std::string& reason) {
+  ENVOY_LOG(trace, "Resynchronizing: {}\n", reason);
+
+  // Whatever is in flight can't be trusted any more. The unframed client data is kept, as the
+  // next command may well be in there.
+  while (!clientPkts_.empty()) {
+    clientPkts_.pop();
+  }
+  while (!serverPkts_.empty()) {
+    serverPkts_.pop();
+  }
+  clientStream_ = PayloadStream();
+  serverStream_ = PayloadStream();
+  std::string().swap(streamQuery_);
+  preparing_ = PreparedStatement();
+  binaryRows_ = false;
+  rowTypes_ = nullptr;
+  schema_ = nullptr;
+  bytesSkipped_ += serverBuffer_.length();
+  serverBuffer_.drain(serverBuffer_.length());
+
+  connState_ = ConnectionState::Resync;
+  queryState_ = QueryState::Idle;
+  sequenceId_ = 0;
+  resyncs_++;
+}
+
+// Whether the <available> bytes at <p> look like the start of a command packet: sequence id 0, a
+// command that clients send, and a length that suits the command. <available> is at least 5.
+static bool plausibleCommand(const uint8_t* p, uint64_t available) {
+  uint32_t length = p[0] | (p[1] << 8) | (p[2] << 16);
+  if (p[3] != 0 || length == 0 || length > MySQLDecoder::MaxResyncPacket) {
+    return false;
+  }
+
+  switch (p[4]) {
+  case COM_QUIT:
+  case COM_STATISTICS:
+  case COM_PROCESS_INFO:
+  case COM_DEBUG:
+  case COM_PING:
+    return length == 1;
+  case COM_QUERY:
+    // Statements start with a keyword, a comment or a parenthesis, after optional whitespace.
+    return length > 1 && (available < 6 || isalpha(p[5]) || isspace(p[5]) || p[5] == '/' ||
+                          p[5] == '-' || p[5] == '(' || p[5] == '#');
+  case COM_INIT_DB:
+  case COM_FIELD_LIST:
+  case COM_CREATE_DB:
+  case COM_DROP_DB:
+  case COM_STMT_PREPARE:
+  case COM_REFRESH:
+  case COM_SHUTDOWN:
+  case COM_SET_OPTION:
+  case COM_PROCESS_KILL:
+  case COM_CHANGE_USER:
+  case COM_BINLOG_DUMP:
+  case COM_TABLE_DUMP:
+  case COM_REGISTER_SLAVE:
+  case COM_STMT_EXECUTE:
+  case COM_STMT_SEND_LONG_DATA:
+  case COM_STMT_CLOSE:
+  case COM_STMT_RESET:
+  case COM_STMT_FETCH:
+    return length > 1;
+  default:
+    // Unknown, or only used inside the server.
+    return false;
+  }
+}
+
+bool MySQLDecoder::resyncClient() {
+  // A client sends nothing after a command until it has seen the response, so a candidate is
+  // only taken once its packet ends exactly where the data seen so far ends. One that runs past
+  // the end may still turn out right when more data comes in.
+  uint64_t length = clientBuffer_.length();
+  if (length <= sizeof(uint32_t)) {
+    return false;
+  }
+
+  const uint8_t* p = static_cast<const uint8_t*>(clientBuffer_.linearize(length));
+  uint64_t skip = 0;
+  bool found = false;
+  for (; skip + sizeof(uint32_t) < length; skip++) {
+    if (!plausibleCommand(p + skip, length - skip)) {
+      continue;
+    }
+
+    uint64_t end = skip + sizeof(uint32_t) + (p[skip] | (p[skip + 1] << 8) | (p[skip + 2] << 16));
+    if (end >= length) {
+      found = (end == length);
+      break;
+    }
+  }
+
+  clientBuffer_.drain(skip);
+  bytesSkipped_ += skip;
+  if (!found) {
+    return false;
+  }
+
+  ENVOY_LOG(trace, "Resynchronized after skipping {} bytes\n", skip);
+  connState_ = ConnectionState::ReadClientQuery;
+  queryState_ = QueryState::Idle;
+  sequenceId_ = 0;
+  return true;
+}
+
+uint64_t MySQLDecoder::bufferedBytes() const {
+  uint64_t bytes = clientBuffer_.length() + serverBuffer_.length() + clientPkts_.bytes() +
+                   serverPkts_.bytes() + streamQuery_.size();
+  if (compressed_) {
+    bytes += clientInflater_->memoryUsage() + serverInflater_->memoryUsage();
+  }
+  return bytes;
+}
+
+uint64_t MySQLDecoder::compressedBytes() const {
+  return compressed_ ? clientInflater_->bytesIn() + serverInflater_->bytesIn() : 0;
+}
+
+uint64_t MySQLDecoder::inflatedBytes() const {
+  return compressed_ ? clientInflater_->bytesOut() + serverInflater_->bytesOut() : 0;
+}
+
+void MySQLDecoder::setStreamingWindow(uint64_t window) {
+  streamingWindow_ = std::min<uint64_t>(window, MAX_PAYLOAD_LEN);
+}
+
+bool MySQLDecoder::canStream(bool from_server, uint32_t length, uint8_t first) {
+  // Only payloads that can be handled without seeing them whole: queries, LOCAL INFILE data and
+  // result set rows. What ends the rows is left to handlePacket(): an ERR packet, or an EOF or OK
+  // packet, which starts with 0xfe as a text row only does with a first value of 16MB or more.
+  if (from_server) {
+    return connState_ == ConnectionState::ReadServerQueryResult &&
+           queryState_ == QueryState::ReadRows && first != ERR_HEADER &&
+           (first != EOF_HEADER || length >= MAX_PAYLOAD_LEN);
+  }
+  return connState_ == ConnectionState::ReadClientQuery ||
+         connState_ == ConnectionState::LocalInFileData;
+}
+
+uint32_t MySQLDecoder::readStreamHeader(Buffer::Instance& buffer, const char* direction) {
+  uint32_t length;
+  uint8_t seq_id;
+  {
+    BufferCursor cursor(buffer);
+    length = cursor.getInt24();
+    seq_id = cursor.getInt8();
+  }
 
-  while (!serverPkts_.empty() && !serverPkts_.front()->moreData_ && shouldProcessServerPkts()) {
-    handlePacket(serverPkts_.front());
-    serverPkts_.pop_front();
+  if (sequenceId_ != seq_id) {
+    throw EnvoyException(fmt::format("Wrong sequence ID from {}. Expected {} but got {}",
+                                     direction, sequenceId_, seq_id));
   }
+  sequenceId_++;
+
+  return length;
 }
 
-bool MySQLDecoder::handlePacket(PacketPtr& pkt) {
+bool MySQLDecoder::startStream(DecoderBuffer& buffer, PacketQueue& pkts,
+                               PayloadStream& stream, bool from_server) {
+  // Packets waiting in the queue have to be handled first, and a payload already being
+  // buffered is finished the same way.
+  if (streamingWindow_ == 0 || !pkts.empty() || buffer.length() <= sizeof(uint32_t)) {
+    return false;
+  }
+
+  // The header and the first byte of the payload.
+  uint32_t length;
+  uint8_t first;
+  {
+    BufferCursor cursor(buffer);
+    uint64_t head = cursor.peekFixedInt(sizeof(uint32_t) + 1);
+    length = head & 0xffffff;
+    first = head >> 32;
+  }
+  if ((length <= streamingWindow_ && length < MAX_PAYLOAD_LEN) ||
+      !canStream(from_server, length, first)) {
+    return false;
+  }
+
+  length = readStreamHeader(buffer, from_server ? "server" : "client");
+  stream.active_ = true;
+  stream.packetRemaining_ = length;
+  stream.morePackets_ = (length >= MAX_PAYLOAD_LEN);
+  stream.offset_ = 0;
+  return true;
+}
+
+bool MySQLDecoder::continueStream(DecoderBuffer& buffer, PayloadStream& stream,
+                                  const char* direction) {
+  if (stream.packetRemaining_ == 0 && stream.morePackets_) {
+    if (buffer.length() < sizeof(uint32_t)) {
+      return false;
+    }
+    uint32_t length = readStreamHeader(buffer, direction);
+    stream.packetRemaining_ = length;
+    stream.morePackets_ = (length >= MAX_PAYLOAD_LEN);
+  }
+
+  // Chunks are also capped at the window, so that a handler never linearizes more than that.
+  uint64_t length = std::min({buffer.length(), stream.packetRemaining_, streamingWindow_});
+  bool last = (length == stream.packetRemaining_ && !stream.morePackets_);
+  if (length == 0 && !last) {
+    return false;
+  }
+
+  uint64_t offset = stream.offset_;
+  stream.packetRemaining_ -= length;
+  stream.offset_ += length;
+  bytesStreamed_ += length;
+  if (last) {
+    stream.active_ = false;
+    payloadsStreamed_++;
+  }
+
+  handleStreamChunk(buffer, length, offset, stream.offset_ + stream.packetRemaining_, last);
+  return true;
+}
+
+bool MySQLDecoder::handlePacket(Packet& pkt) {
 
   switch (connState_) {
   case ConnectionState::ReadServerHandshake:
     ENVOY_LOG(trace, "Read server handshake\n");
-    handleServerHandshake(*pkt);
+    handleServerHandshake(pkt);
     break;
   case ConnectionState::ReadClientHandshake:
     ENVOY_LOG(trace, "Read client handshake\n");
-    handleClientHandshake(*pkt);
+    handleClientHandshake(pkt);
     break;
   case ConnectionState::ReadServerHandshakeResponse:
-    handleServerResponse(*pkt);
+    handleServerResponse(pkt);
     break;
   case ConnectionState::ReadClientQuery:
-    handleClientQuery(*pkt);
+    handleClientQuery(pkt);
     break;
   case ConnectionState::ReadServerQueryResult:
-    handleQueryResponse(*pkt);
+    handleQueryResponse(pkt);
     break;
   case ConnectionState::LocalInFileData:
-    handleLocalInfileData(*pkt);
+    handleLocalInfileData(pkt);
     break;
   case ConnectionState::LocalInFileResult:
-    handleLocalInfileResult(*pkt);
+    handleLocalInfileResult(pkt);
     break;
   default:
-    throw EnvoyException(fmt::format("Unknown connection state {}", connState_));
+    throw EnvoyException(fmt::format("Unknown connection state {}", static_cast<int>(connState_)));
   }
 
   return true;
@@ -140,6 +652,9 @@ void MySQLDecoder::handleServerHandshake(Packet& pkt) {
   capabilities_ = msg.capabilities_;
 
   ENVOY_LOG(trace, "{}", msg.toString());
+  if (callbacks_ != nullptr) {
+    callbacks_->onServerHandshake(msg);
+  }
 
   connState_ = ConnectionState::ReadClientHandshake;
 }
@@ -155,6 +670,9 @@ void MySQLDecoder::handleClientHandshake(Packet& pkt) {
   capabilities_ = msg.capabilities_;
 
   ENVOY_LOG(trace, "{}", msg.toString());
+  if (callbacks_ != nullptr) {
+    callbacks_->onClientHandshake(msg);
+  }
 
   connState_ = ConnectionState::ReadServerHandshakeResponse;
 }
@@ -170,48 +688,365 @@ void MySQLDecoder::handleServerResponse(Packet& pkt) {
     OkMessage msg;
     msg.fromPacket(pkt);
     ENVOY_LOG(trace, "{}", msg.toString());
+    if (callbacks_ != nullptr) {
+      callbacks_->onOk(msg);
+    }
+
+    // Both sides compress from the first packet after the handshake.
+    if ((capabilities_ & CLIENT_COMPRESS) && !compressed_) {
+      startCompression();
+    }
+    break;
+  }
+  case PacketType::ErrPacket: {
+    ENVOY_LOG(trace, "Err Packet\n");
+    ErrMessage msg;
+    msg.fromPacket(pkt);
+    ENVOY_LOG(trace, "{}", msg.toString());
+    if (callbacks_ != nullptr) {
+      callbacks_->onError(msg);
+    }
+    break;
+  }
+  case PacketType::EOFPacket: {
+    ENVOY_LOG(trace, "EOF Packet\n");
+    EofMessage msg;
+    msg.fromPacket(pkt);
+    ENVOY_LOG(trace, "{}", msg.toString());
+    break;
+  }
+  default:
+    ENVOY_LOG(trace, "Unknown Packet\n");
+    assert(false);
+    break;
+  }
+
+  resetQueryState();
+}
+
+void MySQLDecoder::handleClientQuery(Packet& pkt) {
+  ENVOY_LOG(trace, "Query from client: Seqid: {} Len: {}\n", pkt.seqId_, pkt.length());
+
+  QueryMessage msg;
+  msg.fromPacket(pkt);
+  ENVOY_LOG(trace, "{}", msg.toString());
+  if (callbacks_ != nullptr) {
+    callbacks_->onQuery(msg);
+  }
+
+  startQuery(msg.command_, msg.info_, msg.statementId_);
+}
+
+void MySQLDecoder::startQuery(uint8_t command, const std::string& query, uint32_t statement_id) {
+  queryStart_ = now_;
+  queryCommand_ = command;
+  queryFingerprint_ = 0;
+  queryText_ = std::string_view();
+  queryStatementId_ = statement_id;
+  queryRows_ = 0;
+  queryRowBytes_ = 0;
+  binaryRows_ = false;
+  rowTypes_ = nullptr;
+  columnCountRead_ = false;
+  schema_ = nullptr;
+
+  auto it = statements_.end();
+  if (QueryMessage::hasStatementId(command)) {
+    it = statements_.find(statement_id);
+  }
+
+  switch (command) {
+  case COM_QUERY:
+    queryFingerprint_ = normalizer_.normalize(query);
+    queryText_ = normalizer_.normalized();
+    break;
+  case COM_STMT_PREPARE:
+    // Not an execution, so the statement is only remembered, not reported under its SQL.
+    preparing_.fingerprint_ = normalizer_.normalize(query);
+    preparing_.query_ = normalizer_.normalized();
+    preparing_.columnTypes_.clear();
+    break;
+  case COM_STMT_EXECUTE:
+  case COM_STMT_FETCH:
+    binaryRows_ = true;
+    if (it != statements_.end()) {
+      queryFingerprint_ = it->second.fingerprint_;
+      queryText_ = it->second.query_;
+      rowTypes_ = &it->second.columnTypes_;
+    }
+    break;
+  case COM_STMT_CLOSE:
+  case COM_STMT_SEND_LONG_DATA:
+    if (command == COM_STMT_CLOSE && it != statements_.end()) {
+      statements_.erase(it);
+    }
+    // The server doesn't answer these, so the next packet starts a new command.
+    sequenceId_ = 0;
+    return;
+  }
+
+  connState_ = ConnectionState::ReadServerQueryResult;
+  // A cursor's rows are fetched without a result set header.
+  queryState_ = command == COM_STMT_FETCH ? QueryState::ReadRows : QueryState::ReadColumns;
+}
+
+const PreparedStatement* MySQLDecoder::statement(uint32_t id) const {
+  auto it = statements_.find(id);
+  return it == statements_.end() ? nullptr : &it->second;
+}
+
+void MySQLDecoder::handlePrepareResponse(Packet& pkt) {
+  ENVOY_LOG(trace, "Prepare response from server: Seqid: {} Len: {}\n", pkt.seqId_,
+            pkt.length());
+
+  switch (queryState_) {
+  case QueryState::ReadColumns: {
+    if (pkt.header() == ERR_HEADER) {
+      ErrMessage msg;
+      msg.fromPacket(pkt);
+      ENVOY_LOG(trace, "{}", msg.toString());
+      if (callbacks_ != nullptr) {
+        callbacks_->onError(msg);
+      }
+
+      finishQuery(msg.errorCode_);
+      return;
+    }
+
+    // COM_STMT_PREPARE_OK
+    BufferCursor cursor(pkt.buffer_);
+    cursor.getInt8();
+    preparingId_ = cursor.getInt32();
+    preparingColumns_ = cursor.getInt16();
+    preparingParams_ = cursor.getInt16();
+    preparing_.params_ = preparingParams_;
+    ENVOY_LOG(trace, "Statement prepared: Id: {} Columns: {} Params: {}\n", preparingId_,
+              preparingColumns_, preparingParams_);
+
+    if (preparingParams_ > 0) {
+      queryState_ = QueryState::ReadStatementParams;
+    } else if (preparingColumns_ > 0) {
+      queryState_ = QueryState::ReadStatementColumns;
+    } else {
+      finishPrepare();
+    }
+    break;
+  }
+  case QueryState::ReadStatementParams:
+    // Each section ends with an EOF packet, unless the client deprecated those.
+    if (pkt.type() != PacketType::EOFPacket) {
+      preparingParams_--;
+      if (preparingParams_ > 0 || !(capabilities_ & CLIENT_DEPRECATE_EOF)) {
+        break;
+      }
+    }
+    if (preparingColumns_ > 0) {
+      queryState_ = QueryState::ReadStatementColumns;
+    } else {
+      finishPrepare();
+    }
+    break;
+  case QueryState::ReadStatementColumns:
+    if (pkt.type() != PacketType::EOFPacket) {
+      uint64_t len = pkt.length();
+      const uint8_t* pos = static_cast<const uint8_t*>(pkt.buffer_.linearize(len));
+      ColumnDefinition column;
+      column.fromBytes(pos, pos + len);
+      preparing_.columnTypes_.push_back(column.type_);
+      preparingColumns_--;
+      if (preparingColumns_ > 0 || !(capabilities_ & CLIENT_DEPRECATE_EOF)) {
+        break;
+      }
+    }
+    finishPrepare();
+    break;
+  default:
+    assert(false);
+    break;
+  }
+}
+
+void MySQLDecoder::finishPrepare() {
+  // Ids are unique per connection, but a client may re-prepare after a COM_STMT_CLOSE we missed.
+  if (statements_.size() < MaxPreparedStatements || statements_.count(preparingId_) > 0) {
+    statements_[preparingId_] = std::move(preparing_);
+  }
+  preparing_ = PreparedStatement();
+  queryStatementId_ = preparingId_;
+  finishQuery(0);
+}
+
+void MySQLDecoder::handleTextRow(Packet& pkt) {
+  if (rowMode_ == RowDecodeMode::CountOnly) {
+    uint64_t bytes = 0;
+    RowView::count(pkt, bytes);
+    queryRowBytes_ += bytes;
+    totalRowBytes_ += bytes;
+  } else {
+    rowView_.fromPacket(pkt);
+    queryRowBytes_ += rowView_.bytes();
+    totalRowBytes_ += rowView_.bytes();
+    ENVOY_LOG(trace, "Rows {}\n", rowView_.toString());
+    if (callbacks_ != nullptr) {
+      callbacks_->onRow(rowView_);
+    }
+  }
+
+  queryRows_++;
+  totalRows_++;
+}
+
+void MySQLDecoder::handleBinaryRow(Packet& pkt) {
+  if (rowTypes_ == nullptr) {
+    // Without the column types the values can't be told apart; count the row whole.
+    queryRowBytes_ += pkt.length();
+    totalRowBytes_ += pkt.length();
+  } else if (rowMode_ == RowDecodeMode::CountOnly) {
+    uint64_t bytes = 0;
+    BinaryRowView::count(pkt, *rowTypes_, bytes);
+    queryRowBytes_ += bytes;
+    totalRowBytes_ += bytes;
+  } else {
+    binaryRowView_.fromPacket(pkt, *rowTypes_);
+    queryRowBytes_ += binaryRowView_.bytes();
+    totalRowBytes_ += binaryRowView_.bytes();
+    ENVOY_LOG(trace, "Binary row {}\n", binaryRowView_.toString());
+    if (callbacks_ != nullptr) {
+      callbacks_->onBinaryRow(binaryRowView_);
+    }
+  }
+
+  queryRows_++;
+  totalRows_++;
+}
+
+void MySQLDecoder::handleStreamChunk(Buffer::Instance& data, uint64_t length, uint64_t offset,
+                                     uint64_t total_hint, bool last) {
+  ENVOY_LOG(trace, "Streamed payload chunk: Offset: {} Len: {} Total: {}{}\n", offset, length,
+            total_hint, last ? "" : "+");
+
+  const uint8_t* p =
+      length > 0 ? static_cast<const uint8_t*>(data.linearize(static_cast<uint32_t>(length)))
+                 : nullptr;
+  uint64_t n = length;
+
+  switch (connState_) {
+  case ConnectionState::ReadClientQuery: {
+    if (offset == 0) {
+      streamCommand_ = *p++;
+      n--;
+      if (QueryMessage::commandName(streamCommand_) == nullptr) {
+        throw EnvoyException(fmt::format("Unknown command: {}", streamCommand_));
+      }
+      streamQuery_.clear();
+    }
+
+    // Only the start of the command is kept; that is enough to tell apart the statements that
+    // get this large, typically bulk INSERTs, and holds the statement id of COM_STMT_* commands.
+    uint64_t limit = std::min(streamingWindow_, MaxStreamedQueryText);
+    if (streamQuery_.size() < limit) {
+      streamQuery_.append(reinterpret_cast<const char*>(p),
+                          std::min<uint64_t>(n, limit - streamQuery_.size()));
+    }
+
+    if (last) {
+      ENVOY_LOG(trace, "Streamed query: Command: {} Len: {}\n", streamCommand_, total_hint);
+      uint32_t statement_id = 0;
+      if (QueryMessage::hasStatementId(streamCommand_) && streamQuery_.size() >= 4) {
+        for (int i = 3; i >= 0; i--) {
+          statement_id = (statement_id << 8) | static_cast<uint8_t>(streamQuery_[i]);
+        }
+      }
+      if (callbacks_ != nullptr) {
+        QueryMessage msg;
+        msg.command_ = streamCommand_;
+        msg.commandName_ = QueryMessage::commandName(streamCommand_);
+        msg.statementId_ = statement_id;
+        if (streamCommand_ == COM_QUERY || streamCommand_ == COM_STMT_PREPARE) {
+          msg.info_ = streamQuery_;
+        }
+        callbacks_->onQuery(msg);
+      }
+      startQuery(streamCommand_, streamQuery_, statement_id);
+      std::string().swap(streamQuery_);
+    }
     break;
   }
-  case PacketType::ErrPacket: {
-    ENVOY_LOG(trace, "Err Packet\n");
-    ErrMessage msg;
-    msg.fromPacket(pkt);
-    ENVOY_LOG(trace, "{}", msg.toString());
+  case ConnectionState::LocalInFileData:
+    // Never the empty packet that ends the upload, so there is nothing to do but skip it.
     break;
-  }
-  case PacketType::EOFPacket: {
-    ENVOY_LOG(trace, "EOF Packet\n");
-    EofMessage msg;
-    msg.fromPacket(pkt);
-    ENVOY_LOG(trace, "{}", msg.toString());
+  case ConnectionState::ReadServerQueryResult: {
+    if (offset == 0) {
+      streamColumnRemaining_ = 0;
+      streamLenEncSize_ = 0;
+      streamRowHead_.clear();
+      streamColumn_ = 0;
+    }
+    if (binaryRows_) {
+      countStreamedBinaryRow(p, n);
+    } else {
+      countStreamedRow(p, n);
+    }
+
+    if (last) {
+      queryRows_++;
+      totalRows_++;
+    }
     break;
   }
   default:
-    ENVOY_LOG(trace, "Unknown Packet\n");
     assert(false);
     break;
   }
 
-  resetQueryState();
+  data.drain(length);
 }
 
-void MySQLDecoder::handleClientQuery(Packet& pkt) {
-  Buffer::Instance& buffer = pkt.buffer_;
-  ENVOY_LOG(trace, "Query from client: Seqid: {} Len: {}\n", pkt.seqId_, pkt.length());
+void MySQLDecoder::countStreamedRow(const uint8_t* data, uint64_t length) {
+  // Walks the length encoded column values of a text row as RowView::count() does, except that
+  // a length prefix may be split across chunks.
+  while (length > 0) {
+    if (streamColumnRemaining_ > 0) {
+      uint64_t n = std::min(length, streamColumnRemaining_);
+      streamColumnRemaining_ -= n;
+      queryRowBytes_ += n;
+      totalRowBytes_ += n;
+      data += n;
+      length -= n;
+      continue;
+    }
 
-  QueryMessage msg;
-  msg.fromPacket(pkt);
-  ENVOY_LOG(trace, "{}", msg.toString());
+    streamLenEnc_[streamLenEncSize_++] = *data++;
+    length--;
 
-  connState_ = ConnectionState::ReadServerQueryResult;
-  queryState_ = QueryState::ReadColumns;
+    uint8_t first = streamLenEnc_[0];
+    uint8_t size = first == 0xfc ? 3 : first == 0xfd ? 4 : first == 0xfe ? 9 : 1;
+    if (streamLenEncSize_ < size) {
+      continue;
+    }
+
+    uint64_t value = 0;
+    if (size == 1) {
+      // 0xfb is a NULL value.
+      value = first == 0xfb ? 0 : first;
+    } else {
+      for (uint8_t i = size - 1; i > 0; i--) {
+        value = (value << 8) | streamLenEnc_[i];
+      }
+    }
+    streamColumnRemaining_ = value;
+    streamLenEncSize_ = 0;
+  }
 }
 
 void MySQLDecoder::handleQueryResponse(Packet& pkt) {
-  Buffer::Instance& buffer = pkt.buffer_;
-
   ENVOY_LOG(trace, "Query response from server: Seqid: {} Len: {}\n", pkt.seqId_, pkt.length());
 
+  if (queryCommand_ == COM_STMT_PREPARE) {
+    handlePrepareResponse(pkt);
+    return;
+  }
+
   switch (queryState_) {
   case QueryState::ReadColumns: {
     auto pkt_type = pkt.type();
@@ -221,8 +1056,11 @@ void MySQLDecoder::handleQueryResponse(Packet& pkt) {
       OkMessage msg;
       msg.fromPacket(pkt);
       ENVOY_LOG(trace, "{}", msg.toString());
+      if (callbacks_ != nullptr) {
+        callbacks_->onOk(msg);
+      }
 
-      resetQueryState();
+      finishQuery(0);
       break;
     }
     case PacketType::ErrPacket: {
@@ -230,8 +1068,11 @@ void MySQLDecoder::handleQueryResponse(Packet& pkt) {
       ErrMessage msg;
       msg.fromPacket(pkt);
       ENVOY_LOG(trace, "{}", msg.toString());
+      if (callbacks_ != nullptr) {
+        callbacks_->onError(msg);
+      }
 
-      resetQueryState();
+      finishQuery(msg.errorCode_);
       break;
     }
     case PacketType::EOFPacket: {
@@ -240,6 +1081,12 @@ void MySQLDecoder::handleQueryResponse(Packet& pkt) {
       msg.fromPacket(pkt);
       ENVOY_LOG(trace, "{}", msg.toString());
 
+      finishColumns();
+      if (binaryRows_ && (msg.status_ & SERVER_STATUS_CURSOR_EXISTS)) {
+        // The rows of a cursor only come with the COM_STMT_FETCHes that follow.
+        finishQuery(0);
+        break;
+      }
       queryState_ = QueryState::ReadRows;
       break;
     }
@@ -257,8 +1104,18 @@ void MySQLDecoder::handleQueryResponse(Packet& pkt) {
       //   //throw EnvoyException(fmt::format("LOCAL_INFILE not supported yet"));
       // }
 
-      uint64_t n = BufferHelper::getLenEncInt(buffer);
+      if (columnCountRead_) {
+        addColumnDefinition(pkt);
+        break;
+      }
+
+      BufferCursor cursor(pkt.buffer_);
+      uint64_t n = cursor.getLenEncInt();
       ENVOY_LOG(trace, "Result set: Length: {}\n", n);
+      columnCountRead_ = true;
+      resultColumns_ = n;
+      schemaBytes_.clear();
+      schemaOffsets_.clear();
       break;
     }
     }
@@ -266,24 +1123,47 @@ void MySQLDecoder::handleQueryResponse(Packet& pkt) {
     break;
   }
   case QueryState::ReadRows: {
-    auto pkt_type = pkt.type();
-    switch (pkt_type) {
-    case PacketType::OkPacket: {
+    // A 0x00 header never ends the rows: binary rows start with one, and so does a text row whose
+    // first column is empty. Either would otherwise read as an OK packet.
+    if (pkt.header() == OK_HEADER) {
+      if (binaryRows_) {
+        handleBinaryRow(pkt);
+      } else {
+        handleTextRow(pkt);
+      }
+      break;
+    }
+
+    // With CLIENT_DEPRECATE_EOF the rows end with an OK packet under the EOF header, which is
+    // longer than an EOF packet whenever it carries info or session state. Only a text row whose
+    // first value is 16MB or more starts with 0xfe too.
+    if (pkt.header() == EOF_HEADER && (capabilities_ & CLIENT_DEPRECATE_EOF) &&
+        pkt.length() < MAX_PAYLOAD_LEN) {
       ENVOY_LOG(trace, "OK Packet\n");
       OkMessage msg;
       msg.fromPacket(pkt);
       ENVOY_LOG(trace, "{}", msg.toString());
+      ENVOY_LOG(trace, "Result set: Rows: {} Bytes: {}\n", queryRows_, queryRowBytes_);
+      if (callbacks_ != nullptr) {
+        callbacks_->onOk(msg);
+      }
 
-      resetQueryState();
+      finishQuery(0);
       break;
     }
+
+    auto pkt_type = pkt.type();
+    switch (pkt_type) {
     case PacketType::ErrPacket: {
       ENVOY_LOG(trace, "Err Packet\n");
       ErrMessage msg;
       msg.fromPacket(pkt);
       ENVOY_LOG(trace, "{}", msg.toString());
+      if (callbacks_ != nullptr) {
+        callbacks_->onError(msg);
+      }
 
-      resetQueryState();
+      finishQuery(msg.errorCode_);
       break;
     }
     case PacketType::EOFPacket: {
@@ -291,23 +1171,17 @@ void MySQLDecoder::handleQueryResponse(Packet& pkt) {
       EofMessage msg;
       msg.fromPacket(pkt);
       ENVOY_LOG(trace, "{}", msg.toString());
+      ENVOY_LOG(trace, "Result set: Rows: {} Bytes: {}\n", queryRows_, queryRowBytes_);
 
-      resetQueryState();
+      finishQuery(0);
       break;
     }
-    default: {
-      uint8_t h = pkt.header();
-      if (h == LOCAL_INFILE && pkt.length() > 1) {
-        throw EnvoyException(fmt::format("LOCAL_INFILE response not supported yet"));
-        break;
-      }
-
-      RowMessage msg;
-      msg.fromPacket(pkt);
-      ENVOY_LOG(trace, "Rows {}\n", msg.toString());
+    default:
+      // A leading 0xfb here is not a LOCAL INFILE request (those only answer the query itself)
+      // but a NULL first column, which RowView handles.
+      handleTextRow(pkt);
       break;
     }
-    }
 
     break;
   }
@@ -317,6 +1191,53 @@ void MySQLDecoder::handleQueryResponse(Packet& pkt) {
   }
 }
 
+void MySQLDecoder::addColumnDefinition(Packet& pkt) {
+  // Only collected here; finishColumns() parses them if the schema isn't cached yet.
+  uint64_t len = pkt.length();
+  schemaOffsets_.push_back(schemaBytes_.size());
+  schemaBytes_.append(static_cast<const char*>(pkt.buffer_.linearize(len)), len);
+
+  // Without EOF packets the rows start right after the last definition.
+  if (schemaOffsets_.size() == resultColumns_ && (capabilities_ & CLIENT_DEPRECATE_EOF)) {
+    finishColumns();
+    queryState_ = QueryState::ReadRows;
+  }
+}
+
+void MySQLDecoder::finishColumns() {
+  if (!columnCountRead_ || schema_ != nullptr) {
+    return;
+  }
+
+  auto it = schemas_.find(schemaBytes_);
+  if (it != schemas_.end()) {
+    schemaHits_++;
+    schema_ = &it->second;
+  } else {
+    schemaMisses_++;
+    ResultSchema& schema = schemas_.size() < MaxCachedSchemas ? schemas_[schemaBytes_]
+                                                               : uncachedSchema_;
+    schema.columns_.resize(schemaOffsets_.size());
+    schema.types_.resize(schemaOffsets_.size());
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(schemaBytes_.data());
+    for (size_t i = 0; i < schemaOffsets_.size(); i++) {
+      const uint8_t* pos = data + schemaOffsets_[i];
+      const uint8_t* end =
+          data + (i + 1 < schemaOffsets_.size() ? schemaOffsets_[i + 1] : schemaBytes_.size());
+      schema.columns_[i].fromBytes(pos, end);
+      schema.types_[i] = schema.columns_[i].type_;
+      ENVOY_LOG(trace, "Column {}\n", schema.columns_[i].toString());
+    }
+    schema_ = &schema;
+  }
+
+  // Binary rows of a statement we didn't see prepared, or whose columns changed since, are read
+  // with the types of the result set.
+  if (binaryRows_ && (rowTypes_ == nullptr || rowTypes_->size() != schema_->types_.size())) {
+    rowTypes_ = &schema_->types_;
+  }
+}
+
 void MySQLDecoder::handleLocalInfileData(Packet& pkt) {
   ENVOY_LOG(trace, "LocalInFile Data : Seqid: {} Len: {}\n", pkt.seqId_, pkt.length());
   if (pkt.length() == 0 ) {
@@ -333,8 +1254,11 @@ void MySQLDecoder::handleLocalInfileResult(Packet& pkt) {
     OkMessage msg;
     msg.fromPacket(pkt);
     ENVOY_LOG(trace, "{}", msg.toString());
+    if (callbacks_ != nullptr) {
+      callbacks_->onOk(msg);
+    }
 
-    resetQueryState();
+    finishQuery(0);
     break;
   }
   case PacketType::ErrPacket: {
@@ -342,8 +1266,11 @@ void MySQLDecoder::handleLocalInfileResult(Packet& pkt) {
     ErrMessage msg;
     msg.fromPacket(pkt);
     ENVOY_LOG(trace, "{}", msg.toString());
+    if (callbacks_ != nullptr) {
+      callbacks_->onError(msg);
+    }
 
-    resetQueryState();
+    finishQuery(msg.errorCode_);
     break;
   }
   case PacketType::EOFPacket: {
@@ -352,7 +1279,7 @@ void MySQLDecoder::handleLocalInfileResult(Packet& pkt) {
     msg.fromPacket(pkt);
     ENVOY_LOG(trace, "{}", msg.toString());
 
-    resetQueryState();
+    finishQuery(0);
     break;
   }
   case PacketType::Progress: {
@@ -364,18 +1291,106 @@ void MySQLDecoder::handleLocalInfileResult(Packet& pkt) {
     break;
   }
   default: {
-    throw EnvoyException(fmt::format("Unknown LocalInFile response: {}", pkt_type));
+    throw EnvoyException(fmt::format("Unknown LocalInFile response: {}", static_cast<int>(pkt_type)));
     break;
   }
   }
 }
 
+void MySQLDecoder::finishQuery(uint16_t error_code) {
+  if (callbacks_ != nullptr) {
+    QueryResult result;
+    result.command_ = queryCommand_;
+    result.start_ = queryStart_;
+    result.end_ = now_;
+    result.rows_ = queryRows_;
+    result.rowBytes_ = queryRowBytes_;
+    result.errorCode_ = error_code;
+    result.fingerprint_ = queryFingerprint_;
+    result.query_ = queryText_;
+    result.statementId_ = queryStatementId_;
+    result.schema_ = schema_;
+    callbacks_->onQueryResult(result);
+  }
+
+  resetQueryState();
+}
+
 void MySQLDecoder::resetQueryState() {
   connState_ = ConnectionState::ReadClientQuery;
   queryState_ = QueryState::Idle;
   sequenceId_ = 0;
 }
 
+PacketQueue::PacketQueue(size_t capacity) : head_(0), size_(0), hits_(0), misses_(0) {
+  // Keep the capacity a power of two so slot indices can be masked.
+  size_t n = 1;
+  while (n < capacity) {
+    n <<= 1;
+  }
+  slots_.resize(n);
+}
+
+Packet& PacketQueue::push(uint32_t capabilities) {
+  if (size_ == slots_.size()) {
+    grow();
+  }
+
+  PacketPtr& slot = slots_[(head_ + size_) & (slots_.size() - 1)];
+  if (slot) {
+    hits_++;
+    slot->reset(capabilities);
+  } else {
+    misses_++;
+    slot = std::make_unique<Packet>(capabilities);
+  }
+
+  size_++;
+  return *slot;
+}
+
+void PacketQueue::pop() {
+  assert(size_ > 0);
+  Packet& pkt = front();
+  pkt.buffer_.drain(pkt.buffer_.length());
+  head_ = (head_ + 1) & (slots_.size() - 1);
+  size_--;
+}
+
+Packet& PacketQueue::front() {
+  assert(size_ > 0);
+  return *slots_[head_];
+}
+
+Packet& PacketQueue::back() {
+  assert(size_ > 0);
+  return *slots_[(head_ + size_ - 1) & (slots_.size() - 1)];
+}
+
+Packet& PacketQueue::operator[](size_t i) {
+  assert(i < size_);
+  return *slots_[(head_ + i) & (slots_.size() - 1)];
+}
+
+uint64_t PacketQueue::bytes() const {
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < size_; i++) {
+    bytes += slots_[(head_ + i) & (slots_.size() - 1)]->buffer_.length();
+  }
+  return bytes;
+}
+
+void PacketQueue::grow() {
+  // The ring is full, so every slot holds a queued packet. Unroll them in order into a ring twice
+  // the size; the new slots are filled lazily by push().
+  std::vector<PacketPtr> slots(slots_.size() * 2);
+  for (size_t i = 0; i < size_; i++) {
+    slots[i] = std::move(slots_[(head_ + i) & (slots_.size() - 1)]);
+  }
+  slots_.swap(slots);
+  head_ = 0;
+}
+
 // https://dev.mysql.com/doc/internals/en/basic-types.html
 
 uint64_t BufferHelper::peekFixedInt(Buffer::Instance& data, uint64_t size) {
@@ -385,8 +1400,8 @@ uint64_t BufferHelper::peekFixedInt(Buffer::Instance& data, uint64_t size) {
 
   uint8_t* mem = reinterpret_cast<uint8_t*>(data.linearize(size));
   uint64_t val = 0;
-  for (int i = 0, s = 0; i < size; i++, s += 8) {
-    val |= mem[i] << s;
+  for (uint64_t i = 0, s = 0; i < size; i++, s += 8) {
+    val |= static_cast<uint64_t>(mem[i]) << s;
   }
 
   return val;
@@ -427,26 +1442,231 @@ void BufferHelper::peekBytes(Buffer::Instance& data, uint8_t* out, size_t out_le
   std::memcpy(out, mem, out_len);
 }
 
-void BufferHelper::getBytes(Buffer::Instance& data, uint8_t* out, size_t out_len) {
-  if (data.length() < out_len) {
-    throw EnvoyException(fmt::format("Invalid buffer size: {} {}", data.length(), out_len));
+void BufferHelper::getBytes(Buffer::Instance& data, uint8_t* out, size_t out_len) {
+  if (data.length() < out_len) {
+    throw EnvoyException(fmt::format("Invalid buffer size: {} {}", data.length(), out_len));
+  }
+
+  void* mem = data.linearize(out_len);
+  std::memcpy(out, mem, out_len);
+  data.drain(out_len);
+}
+
+void BufferHelper::skipBytes(Buffer::Instance& data, size_t len) {
+  if (data.length() < len) {
+    throw EnvoyException(fmt::format("Invalid buffer size: {} {}", data.length(), len));
+  }
+
+  data.drain(len);
+}
+
+uint64_t BufferHelper::getLenEncInt(Buffer::Instance& data) {
+  uint8_t len = getByte(data);
+  if (len <= 0) {
+    return 0;
+  }
+
+  uint8_t size = 0;
+  if (len < 0xfb) {
+    return len;
+  } else if (len == 0xfc) {
+    size = 2;
+  } else if (len == 0xfd) {
+    size = 3;
+  } else if (len == 0xfe) {
+    size = 8;
+  } else {
+    throw EnvoyException(fmt::format("Unknown length encoded int: {}", len));
+  }
+
+  return getFixedInt(data, size);
+}
+
+uint8_t BufferHelper::getInt8(Buffer::Instance& data) { return getFixedInt(data, 1); }
+
+uint8_t BufferHelper::peekInt8(Buffer::Instance& data) { return peekFixedInt(data, 1); }
+
+uint16_t BufferHelper::getInt16(Buffer::Instance& data) { return getFixedInt(data, 2); }
+
+uint16_t BufferHelper::peekInt16(Buffer::Instance& data) { return peekFixedInt(data, 2); }
+
+uint32_t BufferHelper::getInt24(Buffer::Instance& data) { return getFixedInt(data, 3); }
+
+uint32_t BufferHelper::peekInt24(Buffer::Instance& data) { return peekFixedInt(data, 3); }
+
+uint32_t BufferHelper::getInt32(Buffer::Instance& data) { return getFixedInt(data, 4); }
+
+uint32_t BufferHelper::peekInt32(Buffer::Instance& data) { return peekFixedInt(data, 4); }
+
+std::string BufferHelper::getCString(Buffer::Instance& data) {
+  char end = '\0';
+  ssize_t index = data.search(&end, sizeof(end), 0);
+  if (index == -1) {
+    throw EnvoyException(fmt::format("Invalid CString"));
+  }
+
+  // Copy straight out of the slices; linearizing would move the string around first.
+  std::string ret(index, '\0');
+  data.copyOut(0, index, &ret[0]);
+  data.drain(index + 1);
+  return ret;
+}
+
+std::string BufferHelper::getLenPrefixedString(Buffer::Instance& data) {
+  uint64_t size = getInt8(data);
+  if (size == 0) {
+    throw EnvoyException(fmt::format("Invalid length prefixed string"));
+  }
+
+  std::string s;
+  s.resize(size);
+  assert(s.capacity() >= size);
+  getBytes(data, reinterpret_cast<uint8_t *>(&s[0]), size);
+
+  return s;
+}
+
+std::string BufferHelper::getLenEncString(Buffer::Instance& data) {
+  uint64_t size = getLenEncInt(data);
+  if (size == 0) {
+    return std::string();
+  }
+
+  std::string s;
+  s.resize(size);
+  assert(s.capacity() >= size);
+  getBytes(data, reinterpret_cast<uint8_t *>(&s[0]), size);
+
+  return s;
+}
+
+std::string BufferHelper::getStringFromBuffer(Buffer::Instance& data, size_t size) {
+  if (size == 0) {
+    return std::string();
+  }
+
+  // TODO: Replace it with std::unique<char *>? can avoid unnessary
+  // initialization in s.resize()
+  std::string s;
+  s.resize(size);
+  assert(s.capacity() >= size);
+  getBytes(data, reinterpret_cast<uint8_t *>(&s[0]), size);
+
+  return s;
+}
+
+std::string BufferHelper::getStringFromRestOfBuffer(Buffer::Instance& data) {
+  return getStringFromBuffer(data, data.length());
+}
+
+BufferCursor::BufferCursor(Buffer::Instance& data) : data_(data), length_(data.length()) {
+  reload();
+}
+
+BufferCursor::~BufferCursor() { sync(); }
+
+void BufferCursor::sync() {
+  if (pos_ != start_) {
+    data_.drain(pos_ - start_);
+    start_ = pos_;
+  }
+}
+
+void BufferCursor::reload() {
+  Buffer::RawSlice slice;
+  data_.getRawSlices(&slice, 1);
+
+  // getRawSlices() may hand back an empty slice past the end of the data, see its comment.
+  start_ = pos_ = static_cast<const uint8_t*>(slice.mem_);
+  end_ = pos_ + std::min<uint64_t>(slice.len_, length_);
+}
+
+void BufferCursor::ensure(uint64_t size) {
+  if (contiguous(size)) {
+    return;
+  }
+
+  if (length_ < size) {
+    throw EnvoyException(fmt::format("Invalid buffer size: {} {}", length_, size));
+  }
+
+  sync();
+  data_.linearize(size);
+  reload();
+}
+
+uint64_t BufferCursor::peekFixedInt(uint64_t size) {
+  ensure(size);
+
+  uint64_t val = 0;
+  for (uint64_t i = 0, s = 0; i < size; i++, s += 8) {
+    val |= static_cast<uint64_t>(pos_[i]) << s;
+  }
+
+  return val;
+}
+
+uint64_t BufferCursor::getFixedInt(uint64_t size) {
+  auto val = peekFixedInt(size);
+  pos_ += size;
+  length_ -= size;
+  return val;
+}
+
+uint8_t BufferCursor::peekByte() {
+  if (length_ == 0) {
+    throw EnvoyException(fmt::format("Invalid buffer size, buffer is empty"));
+  }
+
+  ensure(sizeof(uint8_t));
+  return *pos_;
+}
+
+uint8_t BufferCursor::getByte() {
+  uint8_t ret = peekByte();
+  pos_++;
+  length_--;
+  return ret;
+}
+
+void BufferCursor::peekBytes(uint8_t* out, size_t out_len) {
+  if (contiguous(out_len)) {
+    std::memcpy(out, pos_, out_len);
+    return;
+  }
+
+  if (length_ < out_len) {
+    throw EnvoyException(fmt::format("Invalid buffer size: {} {}", length_, out_len));
   }
 
-  void* mem = data.linearize(out_len);
-  std::memcpy(out, mem, out_len);
-  data.drain(out_len);
+  // Copy across the slices rather than linearizing them, which would copy the data twice.
+  data_.copyOut(pos_ - start_, out_len, out);
 }
 
-void BufferHelper::skipBytes(Buffer::Instance& data, size_t len) {
-  if (data.length() < len) {
-    throw EnvoyException(fmt::format("Invalid buffer size: {} {}", data.length(), len));
+void BufferCursor::getBytes(uint8_t* out, size_t out_len) {
+  peekBytes(out, out_len);
+  skipBytes(out_len);
+}
+
+void BufferCursor::skipBytes(size_t len) {
+  if (contiguous(len)) {
+    pos_ += len;
+    length_ -= len;
+    return;
   }
 
-  data.drain(len);
+  if (length_ < len) {
+    throw EnvoyException(fmt::format("Invalid buffer size: {} {}", length_, len));
+  }
+
+  sync();
+  data_.drain(len);
+  length_ -= len;
+  reload();
 }
 
-uint64_t BufferHelper::getLenEncInt(Buffer::Instance& data) {
-  uint8_t len = getByte(data);
+uint64_t BufferCursor::getLenEncInt() {
+  uint8_t len = getByte();
   if (len <= 0) {
     return 0;
   }
@@ -464,100 +1684,92 @@ uint64_t BufferHelper::getLenEncInt(Buffer::Instance& data) {
     throw EnvoyException(fmt::format("Unknown length encoded int: {}", len));
   }
 
-  std::vector<uint8_t> mem(size);
-
-  getBytes(data, &mem[0], size);
-
-  uint64_t val = 0;
-  for (int i = 0, s = 0; i < size; i++, s += 8) {
-    val |= mem[i] << s;
-  }
-
-  return val;
+  return getFixedInt(size);
 }
 
-uint8_t BufferHelper::getInt8(Buffer::Instance& data) { return getFixedInt(data, 1); }
+uint8_t BufferCursor::getInt8() { return getFixedInt(1); }
 
-uint8_t BufferHelper::peekInt8(Buffer::Instance& data) { return peekFixedInt(data, 1); }
+uint8_t BufferCursor::peekInt8() { return peekFixedInt(1); }
 
-uint16_t BufferHelper::getInt16(Buffer::Instance& data) { return getFixedInt(data, 2); }
+uint16_t BufferCursor::getInt16() { return getFixedInt(2); }
 
-uint16_t BufferHelper::peekInt16(Buffer::Instance& data) { return peekFixedInt(data, 2); }
+uint16_t BufferCursor::peekInt16() { return peekFixedInt(2); }
 
-uint32_t BufferHelper::getInt24(Buffer::Instance& data) { return getFixedInt(data, 3); }
+uint32_t BufferCursor::getInt24() { return getFixedInt(3); }
 
-uint32_t BufferHelper::peekInt24(Buffer::Instance& data) { return peekFixedInt(data, 3); }
+uint32_t BufferCursor::peekInt24() { return peekFixedInt(3); }
 
-uint32_t BufferHelper::getInt32(Buffer::Instance& data) { return getFixedInt(data, 4); }
+uint32_t BufferCursor::getInt32() { return getFixedInt(4); }
 
-uint32_t BufferHelper::peekInt32(Buffer::Instance& data) { return peekFixedInt(data, 4); }
+uint32_t BufferCursor::peekInt32() { return peekFixedInt(4); }
 
-std::string BufferHelper::getCString(Buffer::Instance& data) {
-  char end = '\0';
-  ssize_t index = data.search(&end, sizeof(end), 0);
-  if (index == -1) {
-    throw EnvoyException(fmt::format("Invalid CString"));
+std::string BufferCursor::getCString() {
+  const void* end = ByteSearch::find(pos_, end_ - pos_, '\0');
+  if (end == nullptr) {
+    sync();
+    char nul = '\0';
+    ssize_t index = data_.search(&nul, sizeof(nul), 0);
+    if (index == -1 || static_cast<uint64_t>(index) >= length_) {
+      throw EnvoyException(fmt::format("Invalid CString"));
+    }
+    ensure(index + 1);
+    end = pos_ + index;
   }
 
-  char* start = reinterpret_cast<char*>(data.linearize(index + 1));
-  std::string ret(start);
-  data.drain(index + 1);
+  std::string ret(reinterpret_cast<const char*>(pos_), static_cast<const uint8_t*>(end) - pos_);
+  skipBytes(ret.size() + 1);
   return ret;
 }
 
-std::string BufferHelper::getLenPrefixedString(Buffer::Instance& data) {
-  uint64_t size = getInt8(data);
+std::string BufferCursor::getLenPrefixedString() {
+  uint64_t size = getInt8();
   if (size == 0) {
     throw EnvoyException(fmt::format("Invalid length prefixed string"));
   }
 
-  std::string s;
-  s.resize(size);
-  assert(s.capacity() >= size);
-  getBytes(data, reinterpret_cast<uint8_t *>(&s[0]), size);
-
-  return s;
+  return getStringFromBuffer(size);
 }
 
-std::string BufferHelper::getLenEncString(Buffer::Instance& data) {
-  uint64_t size = getLenEncInt(data);
+std::string BufferCursor::getLenEncString() { return getStringFromBuffer(getLenEncInt()); }
+
+std::string BufferCursor::getStringFromBuffer(size_t size) {
   if (size == 0) {
     return std::string();
   }
 
-  std::string s;
-  s.resize(size);
-  assert(s.capacity() >= size);
-  getBytes(data, reinterpret_cast<uint8_t *>(&s[0]), size);
-
-  return s;
-}
-
-std::string BufferHelper::getStringFromBuffer(Buffer::Instance& data, size_t size) {
-  if (size == 0) {
-    return std::string();
+  if (contiguous(size)) {
+    std::string s(reinterpret_cast<const char*>(pos_), size);
+    pos_ += size;
+    length_ -= size;
+    return s;
   }
 
-  // TODO: Replace it with std::unique<char *>? can avoid unnessary
-  // initialization in s.resize()
   std::string s;
   s.resize(size);
-  assert(s.capacity() >= size);
-  getBytes(data, reinterpret_cast<uint8_t *>(&s[0]), size);
+  getBytes(reinterpret_cast<uint8_t*>(&s[0]), size);
 
   return s;
 }
 
-std::string BufferHelper::getStringFromRestOfBuffer(Buffer::Instance& data) {
-  return getStringFromBuffer(data, data.length());
-}
+std::string BufferCursor::getStringFromRestOfBuffer() { return getStringFromBuffer(length_); }
 
 Packet::Packet(uint32_t capabilities) : seqId_(0), moreData_(false), capabilities_(capabilities) {}
 
+void Packet::reset(uint32_t capabilities) {
+  seqId_ = 0;
+  moreData_ = false;
+  capabilities_ = capabilities;
+  buffer_.drain(buffer_.length());
+}
+
 void Packet::fromBuffer(Buffer::Instance& buffer) {
-  auto length = BufferHelper::getInt24(buffer);
+  uint32_t length;
+  {
+    BufferCursor cursor(buffer);
+    length = cursor.getInt24();
+    seqId_ = cursor.getInt8();
+  }
 
-  seqId_ = BufferHelper::getInt8(buffer);
   // ENVOY_LOG(trace, "=== {} = {}\n", length, buffer.length());
   assert(buffer.length() >= length);
 
@@ -570,16 +1782,21 @@ void Packet::fromBuffer(Buffer::Instance& buffer) {
 
 uint64_t Packet::length() { return buffer_.length(); }
 
-uint8_t Packet::header() { return BufferHelper::peekInt8(buffer_); }
+uint8_t Packet::header() {
+  BufferCursor cursor(buffer_);
+  return cursor.peekInt8();
+}
 
 PacketType Packet::type() {
-  uint8_t header = BufferHelper::peekInt8(buffer_);
+  BufferCursor cursor(buffer_);
+  uint8_t header = cursor.peekInt8();
   if (header == OK_HEADER && buffer_.length() >= 7) {
     return PacketType::OkPacket;
   } else if (header == EOF_HEADER && buffer_.length() <= 9) {
     return PacketType::EOFPacket;
   } else if (header == ERR_HEADER) {
-    auto error_code = BufferHelper::peekInt16(buffer_);
+    // The error code follows the header byte.
+    auto error_code = buffer_.length() >= 3 ? cursor.peekInt24() >> 8 : 0;
     if (error_code == 0xFFFF) {
       return PacketType::Progress;
     }
@@ -598,7 +1815,8 @@ bool Packet::containsFullPkt(Buffer::Instance& buffer) {
   }
 
   // Get the packet length
-  uint32_t pkt_len = BufferHelper::peekFixedInt(buffer, 3);
+  BufferCursor cursor(buffer);
+  uint32_t pkt_len = cursor.peekInt24();
   if (buffer.length() < (pkt_len + sizeof(uint32_t))) {
     return false;
   }
@@ -609,20 +1827,20 @@ bool Packet::containsFullPkt(Buffer::Instance& buffer) {
 ServerHandshakeMessage::ServerHandshakeMessage() {}
 
 void ServerHandshakeMessage::fromPacket(Packet& pkt) {
-  Buffer::OwnedImpl& buffer = pkt.buffer_;
+  BufferCursor cursor(pkt.buffer_);
 
-  protoVersion_ = BufferHelper::getInt8(buffer);
-  srvName_ = BufferHelper::getCString(buffer);
-  threadId_ = BufferHelper::getInt32(buffer);
-  authPluginData1_ = BufferHelper::getCString(buffer);
-  capabilities_ = BufferHelper::getInt16(buffer);
-  charset_ = BufferHelper::getInt8(buffer);
-  srvStatus_ = BufferHelper::getInt16(buffer);
-  capabilities_ |= (BufferHelper::getInt16(buffer) << 16);
+  protoVersion_ = cursor.getInt8();
+  srvName_ = cursor.getCString();
+  threadId_ = cursor.getInt32();
+  authPluginData1_ = cursor.getCString();
+  capabilities_ = cursor.getInt16();
+  charset_ = cursor.getInt8();
+  srvStatus_ = cursor.getInt16();
+  capabilities_ |= (cursor.getInt16() << 16);
 
-  uint32_t auth_plugin_data_len = BufferHelper::getInt8(buffer);
+  uint32_t auth_plugin_data_len = cursor.getInt8();
 
-  BufferHelper::skipBytes(buffer, 10);
+  cursor.skipBytes(10);
 
   if ((capabilities_ & CLIENT_PLUGIN_AUTH) || (capabilities_ & CLIENT_SECURE_CONNECTION)) {
     // We are guaranteed to have at least 13 bytes if
@@ -631,17 +1849,17 @@ void ServerHandshakeMessage::fromPacket(Packet& pkt) {
     // just use BufferHelper::getCString() here?
     // TODO:
     size_t len = std::max(static_cast<uint32_t>(13), auth_plugin_data_len - 8);
-    authPluginData2_ = BufferHelper::getStringFromBuffer(buffer, len);
+    authPluginData2_ = cursor.getStringFromBuffer(len);
   }
 
   if (capabilities_ & CLIENT_PLUGIN_AUTH) {
     try {
-      authPluginName_ = BufferHelper::getCString(buffer);
+      authPluginName_ = cursor.getCString();
     } catch (...) {
       // Looks like in certain MySQL versions, due to a bug,
       // auth_plugin_name may miss trailing '\0'.  So we will read
       // rest of the data.
-      authPluginName_ = BufferHelper::getStringFromRestOfBuffer(buffer);
+      authPluginName_ = cursor.getStringFromRestOfBuffer();
     }
   }
 
@@ -756,49 +1974,49 @@ std::string ServerHandshakeMessage::toString() {
 ClientHandshakeMessage::ClientHandshakeMessage() {}
 
 void ClientHandshakeMessage::fromPacket(Packet& pkt) {
-  Buffer::OwnedImpl& buffer = pkt.buffer_;
+  BufferCursor cursor(pkt.buffer_);
 
-  capabilities_ = BufferHelper::getInt16(buffer);
+  capabilities_ = cursor.getInt16();
 
   if (capabilities_ & CLIENT_PROTOCOL_41) {
-    capabilities_ |= (BufferHelper::getInt16(buffer) << 16);
-    maxPktSize_ = BufferHelper::getInt32(buffer);
-    charset_ = BufferHelper::getInt8(buffer);
+    capabilities_ |= (cursor.getInt16() << 16);
+    maxPktSize_ = cursor.getInt32();
+    charset_ = cursor.getInt8();
 
-    BufferHelper::skipBytes(buffer, 23);
+    cursor.skipBytes(23);
 
-    userName_ = BufferHelper::getCString(buffer);
+    userName_ = cursor.getCString();
 
     if (capabilities_ & CLIENT_PLUGIN_AUTH_LENENC_CLIENT_DATA) {
-      authResp_ = BufferHelper::getLenEncString(buffer);
+      authResp_ = cursor.getLenEncString();
     } else if (capabilities_ & CLIENT_SECURE_CONNECTION) {
-      authResp_ = BufferHelper::getLenPrefixedString(buffer);
+      authResp_ = cursor.getLenPrefixedString();
     } else {
-      authResp_ = BufferHelper::getCString(buffer);
+      authResp_ = cursor.getCString();
     }
 
     if (capabilities_ & CLIENT_CONNECT_WITH_DB) {
-      dbName_ = BufferHelper::getCString(buffer);
+      dbName_ = cursor.getCString();
     }
 
     if (capabilities_ & CLIENT_PLUGIN_AUTH) {
-      authPluginName_ = BufferHelper::getCString(buffer);
+      authPluginName_ = cursor.getCString();
     }
 
     if (capabilities_ & CLIENT_CONNECT_ATTRS) {
       string key, val;
-      uint64_t len = BufferHelper::getLenEncInt(buffer);
+      uint64_t len = cursor.getLenEncInt();
       while (len > 0) {
-        key = BufferHelper::getLenEncString(buffer);
-        val = BufferHelper::getLenEncString(buffer);
+        key = cursor.getLenEncString();
+        val = cursor.getLenEncString();
         connAttribs_[key] = val;
         len -= (key.length() + val.length() + 1 + 1);
       }
     }
   } else {
-    maxPktSize_ = BufferHelper::getInt24(buffer);
-    userName_ = BufferHelper::getCString(buffer);
-    password_ = BufferHelper::getStringFromRestOfBuffer(buffer);
+    maxPktSize_ = cursor.getInt24();
+    userName_ = cursor.getCString();
+    password_ = cursor.getStringFromRestOfBuffer();
   }
 }
 
@@ -877,27 +2095,28 @@ std::string ClientHandshakeMessage::toString() {
 OkMessage::OkMessage() {}
 
 void OkMessage::fromPacket(Packet& pkt) {
-  Buffer::OwnedImpl& buffer = pkt.buffer_;
+  BufferCursor cursor(pkt.buffer_);
 
-  uint8_t h = BufferHelper::getInt8(buffer);
-  assert(h == 0x00);
+  // The EOF header when an OK packet ends a result set under CLIENT_DEPRECATE_EOF.
+  uint8_t h = cursor.getInt8();
+  assert(h == OK_HEADER || h == EOF_HEADER);
 
-  affectedRows_ = BufferHelper::getLenEncInt(buffer);
-  lastInsertId_ = BufferHelper::getLenEncInt(buffer);
+  affectedRows_ = cursor.getLenEncInt();
+  lastInsertId_ = cursor.getLenEncInt();
   if (pkt.capabilities_ & CLIENT_PROTOCOL_41) {
-    status_ = BufferHelper::getInt16(buffer);
-    warnings_ = BufferHelper::getInt16(buffer);
+    status_ = cursor.getInt16();
+    warnings_ = cursor.getInt16();
   } else if (pkt.capabilities_ & CLIENT_TRANSACTIONS) {
-    status_ = BufferHelper::getInt16(buffer);
+    status_ = cursor.getInt16();
   }
 
   if (pkt.capabilities_ & CLIENT_SESSION_TRACKING) {
-    info_ = BufferHelper::getLenEncString(buffer);
+    info_ = cursor.getLenEncString();
     if (status_ & SERVER_SESSION_STATE_CHANGED) {
-      sessionStateChanges_ = BufferHelper::getLenEncString(buffer);
+      sessionStateChanges_ = cursor.getLenEncString();
     }
   } else {
-    info_ = BufferHelper::getStringFromRestOfBuffer(buffer);
+    info_ = cursor.getStringFromRestOfBuffer();
   }
 }
 
@@ -917,27 +2136,27 @@ std::string OkMessage::toString() {
 ErrMessage::ErrMessage() {}
 
 void ErrMessage::fromPacket(Packet& pkt) {
-  Buffer::OwnedImpl& buffer = pkt.buffer_;
+  BufferCursor cursor(pkt.buffer_);
 
   // https://mariadb.com/kb/en/library/err_packet/
 
-  uint8_t h = BufferHelper::getInt8(buffer);
+  uint8_t h = cursor.getInt8();
   assert(h == 0xFF);
 
-  errorCode_ = BufferHelper::getInt16(buffer);
+  errorCode_ = cursor.getInt16();
 
   if (errorCode_ == 0xFFFF && pkt.capabilities_ & CLIENT_PROGRESS) {
     /* progress reporting */
-    BufferHelper::skipBytes(buffer, 1); // Stage
-    BufferHelper::skipBytes(buffer, 1); // Max stage
-    BufferHelper::skipBytes(buffer, 3); // Progress
-    errorMsg_ = BufferHelper::getLenEncString(buffer);
+    cursor.skipBytes(1); // Stage
+    cursor.skipBytes(1); // Max stage
+    cursor.skipBytes(3); // Progress
+    errorMsg_ = cursor.getLenEncString();
   } else {
     if (pkt.capabilities_ & CLIENT_PROTOCOL_41) {
-      sqlMarker_ = BufferHelper::getStringFromBuffer(buffer, 1);
-      sqlState_ = BufferHelper::getStringFromBuffer(buffer, 5);
+      sqlMarker_ = cursor.getStringFromBuffer(1);
+      sqlState_ = cursor.getStringFromBuffer(5);
     }
-    errorMsg_ = BufferHelper::getStringFromRestOfBuffer(buffer);
+    errorMsg_ = cursor.getStringFromRestOfBuffer();
   }
 }
 
@@ -952,17 +2171,17 @@ std::string ErrMessage::toString() {
   return s.str();
 }
 
-EofMessage::EofMessage() {}
+EofMessage::EofMessage() : warnings_(0), status_(0) {}
 
 void EofMessage::fromPacket(Packet& pkt) {
-  Buffer::OwnedImpl& buffer = pkt.buffer_;
+  BufferCursor cursor(pkt.buffer_);
 
-  uint8_t h = BufferHelper::getInt8(buffer);
-  assert(h == 0xFE && buffer.length() < 9);
+  uint8_t h = cursor.getInt8();
+  assert(h == 0xFE && cursor.length() < 9);
 
   if (pkt.capabilities_ & CLIENT_PROTOCOL_41) {
-    warnings_ = BufferHelper::getInt16(buffer);
-    status_ = BufferHelper::getInt16(buffer);
+    warnings_ = cursor.getInt16();
+    status_ = cursor.getInt16();
   }
 }
 
@@ -975,108 +2194,104 @@ std::string EofMessage::toString() {
   return s.str();
 }
 
-QueryMessage::QueryMessage() {}
+QueryMessage::QueryMessage() : command_(0), statementId_(0) {}
 
-void QueryMessage::fromPacket(Packet& pkt) {
-  Buffer::Instance& buffer = pkt.buffer_;
-
-  command_ = BufferHelper::getInt8(buffer);
-
-  switch (command_) {
+const char* QueryMessage::commandName(uint8_t command) {
+  switch (command) {
   case COM_SLEEP:
-    commandName_ = "COM_SLEEP";
-    break;
+    return "COM_SLEEP";
   case COM_QUIT:
-    commandName_ = "COM_QUIT";
-    break;
+    return "COM_QUIT";
   case COM_INIT_DB:
-    commandName_ = "COM_INIT_DB";
-    break;
+    return "COM_INIT_DB";
   case COM_QUERY:
-    commandName_ = "COM_QUERY";
-    info_ = BufferHelper::getStringFromRestOfBuffer(buffer);
-    break;
+    return "COM_QUERY";
   case COM_FIELD_LIST:
-    commandName_ = "COM_FIELD_LIST";
-    break;
+    return "COM_FIELD_LIST";
   case COM_CREATE_DB:
-    commandName_ = "COM_CREATE_DB";
-    break;
+    return "COM_CREATE_DB";
   case COM_DROP_DB:
-    commandName_ = "COM_DROP_DB";
-    break;
+    return "COM_DROP_DB";
   case COM_REFRESH:
-    commandName_ = "COM_REFRESH";
-    break;
+    return "COM_REFRESH";
   case COM_SHUTDOWN:
-    commandName_ = "COM_SHUTDOWN";
-    break;
+    return "COM_SHUTDOWN";
   case COM_STATISTICS:
-    commandName_ = "COM_STATISTICS";
-    break;
+    return "COM_STATISTICS";
   case COM_PROCESS_INFO:
-    commandName_ = "COM_PROCESS_INFO";
-    break;
+    return "COM_PROCESS_INFO";
   case COM_CONNECT:
-    commandName_ = "COM_CONNECT";
-    break;
+    return "COM_CONNECT";
   case COM_PROCESS_KILL:
-    commandName_ = "COM_PROCESS_KILL";
-    break;
+    return "COM_PROCESS_KILL";
   case COM_DEBUG:
-    commandName_ = "COM_DEBUG";
-    break;
+    return "COM_DEBUG";
   case COM_PING:
-    commandName_ = "COM_PING";
-    break;
+    return "COM_PING";
   case COM_TIME:
-    commandName_ = "COM_TIME";
-    break;
+    return "COM_TIME";
   case COM_DELAYED_INSERT:
-    commandName_ = "COM_DELAYED_INSERT";
-    break;
+    return "COM_DELAYED_INSERT";
   case COM_CHANGE_USER:
-    commandName_ = "COM_CHANGE_USER";
-    break;
+    return "COM_CHANGE_USER";
   case COM_BINLOG_DUMP:
-    commandName_ = "COM_BINLOG_DUMP";
-    break;
+    return "COM_BINLOG_DUMP";
   case COM_TABLE_DUMP:
-    commandName_ = "COM_TABLE_DUMP";
-    break;
+    return "COM_TABLE_DUMP";
   case COM_CONNECT_OUT:
-    commandName_ = "COM_CONNECT_OUT";
-    break;
+    return "COM_CONNECT_OUT";
   case COM_REGISTER_SLAVE:
-    commandName_ = "COM_REGISTER_SLAVE";
-    break;
+    return "COM_REGISTER_SLAVE";
   case COM_STMT_PREPARE:
-    commandName_ = "COM_STMT_PREPARE";
-    break;
+    return "COM_STMT_PREPARE";
   case COM_STMT_EXECUTE:
-    commandName_ = "COM_STMT_EXECUTE";
-    break;
+    return "COM_STMT_EXECUTE";
   case COM_STMT_SEND_LONG_DATA:
-    commandName_ = "COM_STMT_SEND_LONG_DATA";
-    break;
+    return "COM_STMT_SEND_LONG_DATA";
   case COM_STMT_CLOSE:
-    commandName_ = "COM_STMT_CLOSE";
-    break;
+    return "COM_STMT_CLOSE";
   case COM_STMT_RESET:
-    commandName_ = "COM_STMT_RESET";
-    break;
+    return "COM_STMT_RESET";
   case COM_SET_OPTION:
-    commandName_ = "COM_SET_OPTION";
-    break;
+    return "COM_SET_OPTION";
   case COM_STMT_FETCH:
-    commandName_ = "COM_STMT_FETCH";
-    break;
+    return "COM_STMT_FETCH";
   case COM_DAEMON:
-    commandName_ = "COM_DAEMON";
-    break;
+    return "COM_DAEMON";
   default:
+    return nullptr;
+  }
+}
+
+void QueryMessage::fromPacket(Packet& pkt) {
+  BufferCursor cursor(pkt.buffer_);
+
+  command_ = cursor.getInt8();
+
+  const char* name = commandName(command_);
+  if (name == nullptr) {
     throw EnvoyException(fmt::format("Unknown command: {}", command_));
   }
+  commandName_ = name;
+
+  if (command_ == COM_QUERY || command_ == COM_STMT_PREPARE) {
+    info_ = cursor.getStringFromRestOfBuffer();
+  } else if (hasStatementId(command_)) {
+    statementId_ = cursor.getInt32();
+  }
+}
+
+bool QueryMessage::hasStatementId(uint8_t command) {
+  switch (command) {
+  case COM_STMT_EXECUTE:
+  case COM_STMT_SEND_LONG_DATA:
+  case COM_STMT_CLOSE:
+  case COM_STMT_RESET:
+  case COM_STMT_FETCH:
+    return true;
+  default:
+    return false;
+  }
 }
 
 std::string QueryMessage::toString() {
@@ -1091,9 +2306,9 @@ std::string QueryMessage::toString() {
 RowMessage::RowMessage() {}
 
 void RowMessage::fromPacket(Packet& pkt) {
-  Buffer::Instance& buffer = pkt.buffer_;
-  while (buffer.length() > 0) {
-    auto s = BufferHelper::getLenEncString(buffer);
+  BufferCursor cursor(pkt.buffer_);
+  while (cursor.length() > 0) {
+    auto s = cursor.getLenEncString();
     info_.push_back(s);
   }
 }
@@ -1109,4 +2324,382 @@ std::string RowMessage::toString() {
   return s.str();
 }
 
+RowView::RowView() : data_(nullptr), bytes_(0) {}
+
+// Reads a length encoded integer from raw packet memory. Sets <null> instead for the 0xfb marker
+// that text protocol rows use for NULL columns.
+static uint64_t readLenEncInt(const uint8_t*& pos, const uint8_t* end, bool& null) {
+  if (pos == end) {
+    throw EnvoyException(fmt::format("Invalid buffer size, buffer is empty"));
+  }
+
+  null = false;
+  uint8_t len = *pos++;
+  uint8_t size = 0;
+  if (len < 0xfb) {
+    return len;
+  } else if (len == 0xfb) {
+    null = true;
+    return 0;
+  } else if (len == 0xfc) {
+    size = 2;
+  } else if (len == 0xfd) {
+    size = 3;
+  } else if (len == 0xfe) {
+    size = 8;
+  } else {
+    throw EnvoyException(fmt::format("Unknown length encoded int: {}", len));
+  }
+
+  if (static_cast<size_t>(end - pos) < size) {
+    throw EnvoyException(fmt::format("Invalid buffer size: {} {}", end - pos, size));
+  }
+
+  uint64_t val = 0;
+  for (uint64_t i = 0, s = 0; i < size; i++, s += 8) {
+    val |= static_cast<uint64_t>(pos[i]) << s;
+  }
+  pos += size;
+
+  return val;
+}
+
+void RowView::fromPacket(Packet& pkt) {
+  uint64_t len = pkt.length();
+  const uint8_t* start = static_cast<const uint8_t*>(pkt.buffer_.linearize(len));
+  const uint8_t* pos = start;
+  const uint8_t* end = start + len;
+
+  data_ = reinterpret_cast<const char*>(start);
+  cols_.clear();
+  bytes_ = 0;
+
+  while (pos < end) {
+    bool null;
+    uint64_t size = readLenEncInt(pos, end, null);
+    if (null) {
+      cols_.push_back({static_cast<size_t>(pos - start), NullColumn});
+      continue;
+    }
+    if (static_cast<uint64_t>(end - pos) < size) {
+      throw EnvoyException(fmt::format("Invalid buffer size: {} {}", end - pos, size));
+    }
+
+    cols_.push_back({static_cast<size_t>(pos - start), size});
+    bytes_ += size;
+    pos += size;
+  }
+}
+
+bool RowView::isNull(size_t i) const { return cols_.at(i).length_ == NullColumn; }
+
+std::string_view RowView::column(size_t i) const {
+  const Column& col = cols_.at(i);
+  if (col.length_ == NullColumn) {
+    return std::string_view();
+  }
+
+  return std::string_view(data_ + col.offset_, col.length_);
+}
+
+std::string RowView::materialize(size_t i) const { return std::string(column(i)); }
+
+std::string RowView::toString() {
+  std::stringstream s;
+
+  s << cols_.size() << " items:: ";
+  for (const auto& col : cols_) {
+    if (col.length_ == NullColumn) {
+      s << "NULL ";
+    } else {
+      s << col.length_ << " ";
+    }
+  }
+
+  return s.str();
+}
+
+uint64_t RowView::count(Packet& pkt, uint64_t& bytes) {
+  uint64_t len = pkt.length();
+  const uint8_t* pos = static_cast<const uint8_t*>(pkt.buffer_.linearize(len));
+  const uint8_t* end = pos + len;
+
+  uint64_t columns = 0;
+  while (pos < end) {
+    bool null;
+    uint64_t size = readLenEncInt(pos, end, null);
+    if (static_cast<uint64_t>(end - pos) < size) {
+      throw EnvoyException(fmt::format("Invalid buffer size: {} {}", end - pos, size));
+    }
+
+    bytes += size;
+    pos += size;
+    columns++;
+  }
+
+  return columns;
+}
+
+// Reads a length encoded string from raw packet memory into <s>.
+static void readLenEncString(const uint8_t*& pos, const uint8_t* end, std::string& s) {
+  bool null;
+  uint64_t size = readLenEncInt(pos, end, null);
+  if (static_cast<uint64_t>(end - pos) < size) {
+    throw EnvoyException(fmt::format("Invalid buffer size: {} {}", end - pos, size));
+  }
+
+  s.assign(reinterpret_cast<const char*>(pos), size);
+  pos += size;
+}
+
+void ColumnDefinition::fromBytes(const uint8_t*& pos, const uint8_t* end) {
+  std::string catalog, org_table, org_name;
+  readLenEncString(pos, end, catalog);
+  readLenEncString(pos, end, schema_);
+  readLenEncString(pos, end, table_);
+  readLenEncString(pos, end, org_table);
+  readLenEncString(pos, end, name_);
+  readLenEncString(pos, end, org_name);
+
+  // The fixed length fields, whose length comes first and is always 0x0c.
+  bool null;
+  uint64_t fixed = readLenEncInt(pos, end, null);
+  if (fixed < 10 || static_cast<uint64_t>(end - pos) < fixed) {
+    throw EnvoyException(fmt::format("Invalid column definition: {} {}", end - pos, fixed));
+  }
+
+  charset_ = pos[0] | (pos[1] << 8);
+  length_ = pos[2] | (pos[3] << 8) | (pos[4] << 16) | (static_cast<uint32_t>(pos[5]) << 24);
+  type_ = pos[6];
+  flags_ = pos[7] | (pos[8] << 8);
+  decimals_ = pos[9];
+  pos += fixed;
+}
+
+std::string ColumnDefinition::toString() const {
+  std::stringstream s;
+
+  s << "Schema: " << schema_ << " Table: " << table_ << " Name: " << name_
+    << " Charset: " << charset_ << " Length: " << length_ << " Type: " << int(type_)
+    << " Flags: " << flags_ << " Decimals: " << int(decimals_);
+
+  return s.str();
+}
+
+BinaryRowView::BinaryRowView() : data_(nullptr), bytes_(0) {}
+
+// Reads the length of a binary protocol value of MYSQL_TYPE_* <type> and moves <pos> past any
+// prefix, onto the value itself.
+static uint64_t readBinaryValueLength(uint8_t type, const uint8_t*& pos, const uint8_t* end) {
+  switch (type) {
+  case MYSQL_TYPE_NULL:
+    return 0;
+  case MYSQL_TYPE_TINY:
+    return 1;
+  case MYSQL_TYPE_SHORT:
+  case MYSQL_TYPE_YEAR:
+    return 2;
+  case MYSQL_TYPE_LONG:
+  case MYSQL_TYPE_INT24:
+  case MYSQL_TYPE_FLOAT:
+    return 4;
+  case MYSQL_TYPE_LONGLONG:
+  case MYSQL_TYPE_DOUBLE:
+    return 8;
+  case MYSQL_TYPE_DATE:
+  case MYSQL_TYPE_DATETIME:
+  case MYSQL_TYPE_TIMESTAMP:
+  case MYSQL_TYPE_TIME:
+    if (pos == end) {
+      throw EnvoyException(fmt::format("Invalid buffer size, buffer is empty"));
+    }
+    return *pos++;
+  default: {
+    bool null;
+    return readLenEncInt(pos, end, null);
+  }
+  }
+}
+
+// Locates the NULL bitmap of a binary row, which follows the 0x00 header and is offset by two
+// bits. Returns the first value.
+static const uint8_t* binaryRowValues(const uint8_t* start, const uint8_t* end, size_t columns,
+                                      const uint8_t*& bitmap) {
+  size_t bitmap_len = (columns + 7 + 2) / 8;
+  if (static_cast<size_t>(end - start) < 1 + bitmap_len || *start != OK_HEADER) {
+    throw EnvoyException(fmt::format("Invalid binary row: {} bytes for {} columns", end - start,
+                                     columns));
+  }
+
+  bitmap = start + 1;
+  return bitmap + bitmap_len;
+}
+
+static bool binaryRowNull(const uint8_t* bitmap, size_t i) {
+  return bitmap[(i + 2) / 8] & (1 << ((i + 2) % 8));
+}
+
+// Bytes that precede a binary value of <type> and give its length, as far as the <size> of them
+// at <prefix> tell: none for fixed size types, one for temporal ones, or a length encoded int.
+static uint8_t binaryValuePrefix(uint8_t type, const uint8_t* prefix, uint8_t size) {
+  switch (type) {
+  case MYSQL_TYPE_NULL:
+  case MYSQL_TYPE_TINY:
+  case MYSQL_TYPE_SHORT:
+  case MYSQL_TYPE_YEAR:
+  case MYSQL_TYPE_LONG:
+  case MYSQL_TYPE_INT24:
+  case MYSQL_TYPE_FLOAT:
+  case MYSQL_TYPE_LONGLONG:
+  case MYSQL_TYPE_DOUBLE:
+    return 0;
+  case MYSQL_TYPE_DATE:
+  case MYSQL_TYPE_DATETIME:
+  case MYSQL_TYPE_TIMESTAMP:
+  case MYSQL_TYPE_TIME:
+    return 1;
+  default:
+    if (size == 0) {
+      return 1;
+    }
+    return prefix[0] == 0xfc ? 3 : prefix[0] == 0xfd ? 4 : prefix[0] == 0xfe ? 9 : 1;
+  }
+}
+
+void BinaryRowView::fromPacket(Packet& pkt, const std::vector<uint8_t>& types) {
+  uint64_t len = pkt.length();
+  const uint8_t* start = static_cast<const uint8_t*>(pkt.buffer_.linearize(len));
+  const uint8_t* end = start + len;
+  const uint8_t* bitmap;
+  const uint8_t* pos = binaryRowValues(start, end, types.size(), bitmap);
+
+  data_ = reinterpret_cast<const char*>(start);
+  cols_.clear();
+  bytes_ = 0;
+
+  for (size_t i = 0; i < types.size(); i++) {
+    if (binaryRowNull(bitmap, i)) {
+      cols_.push_back({static_cast<size_t>(pos - start), NullColumn});
+      continue;
+    }
+
+    uint64_t size = readBinaryValueLength(types[i], pos, end);
+    if (static_cast<uint64_t>(end - pos) < size) {
+      throw EnvoyException(fmt::format("Invalid buffer size: {} {}", end - pos, size));
+    }
+
+    cols_.push_back({static_cast<size_t>(pos - start), size});
+    bytes_ += size;
+    pos += size;
+  }
+}
+
+bool BinaryRowView::isNull(size_t i) const { return cols_.at(i).length_ == NullColumn; }
+
+std::string_view BinaryRowView::column(size_t i) const {
+  const Column& col = cols_.at(i);
+  if (col.length_ == NullColumn) {
+    return std::string_view();
+  }
+
+  return std::string_view(data_ + col.offset_, col.length_);
+}
+
+std::string BinaryRowView::toString() {
+  std::stringstream s;
+
+  s << cols_.size() << " items:: ";
+  for (const auto& col : cols_) {
+    if (col.length_ == NullColumn) {
+      s << "NULL ";
+    } else {
+      s << col.length_ << " ";
+    }
+  }
+
+  return s.str();
+}
+
+uint64_t BinaryRowView::count(Packet& pkt, const std::vector<uint8_t>& types, uint64_t& bytes) {
+  uint64_t len = pkt.length();
+  const uint8_t* start = static_cast<const uint8_t*>(pkt.buffer_.linearize(len));
+  const uint8_t* end = start + len;
+  const uint8_t* bitmap;
+  const uint8_t* pos = binaryRowValues(start, end, types.size(), bitmap);
+
+  for (size_t i = 0; i < types.size(); i++) {
+    if (binaryRowNull(bitmap, i)) {
+      continue;
+    }
+
+    uint64_t size = readBinaryValueLength(types[i], pos, end);
+    if (static_cast<uint64_t>(end - pos) < size) {
+      throw EnvoyException(fmt::format("Invalid buffer size: {} {}", end - pos, size));
+    }
+
+    bytes += size;
+    pos += size;
+  }
+
+  return types.size();
+}
+
+void MySQLDecoder::countStreamedBinaryRow(const uint8_t* data, uint64_t length) {
+  if (rowTypes_ == nullptr) {
+    // As handleBinaryRow(): without the column types the row is counted whole.
+    queryRowBytes_ += length;
+    totalRowBytes_ += length;
+    return;
+  }
+
+  // Walks the values of a binary row as BinaryRowView::count() does, once its header and NULL
+  // bitmap are in.
+  const std::vector<uint8_t>& types = *rowTypes_;
+  size_t head_len = 1 + (types.size() + 7 + 2) / 8;
+  while (length > 0) {
+    if (streamRowHead_.size() < head_len) {
+      uint64_t n = std::min<uint64_t>(length, head_len - streamRowHead_.size());
+      streamRowHead_.append(reinterpret_cast<const char*>(data), n);
+      data += n;
+      length -= n;
+      if (static_cast<uint8_t>(streamRowHead_[0]) != OK_HEADER) {
+        throw EnvoyException(fmt::format("Invalid binary row header: {}",
+                                         static_cast<uint8_t>(streamRowHead_[0])));
+      }
+      continue;
+    }
+
+    if (streamColumnRemaining_ > 0) {
+      uint64_t n = std::min(length, streamColumnRemaining_);
+      streamColumnRemaining_ -= n;
+      queryRowBytes_ += n;
+      totalRowBytes_ += n;
+      data += n;
+      length -= n;
+      continue;
+    }
+
+    const uint8_t* bitmap = reinterpret_cast<const uint8_t*>(streamRowHead_.data()) + 1;
+    while (streamColumn_ < types.size() && binaryRowNull(bitmap, streamColumn_)) {
+      streamColumn_++;
+    }
+    if (streamColumn_ == types.size()) {
+      throw EnvoyException(fmt::format("Invalid binary row: {} bytes past its {} columns",
+                                       length, types.size()));
+    }
+
+    uint8_t type = types[streamColumn_];
+    if (streamLenEncSize_ < binaryValuePrefix(type, streamLenEnc_, streamLenEncSize_)) {
+      streamLenEnc_[streamLenEncSize_++] = *data++;
+      length--;
+      continue;
+    }
+
+    const uint8_t* pos = streamLenEnc_;
+    streamColumnRemaining_ = readBinaryValueLength(type, pos, streamLenEnc_ + streamLenEncSize_);
+    streamLenEncSize_ = 0;
+    streamColumn_++;
+  }
+}
+
 }; // namespace MySQL
@@ -1,69 +1,82 @@
+#pragma once
+
+#include <chrono>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <sstream>
-#include <list>
 #include <map>
+#include <memory>
+#include <unordered_map>
 
 #include "common/buffer/buffer_impl.h"
+#include "common/buffer/slab_impl.h"
+#include "common/buffer/watermark_buffer.h"
+
+#include "compression.h"
+
+#include "fingerprint.h"
 
 namespace MySQL {
 
+// The buffers the decoder frames packets in: evbuffer based by default, or native slab chains
+// when built with -DMYSQL_SLAB_BUFFER.
+#ifdef MYSQL_SLAB_BUFFER
+typedef Envoy::Buffer::SlabImpl DecoderBuffer;
+#else
+typedef Envoy::Buffer::OwnedImpl DecoderBuffer;
+#endif
+// Data received but not framed into packets yet.
+typedef Envoy::Buffer::WatermarkBufferImpl<DecoderBuffer> IngressBuffer;
+
 class Packet;
 typedef std::unique_ptr<Packet> PacketPtr;
 
-class MySQLDecoder {
-public:
-  MySQLDecoder();
-  ~MySQLDecoder();
+// How the decoder treats text protocol rows.
+enum class RowDecodeMode {
+  // Build a RowView over each row, which records column offsets without copying.
+  View,
+  // Only count rows and column bytes.
+  CountOnly
+};
 
-  //TODO: Move functions into private
-  void onClientData(Envoy::Buffer::Instance& buffer);
-  void onServerData(Envoy::Buffer::Instance& buffer);
-  bool handlePacket(PacketPtr& pkt);
-  bool shouldProcessClientPkts();
-  bool shouldProcessServerPkts();
-  void handleServerHandshake(Packet& pkt);
-  void handleClientHandshake(Packet& pkt);
-  void handleServerResponse(Packet& pkt);
-  void handleClientQuery(Packet& pkt);
-  void handleQueryResponse(Packet& pkt);
-  void handleLocalInfileData(Packet& pkt);
-  void handleLocalInfileResult(Packet& pkt);
+/**
+ * Fixed-capacity ring of packets waiting to be handled. A slot keeps its Packet (and the Packet's
+ * buffer) after it is popped, so in steady state push() recycles an existing object instead of
+ * allocating a new one. The ring only grows if more packets are queued than it has slots.
+ */
+class PacketQueue {
+public:
+  static constexpr size_t DefaultCapacity = 64;
+
+  PacketQueue(size_t capacity = DefaultCapacity);
+
+  // Appends a reset packet and returns it.
+  Packet& push(uint32_t capabilities);
+  // Releases the front packet's data and keeps the object around for reuse.
+  void pop();
+  Packet& front();
+  Packet& back();
+  Packet& operator[](size_t i);
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  // Payload bytes held by the queued packets.
+  uint64_t bytes() const;
+
+  // push() calls served by a recycled packet / that had to allocate one.
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
 
 private:
-  void resetQueryState();
-
-  enum class PacketState { ProcessingClientPkts, ProcessingServerPkts };
+  void grow();
 
-  enum class ConnectionState {
-    // IDLE,
-    ReadServerHandshake,
-    ReadClientHandshake,
-    ReadServerHandshakeResponse,
-    ReadClientQuery,
-    ReadServerQueryResult,
-    LocalInFileData,
-    LocalInFileResult
-  };
-
-  enum class QueryState { Idle, ReadColumns, ReadRows };
-
-  uint32_t capabilities_;
-
-  ConnectionState connState_;
-  QueryState queryState_;
-
-  bool sniffing_;
-
-  uint8_t sequenceId_;
-  Envoy::Buffer::OwnedImpl clientBuffer_;
-  Envoy::Buffer::OwnedImpl serverBuffer_;
-
-  std::list<PacketPtr> clientPkts_, serverPkts_;
+  std::vector<PacketPtr> slots_;
+  size_t head_;
+  size_t size_;
+  uint64_t hits_;
+  uint64_t misses_;
 };
 
-typedef std::unique_ptr<MySQLDecoder> MySQLDecoderPtr;
-
 enum class PacketType { UnknownPacket, OkPacket, ErrPacket, EOFPacket, Progress, LocalInFileData };
 
 class BufferHelper {
@@ -91,14 +104,68 @@ public:
   static std::string getStringFromRestOfBuffer(Envoy::Buffer::Instance& data);
 };
 
+/**
+ * Sequential reader with the same accessors as BufferHelper. Reads are served with plain loads
+ * from the buffer's first slice while it holds enough bytes, which for sub-MTU packets is every
+ * read; only reads straddling a slice boundary fall back to linearizing the buffer. Consumed
+ * bytes are drained in one go by sync(), which the destructor calls.
+ */
+class BufferCursor {
+public:
+  BufferCursor(Envoy::Buffer::Instance& data);
+  ~BufferCursor();
+
+  // Number of bytes not yet consumed.
+  uint64_t length() const { return length_; }
+
+  uint64_t peekFixedInt(uint64_t size);
+  uint64_t getFixedInt(uint64_t size);
+  uint8_t peekByte();
+  uint8_t getByte();
+  void peekBytes(uint8_t* out, size_t out_len);
+  void getBytes(uint8_t* out, size_t out_len);
+  void skipBytes(size_t len);
+  uint64_t getLenEncInt();
+  uint8_t getInt8();
+  uint8_t peekInt8();
+  uint16_t getInt16();
+  uint16_t peekInt16();
+  uint32_t getInt24();
+  uint32_t peekInt24();
+  uint32_t getInt32();
+  uint32_t peekInt32();
+  std::string getCString();
+  std::string getLenPrefixedString();
+  std::string getLenEncString();
+  std::string getStringFromBuffer(size_t len);
+  std::string getStringFromRestOfBuffer();
+
+  // Drains the bytes consumed so far from the underlying buffer.
+  void sync();
+
+private:
+  bool contiguous(uint64_t size) const { return static_cast<uint64_t>(end_ - pos_) >= size; }
+  // Makes at least <size> bytes readable from pos_, linearizing the buffer if needed.
+  void ensure(uint64_t size);
+  void reload();
+
+  Envoy::Buffer::Instance& data_;
+  // [start_, pos_) is consumed but not yet drained, [pos_, end_) is readable.
+  const uint8_t* start_;
+  const uint8_t* pos_;
+  const uint8_t* end_;
+  uint64_t length_;
+};
+
 class Packet {
 public:
   uint8_t seqId_;
-  Envoy::Buffer::OwnedImpl buffer_;
+  DecoderBuffer buffer_;
   uint32_t capabilities_;
   bool moreData_;
 
   Packet(uint32_t capabilities);
+  void reset(uint32_t capabilities);
   void fromBuffer(Envoy::Buffer::Instance& buffer);
   uint64_t length();
   uint8_t header();
@@ -184,7 +251,15 @@ public:
 
   uint8_t command_;
   std::string commandName_;
+  // SQL text of COM_QUERY and COM_STMT_PREPARE.
   std::string info_;
+  // Statement id of the COM_STMT_* commands that refer to a prepared statement; 0 otherwise.
+  uint32_t statementId_;
+
+  // nullptr for unknown commands.
+  static const char* commandName(uint8_t command);
+  // Whether <command> starts with the id of a prepared statement.
+  static bool hasStatementId(uint8_t command);
 
   void fromPacket(Packet& pkt);
 
@@ -202,4 +277,432 @@ public:
   std::string toString();
 };
 
+/**
+ * Non-materializing alternative to RowMessage. fromPacket() only records where each column starts
+ * and how long it is; column() returns a view into the packet's memory and materialize() copies a
+ * single column out. Views stay valid until the packet is popped from its queue.
+ */
+class RowView : public Message {
+public:
+  RowView();
+
+  void fromPacket(Packet& pkt);
+
+  size_t columns() const { return cols_.size(); }
+  bool isNull(size_t i) const;
+  std::string_view column(size_t i) const;
+  std::string materialize(size_t i) const;
+  // Sum of the column lengths, excluding their length prefixes.
+  uint64_t bytes() const { return bytes_; }
+
+  std::string toString();
+
+  // Counting-only decoding: skips over the columns without recording or copying them. Returns the
+  // number of columns and adds their lengths to <bytes>.
+  static uint64_t count(Packet& pkt, uint64_t& bytes);
+
+private:
+  static constexpr size_t NullColumn = SIZE_MAX;
+
+  struct Column {
+    size_t offset_;
+    size_t length_;
+  };
+
+  const char* data_;
+  // Reused across rows, so a RowView kept by the decoder stops allocating after the widest row.
+  std::vector<Column> cols_;
+  uint64_t bytes_;
+};
+
+/**
+ * Counterpart of RowView for binary protocol rows, which answer COM_STMT_EXECUTE and
+ * COM_STMT_FETCH. Unlike text rows they don't describe themselves: every value is laid out
+ * according to its column's MYSQL_TYPE_*, so the column types have to be passed in.
+ * column() returns integers and floats as their little endian bytes, temporal values without
+ * their length byte, and strings without their length prefix.
+ */
+class BinaryRowView : public Message {
+public:
+  BinaryRowView();
+
+  void fromPacket(Packet& pkt, const std::vector<uint8_t>& types);
+
+  size_t columns() const { return cols_.size(); }
+  bool isNull(size_t i) const;
+  std::string_view column(size_t i) const;
+  // Sum of the value lengths, excluding length prefixes.
+  uint64_t bytes() const { return bytes_; }
+
+  std::string toString();
+
+  // Counting-only decoding, as RowView::count(). Returns the number of columns.
+  static uint64_t count(Packet& pkt, const std::vector<uint8_t>& types, uint64_t& bytes);
+
+private:
+  static constexpr size_t NullColumn = SIZE_MAX;
+
+  struct Column {
+    size_t offset_;
+    size_t length_;
+  };
+
+  const char* data_;
+  std::vector<Column> cols_;
+  uint64_t bytes_;
+};
+
+/**
+ * The parts of a ColumnDefinition41 packet needed to make sense of the column's values.
+ */
+struct ColumnDefinition {
+  std::string schema_;
+  std::string table_;
+  std::string name_;
+  uint16_t charset_ = 0;
+  // Maximum length of the column's values.
+  uint32_t length_ = 0;
+  // MYSQL_TYPE_*
+  uint8_t type_ = 0;
+  uint16_t flags_ = 0;
+  uint8_t decimals_ = 0;
+
+  /**
+   * Parses the definition that starts at <pos>, moving <pos> to its end.
+   * @throw EnvoyException on a truncated definition.
+   */
+  void fromBytes(const uint8_t*& pos, const uint8_t* end);
+  std::string toString() const;
+};
+
+/**
+ * The columns of a result set. Decoders cache these by their definition packets, so the
+ * definitions of a query that runs repeatedly are only parsed the first time.
+ */
+struct ResultSchema {
+  std::vector<ColumnDefinition> columns_;
+  // MYSQL_TYPE_* of each column, as needed to decode binary rows.
+  std::vector<uint8_t> types_;
+};
+
+/**
+ * A statement prepared with COM_STMT_PREPARE, as learned from the command and its response.
+ */
+struct PreparedStatement {
+  // Fingerprint and normalized text of the statement's SQL.
+  uint64_t fingerprint_ = 0;
+  std::string query_;
+  uint16_t params_ = 0;
+  // MYSQL_TYPE_* of each result set column, in order.
+  std::vector<uint8_t> columnTypes_;
+};
+
+/**
+ * Summary of a command and its response, reported once the final response packet is decoded.
+ * Times are capture timestamps.
+ */
+struct QueryResult {
+  uint8_t command_;
+  std::chrono::microseconds start_;
+  std::chrono::microseconds end_;
+  uint64_t rows_;
+  uint64_t rowBytes_;
+  // 0 unless the server answered with an ERR packet.
+  uint16_t errorCode_;
+  // Fingerprint and normalized text of a COM_QUERY statement, or of the prepared statement a
+  // COM_STMT_EXECUTE or COM_STMT_FETCH runs; 0 and empty for other commands and for statements
+  // prepared before the decoder joined. The text is only valid for the duration of the callback.
+  uint64_t fingerprint_;
+  std::string_view query_;
+  // Statement the command refers to, for COM_STMT_*; 0 otherwise.
+  uint32_t statementId_;
+  // Columns of the result set, if there was one. Owned by the decoder.
+  const ResultSchema* schema_;
+};
+
+/**
+ * Typed events of a decoded connection. Every event has an empty default, so a sink only
+ * overrides what it consumes. The messages and views are only valid for the duration of the call.
+ */
+class DecoderCallbacks {
+public:
+  virtual ~DecoderCallbacks() {}
+
+  virtual void onServerHandshake(const ServerHandshakeMessage&) {}
+  virtual void onClientHandshake(const ClientHandshakeMessage&) {}
+  // A command from the client. The text of a streamed COM_QUERY is only its start, see
+  // MySQLDecoder::setStreamingWindow().
+  virtual void onQuery(const QueryMessage&) {}
+  // OK and ERR packets from the server, whatever they answer.
+  virtual void onOk(const OkMessage&) {}
+  virtual void onError(const ErrMessage&) {}
+  // Result set rows; only with RowDecodeMode::View, and not for streamed rows.
+  virtual void onRow(const RowView&) {}
+  virtual void onBinaryRow(const BinaryRowView&) {}
+  // A command and its response are complete.
+  virtual void onQueryResult(const QueryResult&) {}
+  // The unframed data of either direction went over the buffer limit, and later drained to half
+  // of it in both; see MySQLDecoder::setBufferLimit().
+  virtual void onAboveHighWatermark() {}
+  virtual void onBelowLowWatermark() {}
+};
+
+class MySQLDecoder {
+public:
+  MySQLDecoder();
+  ~MySQLDecoder();
+
+  //TODO: Move functions into private
+
+  // The data in <buffer> is moved (not copied) into the decoder, so <buffer> is drained on return.
+  void onClientData(Envoy::Buffer::Instance& buffer);
+  void onServerData(Envoy::Buffer::Instance& buffer);
+
+  // Frames packets directly on the borrowed <data>. The memory only has to stay valid for the
+  // duration of the call; whatever the decoder still holds on to afterwards (a partial packet, or
+  // packets queued for the other direction) is copied out before returning.
+  void onClientData(const void* data, uint64_t size);
+  void onServerData(const void* data, uint64_t size);
+  bool handlePacket(Packet& pkt);
+  bool shouldProcessClientPkts();
+  bool shouldProcessServerPkts();
+  void handleServerHandshake(Packet& pkt);
+  void handleClientHandshake(Packet& pkt);
+  void handleServerResponse(Packet& pkt);
+  void handleClientQuery(Packet& pkt);
+  void handleQueryResponse(Packet& pkt);
+  void handleLocalInfileData(Packet& pkt);
+  void handleLocalInfileResult(Packet& pkt);
+
+  // Packet pool counters, summed over both directions.
+  uint64_t packetPoolHits() const { return clientPkts_.hits() + serverPkts_.hits(); }
+  uint64_t packetPoolMisses() const { return clientPkts_.misses() + serverPkts_.misses(); }
+
+  void setRowDecodeMode(RowDecodeMode mode) { rowMode_ = mode; }
+  // <callbacks> is not owned and must outlive the decoder.
+  void setCallbacks(DecoderCallbacks& callbacks) { callbacks_ = &callbacks; }
+
+  // Capture time of the data passed in next; used to time queries.
+  void setTime(std::chrono::microseconds now) { now_ = now; }
+  // Text protocol rows and column bytes (excluding length prefixes) seen so far.
+  uint64_t rowsDecoded() const { return totalRows_; }
+  uint64_t rowBytesDecoded() const { return totalRowBytes_; }
+
+  // Payloads longer than <window> bytes are handed to their handler in chunks as they arrive
+  // instead of being buffered whole, which bounds the memory held per connection. Queries keep
+  // only their first <window> bytes (at most MaxStreamedQueryText) for fingerprinting, and rows
+  // are counted without being materialized. The window is capped at MAX_PAYLOAD_LEN, as a payload
+  // spread over several packets only reveals its length at the end; 0 buffers every payload.
+  // Defaults to MAX_PAYLOAD_LEN, so that only multi-packet payloads are streamed.
+  void setStreamingWindow(uint64_t window);
+  // Payloads streamed so far, and their bytes.
+  uint64_t payloadsStreamed() const { return payloadsStreamed_; }
+  uint64_t bytesStreamed() const { return bytesStreamed_; }
+
+  // Bytes currently held on to: partial packets, packets waiting for their turn, the text of a
+  // query being streamed and, once compression starts, the inflaters.
+  uint64_t bufferedBytes() const;
+
+  static constexpr uint64_t MaxStreamedQueryText = 64 * 1024;
+
+  // Unframed bytes either direction may hold, in practice the partial packet at its front, before
+  // onAboveHighWatermark() is called; onBelowLowWatermark() follows once both hold less than half
+  // of it. The callbacks are made as a call with data returns, so data that merely passes through
+  // the buffers within a call doesn't count. 0, the default, disables the limit.
+  void setBufferLimit(uint64_t limit);
+  // Times the limit was exceeded, and times the buffers drained again.
+  uint64_t highWatermarks() const { return highWatermarks_; }
+  uint64_t lowWatermarks() const { return lowWatermarks_; }
+
+  // Whether the connection negotiated CLIENT_COMPRESS. Everything after the handshake is then
+  // inflated before framing. A corrupt compressed stream throws, or with resync on error stops
+  // the decoder, as packets can't be found again in it.
+  bool compressed() const { return compressed_; }
+  // Compressed bytes received and what they inflated to, both directions together.
+  uint64_t compressedBytes() const;
+  uint64_t inflatedBytes() const;
+
+  // With resync on error, a decoding error no longer throws. The decoder drops the packets in
+  // flight and all server data, and looks for the next command in the client data instead (see
+  // resync()). Off by default.
+  void setResyncOnError(bool resync) { resyncOnError_ = resync; }
+  // Forgets the connection state and scans the client data for the start of the next command:
+  // a plausible header with sequence id 0 and a known command, whose packet ends where the data
+  // seen so far ends. Decoding resumes from there; server data is skipped until then. Use this
+  // for connections joined after their handshake.
+  void resync();
+  // Times the decoder had to resynchronize, and the bytes it skipped doing so.
+  uint64_t resyncs() const { return resyncs_; }
+  uint64_t bytesSkipped() const { return bytesSkipped_; }
+
+  // Statements prepared on the connection and not closed yet, by id.
+  const PreparedStatement* statement(uint32_t id) const;
+  size_t statements() const { return statements_.size(); }
+
+  // Statements beyond this many are not tracked; their executions go unattributed.
+  static constexpr size_t MaxPreparedStatements = 4096;
+
+  // Columns of the result set being read, once all of its definitions are in; nullptr otherwise.
+  const ResultSchema* schema() const { return schema_; }
+  // Result sets whose schema was found in the cache, and those whose definitions were parsed.
+  uint64_t schemaHits() const { return schemaHits_; }
+  uint64_t schemaMisses() const { return schemaMisses_; }
+
+  // Distinct schemas cached per connection. Result sets with other schemas have their
+  // definitions parsed every time.
+  static constexpr size_t MaxCachedSchemas = 256;
+
+  // Candidate commands longer than this are passed over while resynchronizing, so that a bogus
+  // length can't make the decoder wait for megabytes of data.
+  static constexpr uint64_t MaxResyncPacket = 1 << 20;
+
+private:
+  void processClientData();
+  void processServerData();
+  void decodeClientData();
+  void decodeServerData();
+  void startResync(const std::string& reason);
+  bool resyncClient();
+  void ownBorrowedData(DecoderBuffer& buffer, PacketQueue& pkts, uint64_t borrowed);
+  // Tells the callbacks if the buffers crossed a watermark since the last call.
+  void reportWatermarks();
+  void startCompression();
+  void inflate(Inflater& inflater, const void* data, uint64_t size, Envoy::Buffer::Instance& out);
+  void inflate(Inflater& inflater, Envoy::Buffer::Instance& in, Envoy::Buffer::Instance& out);
+  void startQuery(uint8_t command, const std::string& query, uint32_t statement_id);
+  void handlePrepareResponse(Packet& pkt);
+  void finishPrepare();
+  void handleTextRow(Packet& pkt);
+  void handleBinaryRow(Packet& pkt);
+  void addColumnDefinition(Packet& pkt);
+  void finishColumns();
+  void finishQuery(uint16_t error_code);
+  void resetQueryState();
+
+  enum class PacketState { ProcessingClientPkts, ProcessingServerPkts };
+
+  enum class ConnectionState {
+    // IDLE,
+    // Looking for the start of a command after joining mid-stream or a decoding error.
+    Resync,
+    ReadServerHandshake,
+    ReadClientHandshake,
+    ReadServerHandshakeResponse,
+    ReadClientQuery,
+    ReadServerQueryResult,
+    LocalInFileData,
+    LocalInFileResult
+  };
+
+  enum class QueryState {
+    Idle,
+    ReadColumns,
+    ReadRows,
+    // Parameter and column definitions that follow COM_STMT_PREPARE_OK.
+    ReadStatementParams,
+    ReadStatementColumns
+  };
+
+  /**
+   * A payload longer than the streaming window, being handed to its handler as it arrives.
+   */
+  struct PayloadStream {
+    bool active_ = false;
+    // Bytes of the current packet not delivered yet, and whether another packet follows it.
+    uint64_t packetRemaining_ = 0;
+    bool morePackets_ = false;
+    // Payload bytes delivered so far.
+    uint64_t offset_ = 0;
+  };
+
+  bool canStream(bool from_server, uint32_t length, uint8_t first);
+  uint32_t readStreamHeader(Envoy::Buffer::Instance& buffer, const char* direction);
+  bool startStream(DecoderBuffer& buffer, PacketQueue& pkts, PayloadStream& stream,
+                   bool from_server);
+  bool continueStream(DecoderBuffer& buffer, PayloadStream& stream,
+                      const char* direction);
+  // <total_hint> is the payload length known so far, exact once <last> is set. The handler
+  // drains the <length> bytes of the chunk from <data>.
+  void handleStreamChunk(Envoy::Buffer::Instance& data, uint64_t length, uint64_t offset,
+                         uint64_t total_hint, bool last);
+  void countStreamedRow(const uint8_t* data, uint64_t length);
+  void countStreamedBinaryRow(const uint8_t* data, uint64_t length);
+
+  uint32_t capabilities_;
+
+  ConnectionState connState_;
+  QueryState queryState_;
+
+  bool sniffing_;
+
+  bool compressed_;
+  // Only created by startCompression(), as most connections don't compress.
+  std::unique_ptr<Inflater> clientInflater_, serverInflater_;
+
+  uint8_t sequenceId_;
+  IngressBuffer clientBuffer_;
+  IngressBuffer serverBuffer_;
+  // Set by the buffers' watermark callbacks, and whether the callbacks were last told the
+  // buffers are above their limit.
+  bool watermarkChanged_, aboveHighWatermark_;
+  uint64_t highWatermarks_, lowWatermarks_;
+
+  PacketQueue clientPkts_, serverPkts_;
+
+  uint64_t streamingWindow_;
+  PayloadStream clientStream_, serverStream_;
+  uint64_t payloadsStreamed_, bytesStreamed_;
+  // Command and leading text of a streamed query.
+  uint8_t streamCommand_;
+  std::string streamQuery_;
+  // Position within the columns of a streamed row: bytes left of the current column value, or
+  // the part of its length prefix seen so far. Binary rows also keep their header and NULL
+  // bitmap, and the index of the next column.
+  uint64_t streamColumnRemaining_;
+  uint8_t streamLenEnc_[9];
+  uint8_t streamLenEncSize_;
+  std::string streamRowHead_;
+  size_t streamColumn_;
+
+  bool resyncOnError_;
+  uint64_t resyncs_, bytesSkipped_;
+
+  std::unordered_map<uint32_t, PreparedStatement> statements_;
+  // The statement being prepared, and the definitions still to come for it.
+  uint32_t preparingId_;
+  PreparedStatement preparing_;
+  uint16_t preparingParams_, preparingColumns_;
+  // Whether the current result set has binary rows, and their column types; nullptr when unknown.
+  bool binaryRows_;
+  const std::vector<uint8_t>* rowTypes_;
+  bool columnCountRead_;
+  uint64_t resultColumns_;
+
+  // Column definition packets of the current result set, back to back, and where each starts.
+  // They are the key into schemas_, and only parsed on a miss.
+  std::string schemaBytes_;
+  std::vector<size_t> schemaOffsets_;
+  std::unordered_map<std::string, ResultSchema> schemas_;
+  // Holds the schema when the cache is full.
+  ResultSchema uncachedSchema_;
+  const ResultSchema* schema_;
+  uint64_t schemaHits_, schemaMisses_;
+  BinaryRowView binaryRowView_;
+
+  RowDecodeMode rowMode_;
+  RowView rowView_;
+  DecoderCallbacks* callbacks_;
+  std::chrono::microseconds now_;
+  std::chrono::microseconds queryStart_;
+  uint8_t queryCommand_;
+  uint64_t queryFingerprint_;
+  std::string_view queryText_;
+  uint32_t queryStatementId_;
+  QueryNormalizer normalizer_;
+  uint64_t queryRows_, queryRowBytes_;
+  uint64_t totalRows_, totalRowBytes_;
+};
+
+typedef std::unique_ptr<MySQLDecoder> MySQLDecoderPtr;
+
 }; // namespace MySQL
@@ -0,0 +1,115 @@
+#include "compression.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "fmt/printf.h"
+#include "exception.h"
+
+using namespace Envoy;
+
+namespace MySQL {
+
+// Output is reserved in chunks of this size; evbuffer hands back what a chunk doesn't use.
+static constexpr uint64_t InflateChunk = 16384;
+
+Inflater::Inflater()
+    : headerSize_(0), remaining_(0), inflatedLength_(0), inflated_(0), bytesIn_(0),
+      bytesOut_(0) {
+  memset(&stream_, 0, sizeof(stream_));
+  if (inflateInit(&stream_) != Z_OK) {
+    throw EnvoyException(fmt::format("Failed to initialize zlib: {}",
+                                     stream_.msg ? stream_.msg : "unknown error"));
+  }
+}
+
+Inflater::~Inflater() { inflateEnd(&stream_); }
+
+void Inflater::inflate(const uint8_t* data, uint64_t size, Buffer::Instance& out) {
+  bytesIn_ += size;
+
+  while (size > 0) {
+    if (remaining_ == 0) {
+      uint64_t n = std::min(size, HeaderSize - headerSize_);
+      memcpy(header_ + headerSize_, data, n);
+      headerSize_ += n;
+      data += n;
+      size -= n;
+      if (headerSize_ == HeaderSize) {
+        startPacket();
+      }
+      continue;
+    }
+
+    uint64_t n = std::min(size, remaining_);
+    if (inflatedLength_ == 0) {
+      out.add(data, n);
+      bytesOut_ += n;
+    } else {
+      n = inflatePayload(data, n, out);
+    }
+    data += n;
+    size -= n;
+    remaining_ -= n;
+
+    if (remaining_ == 0 && inflatedLength_ != 0) {
+      if (inflated_ != inflatedLength_) {
+        throw EnvoyException(fmt::format("Compressed payload inflated to {} bytes instead of {}",
+                                         inflated_, inflatedLength_));
+      }
+      inflateReset(&stream_);
+    }
+  }
+}
+
+void Inflater::startPacket() {
+  remaining_ = header_[0] | (header_[1] << 8) | (header_[2] << 16);
+  inflatedLength_ = header_[4] | (header_[5] << 8) | (header_[6] << 16);
+  inflated_ = 0;
+  headerSize_ = 0;
+
+  if (remaining_ == 0 && inflatedLength_ != 0) {
+    throw EnvoyException(
+        fmt::format("Empty compressed payload for {} inflated bytes", inflatedLength_));
+  }
+}
+
+uint64_t Inflater::inflatePayload(const uint8_t* data, uint64_t size, Buffer::Instance& out) {
+  stream_.next_in = const_cast<Bytef*>(data);
+  stream_.avail_in = size;
+
+  // Each payload is a zlib stream of its own, so once it ends any further input is corrupt.
+  int ret = Z_OK;
+  while (stream_.avail_in > 0 && ret != Z_STREAM_END) {
+    Buffer::RawSlice slice;
+    out.reserve(InflateChunk, &slice, 1);
+    stream_.next_out = static_cast<Bytef*>(slice.mem_);
+    stream_.avail_out = slice.len_;
+
+    ret = ::inflate(&stream_, Z_NO_FLUSH);
+    // With both input and room for output, Z_BUF_ERROR means zlib can't make progress.
+    if (ret != Z_OK && ret != Z_STREAM_END) {
+      throw EnvoyException(fmt::format("Failed to inflate compressed payload: {}",
+                                       stream_.msg ? stream_.msg : zError(ret)));
+    }
+
+    slice.len_ -= stream_.avail_out;
+    inflated_ += slice.len_;
+    bytesOut_ += slice.len_;
+    out.commit(&slice, 1);
+
+    if (inflated_ > inflatedLength_) {
+      throw EnvoyException(fmt::format("Compressed payload inflated to more than {} bytes",
+                                       inflatedLength_));
+    }
+  }
+
+  if (ret == Z_STREAM_END && stream_.avail_in > 0) {
+    throw EnvoyException(
+        fmt::format("{} bytes after the end of a compressed payload", stream_.avail_in));
+  }
+
+  return size;
+}
+
+}; // namespace MySQL
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <zlib.h>
+
+#include <cstdint>
+
+#include "envoy/buffer/buffer.h"
+
+namespace MySQL {
+
+/**
+ * Undoes the compressed protocol of one direction of a CLIENT_COMPRESS connection. Every
+ * compressed packet has a 7 byte header: the 3 byte length of its payload, a sequence id, and
+ * the 3 byte length of the payload once inflated, 0 when the payload was sent as is. Inflated
+ * payloads carry ordinary MySQL packets, which may straddle compressed packets.
+ *
+ * The input is consumed as it arrives: partial headers are kept, a deflated payload is inflated
+ * chunk by chunk straight into memory reserved in the output buffer, and the z_stream is reused
+ * across packets, so inflating allocates nothing per packet.
+ */
+class Inflater {
+public:
+  Inflater();
+  ~Inflater();
+
+  Inflater(const Inflater&) = delete;
+  Inflater& operator=(const Inflater&) = delete;
+
+  /**
+   * Inflates the <size> bytes at <data>, the next part of the compressed stream, appending the
+   * MySQL packets they carry to <out>.
+   * @throw EnvoyException on a corrupt stream; the inflater can't be used any more after that.
+   */
+  void inflate(const uint8_t* data, uint64_t size, Envoy::Buffer::Instance& out);
+
+  // Compressed bytes consumed, headers included, and bytes produced.
+  uint64_t bytesIn() const { return bytesIn_; }
+  uint64_t bytesOut() const { return bytesOut_; }
+
+  // Memory held by the inflater: itself, zlib's inflate state and the 32KB window zlib allocates
+  // for the first deflated payload, counted from the start.
+  uint64_t memoryUsage() const { return sizeof(*this) + InflateStateSize + InflateWindowSize; }
+
+  static constexpr uint64_t HeaderSize = 7;
+  // zlib doesn't export these; the state is about 7KB on 64 bit targets.
+  static constexpr uint64_t InflateStateSize = 7 * 1024;
+  static constexpr uint64_t InflateWindowSize = 32 * 1024;
+
+private:
+  void startPacket();
+  uint64_t inflatePayload(const uint8_t* data, uint64_t size, Envoy::Buffer::Instance& out);
+
+  z_stream stream_;
+  uint8_t header_[HeaderSize];
+  uint64_t headerSize_;
+  // Compressed bytes of the current payload still to come, and its inflated length; 0 when the
+  // payload is not deflated.
+  uint64_t remaining_;
+  uint64_t inflatedLength_;
+  uint64_t inflated_;
+  uint64_t bytesIn_, bytesOut_;
+};
+
+}; // namespace MySQL
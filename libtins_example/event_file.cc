@@ -0,0 +1,335 @@
+#include "event_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "fmt/format.h"
+#include "exception.h"
+
+using namespace Envoy;
+
+namespace MySQL {
+
+namespace EventFile {
+
+const Column Columns[ColumnCount] = {
+    {"timestamp_us", static_cast<uint32_t>(ColumnId::Timestamp), 8},
+    {"client_addr", static_cast<uint32_t>(ColumnId::ClientAddr), 16},
+    {"client_port", static_cast<uint32_t>(ColumnId::ClientPort), 2},
+    {"server_addr", static_cast<uint32_t>(ColumnId::ServerAddr), 16},
+    {"server_port", static_cast<uint32_t>(ColumnId::ServerPort), 2},
+    {"command", static_cast<uint32_t>(ColumnId::Command), 1},
+    {"fingerprint", static_cast<uint32_t>(ColumnId::Fingerprint), 8},
+    {"latency_us", static_cast<uint32_t>(ColumnId::Latency), 8},
+    {"rows", static_cast<uint32_t>(ColumnId::Rows), 8},
+    {"row_bytes", static_cast<uint32_t>(ColumnId::RowBytes), 8},
+    {"error_code", static_cast<uint32_t>(ColumnId::ErrorCode), 2},
+};
+
+} // namespace EventFile
+
+using namespace EventFile;
+
+namespace {
+
+constexpr size_t HeaderSize = sizeof(Magic) + 8;
+constexpr size_t TrailerSize = 8 + sizeof(Magic);
+
+uint64_t padded(uint64_t size) { return (size + 7) & ~7ULL; }
+
+} // namespace
+
+std::array<uint8_t, 16> QueryEvent::ipv4(uint32_t network_order) {
+  std::array<uint8_t, 16> addr{};
+  addr[10] = addr[11] = 0xff;
+  memcpy(addr.data() + 12, &network_order, 4);
+  return addr;
+}
+
+EventWriter::EventWriter(const std::string& path, size_t block_events)
+    : path_(path), blockEvents_(std::max<size_t>(block_events, 1)), fd_(-1), failed_(false),
+      offset_(0), events_(0), staged_(0), block_{} {
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ == -1) {
+    throw EnvoyException(fmt::format("Unable to open {}: {}", path, strerror(errno)));
+  }
+  for (size_t i = 0; i < ColumnCount; i++) {
+    columns_[i].resize(padded(blockEvents_ * Columns[i].width_));
+  }
+
+  uint8_t header[HeaderSize];
+  uint32_t fields[2] = {Version, ColumnCount};
+  memcpy(header, Magic, sizeof(Magic));
+  memcpy(header + sizeof(Magic), fields, sizeof(fields));
+  try {
+    write(header, sizeof(header));
+  } catch (...) {
+    ::close(fd_);
+    throw;
+  }
+}
+
+EventWriter::~EventWriter() {
+  try {
+    close();
+  } catch (const EnvoyException&) {
+  }
+}
+
+void EventWriter::append(const QueryEvent& event) {
+  if (failed_ || fd_ == -1) {
+    throw SinkException(fmt::format("{} is no longer written to", path_));
+  }
+
+  auto put = [this](ColumnId id, const void* value) {
+    size_t i = static_cast<size_t>(id);
+    memcpy(columns_[i].data() + staged_ * Columns[i].width_, value, Columns[i].width_);
+  };
+  uint64_t timestamp = event.timestamp_.count();
+  uint64_t latency = event.latency_.count();
+  put(ColumnId::Timestamp, &timestamp);
+  put(ColumnId::ClientAddr, event.clientAddr_.data());
+  put(ColumnId::ClientPort, &event.clientPort_);
+  put(ColumnId::ServerAddr, event.serverAddr_.data());
+  put(ColumnId::ServerPort, &event.serverPort_);
+  put(ColumnId::Command, &event.command_);
+  put(ColumnId::Fingerprint, &event.fingerprint_);
+  put(ColumnId::Latency, &latency);
+  put(ColumnId::Rows, &event.rows_);
+  put(ColumnId::RowBytes, &event.rowBytes_);
+  put(ColumnId::ErrorCode, &event.errorCode_);
+
+  if (staged_ == 0) {
+    block_.minTimestamp_ = block_.maxTimestamp_ = timestamp;
+  } else {
+    block_.minTimestamp_ = std::min(block_.minTimestamp_, timestamp);
+    block_.maxTimestamp_ = std::max(block_.maxTimestamp_, timestamp);
+  }
+  staged_++;
+  events_++;
+  if (staged_ == blockEvents_) {
+    writeBlock();
+  }
+}
+
+void EventWriter::writeBlock() {
+  // The padding of full column arrays is the zeroed end of the staging arrays; close() zeroes
+  // the tail of a partial last block.
+  iovec iov[ColumnCount];
+  uint64_t size = 0;
+  for (size_t i = 0; i < ColumnCount; i++) {
+    iov[i].iov_base = columns_[i].data();
+    iov[i].iov_len = padded(staged_ * Columns[i].width_);
+    columnOffsets_.push_back(offset_ + size);
+    size += iov[i].iov_len;
+  }
+
+  size_t first = 0;
+  while (first < ColumnCount) {
+    ssize_t n = ::writev(fd_, iov + first, ColumnCount - first);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // Part of the block may be in the file, so nothing after it could be located.
+      int error = errno;
+      failed_ = true;
+      staged_ = 0;
+      columnOffsets_.resize(index_.size() * ColumnCount);
+      throw SinkException(fmt::format("Unable to write {}: {}", path_, strerror(error)));
+    }
+    // Skip what was written; a short write can end in the middle of a column.
+    while (first < ColumnCount && static_cast<size_t>(n) >= iov[first].iov_len) {
+      n -= iov[first].iov_len;
+      first++;
+    }
+    if (first < ColumnCount) {
+      iov[first].iov_base = static_cast<uint8_t*>(iov[first].iov_base) + n;
+      iov[first].iov_len -= n;
+    }
+  }
+  offset_ += size;
+
+  block_.events_ = staged_;
+  index_.push_back(block_);
+  staged_ = 0;
+  block_ = {};
+}
+
+void EventWriter::close() {
+  if (fd_ == -1) {
+    return;
+  }
+  if (failed_) {
+    ::close(fd_);
+    fd_ = -1;
+    throw SinkException(fmt::format("{} is incomplete after a failed write", path_));
+  }
+  if (staged_ > 0) {
+    // Whatever a previous block left behind the staged values would otherwise end up as padding.
+    for (size_t i = 0; i < ColumnCount; i++) {
+      std::fill(columns_[i].begin() + staged_ * Columns[i].width_, columns_[i].end(), 0);
+    }
+    writeBlock();
+  }
+
+  std::vector<uint8_t> footer;
+  auto add = [&footer](const void* data, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    footer.insert(footer.end(), p, p + size);
+  };
+  uint64_t footer_offset = offset_;
+  add(Columns, sizeof(Columns));
+  uint64_t blocks = index_.size();
+  add(&blocks, sizeof(blocks));
+  for (size_t b = 0; b < index_.size(); b++) {
+    add(&index_[b], sizeof(BlockIndex));
+    add(&columnOffsets_[b * ColumnCount], ColumnCount * sizeof(uint64_t));
+  }
+  add(&footer_offset, sizeof(footer_offset));
+  add(Magic, sizeof(Magic));
+
+  // Whatever happens, the file is closed once.
+  try {
+    write(footer.data(), footer.size());
+  } catch (...) {
+    ::close(fd_);
+    fd_ = -1;
+    throw;
+  }
+  int ret = ::close(fd_);
+  fd_ = -1;
+  if (ret != 0) {
+    throw SinkException(fmt::format("Unable to close {}: {}", path_, strerror(errno)));
+  }
+}
+
+void EventWriter::write(const void* data, size_t size) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  while (size > 0) {
+    ssize_t n = ::write(fd_, p, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      failed_ = true;
+      throw SinkException(fmt::format("Unable to write {}: {}", path_, strerror(errno)));
+    }
+    p += n;
+    size -= n;
+    offset_ += n;
+  }
+}
+
+EventReader::EventReader(const std::string& path) : data_(nullptr), size_(0), events_(0) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    throw EnvoyException(fmt::format("Unable to open {}: {}", path, strerror(errno)));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw EnvoyException(fmt::format("Unable to stat {}: {}", path, strerror(errno)));
+  }
+  size_ = st.st_size;
+  if (size_ < HeaderSize + TrailerSize) {
+    ::close(fd);
+    throw EnvoyException(fmt::format("{} is not an event file", path));
+  }
+  void* map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    throw EnvoyException(fmt::format("Unable to map {}: {}", path, strerror(errno)));
+  }
+  data_ = static_cast<const uint8_t*>(map);
+
+  // The mapping is released by the destructor, which doesn't run if the constructor throws.
+  auto fail = [this, &path](const std::string& reason) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+    throw EnvoyException(fmt::format("{}: {}", path, reason));
+  };
+
+  uint32_t fields[2];
+  memcpy(fields, data_ + sizeof(Magic), sizeof(fields));
+  if (memcmp(data_, Magic, sizeof(Magic)) != 0 || fields[0] != Version ||
+      fields[1] != ColumnCount) {
+    fail("not an event file of a supported version");
+  }
+  if (memcmp(data_ + size_ - sizeof(Magic), Magic, sizeof(Magic)) != 0) {
+    fail("missing trailer, the file was not closed");
+  }
+
+  uint64_t footer_offset;
+  memcpy(&footer_offset, data_ + size_ - TrailerSize, sizeof(footer_offset));
+  const uint64_t footer_end = size_ - TrailerSize;
+  if (footer_offset < HeaderSize || footer_offset + sizeof(Columns) + 8 > footer_end) {
+    fail("corrupt footer");
+  }
+  const uint8_t* p = data_ + footer_offset;
+  Column columns[ColumnCount];
+  memcpy(columns, p, sizeof(columns));
+  p += sizeof(columns);
+  for (size_t i = 0; i < ColumnCount; i++) {
+    if (columns[i].id_ != Columns[i].id_ || columns[i].width_ != Columns[i].width_) {
+      fail(fmt::format("unexpected column {}", i));
+    }
+  }
+
+  uint64_t blocks;
+  memcpy(&blocks, p, sizeof(blocks));
+  p += sizeof(blocks);
+  const size_t entry = sizeof(BlockIndex) + ColumnCount * sizeof(uint64_t);
+  if (blocks > (data_ + footer_end - p) / entry) {
+    fail("corrupt footer");
+  }
+  index_.resize(blocks);
+  columnOffsets_.resize(blocks * ColumnCount);
+  for (size_t b = 0; b < blocks; b++) {
+    memcpy(&index_[b], p, sizeof(BlockIndex));
+    memcpy(&columnOffsets_[b * ColumnCount], p + sizeof(BlockIndex),
+           ColumnCount * sizeof(uint64_t));
+    p += entry;
+    events_ += index_[b].events_;
+    for (size_t i = 0; i < ColumnCount; i++) {
+      uint64_t offset = columnOffsets_[b * ColumnCount + i];
+      if (offset % 8 != 0 || offset < HeaderSize || offset > footer_offset ||
+          index_[b].events_ > (footer_offset - offset) / Columns[i].width_) {
+        fail(fmt::format("block {} column {} is out of bounds", b, Columns[i].name_));
+      }
+    }
+  }
+}
+
+EventReader::~EventReader() { munmap(const_cast<uint8_t*>(data_), size_); }
+
+QueryEvent EventReader::event(size_t block, uint64_t n) const {
+  auto get = [this, block, n](ColumnId id, void* value) {
+    size_t i = static_cast<size_t>(id);
+    memcpy(value, column<uint8_t>(block, id) + n * Columns[i].width_, Columns[i].width_);
+  };
+  QueryEvent event;
+  uint64_t timestamp, latency;
+  get(ColumnId::Timestamp, &timestamp);
+  get(ColumnId::ClientAddr, event.clientAddr_.data());
+  get(ColumnId::ClientPort, &event.clientPort_);
+  get(ColumnId::ServerAddr, event.serverAddr_.data());
+  get(ColumnId::ServerPort, &event.serverPort_);
+  get(ColumnId::Command, &event.command_);
+  get(ColumnId::Fingerprint, &event.fingerprint_);
+  get(ColumnId::Latency, &latency);
+  get(ColumnId::Rows, &event.rows_);
+  get(ColumnId::RowBytes, &event.rowBytes_);
+  get(ColumnId::ErrorCode, &event.errorCode_);
+  event.timestamp_ = std::chrono::microseconds(timestamp);
+  event.latency_ = std::chrono::microseconds(latency);
+  return event;
+}
+
+}; // namespace MySQL
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace MySQL {
+
+/**
+ * One completed command, as written to an event file.
+ */
+struct QueryEvent {
+  // Capture time the command was sent, in microseconds since the epoch.
+  std::chrono::microseconds timestamp_{0};
+  // Addresses in network byte order; IPv4 addresses are stored IPv4-mapped (::ffff:a.b.c.d).
+  std::array<uint8_t, 16> clientAddr_{};
+  uint16_t clientPort_ = 0;
+  std::array<uint8_t, 16> serverAddr_{};
+  uint16_t serverPort_ = 0;
+  uint8_t command_ = 0;
+  // 0 for commands without a statement, see QueryResult.
+  uint64_t fingerprint_ = 0;
+  std::chrono::microseconds latency_{0};
+  uint64_t rows_ = 0;
+  uint64_t rowBytes_ = 0;
+  uint16_t errorCode_ = 0;
+
+  static std::array<uint8_t, 16> ipv4(uint32_t network_order);
+};
+
+/**
+ * Columnar event file. Events are grouped into blocks; within a block every column is stored as a
+ * contiguous array of fixed width little-endian values, starting on an 8 byte boundary, so a
+ * mapped file can be scanned one column at a time without decoding anything.
+ *
+ *   header  "MYEVENTS", uint32 version, uint32 column count
+ *   blocks  per block, the column arrays in column order, each padded to 8 bytes
+ *   footer  per column a Column descriptor, then uint64 block count and per block a BlockIndex
+ *           followed by the file offset of each column array
+ *   trailer uint64 offset of the footer, "MYEVENTS"
+ *
+ * A file without its trailer was not closed properly; its blocks can't be located.
+ */
+namespace EventFile {
+
+enum class ColumnId : uint32_t {
+  Timestamp,
+  ClientAddr,
+  ClientPort,
+  ServerAddr,
+  ServerPort,
+  Command,
+  Fingerprint,
+  Latency,
+  Rows,
+  RowBytes,
+  ErrorCode,
+};
+constexpr size_t ColumnCount = 11;
+
+struct Column {
+  char name_[24];
+  uint32_t id_;
+  // Bytes per value.
+  uint32_t width_;
+};
+
+struct BlockIndex {
+  uint64_t events_;
+  // Range of the block's timestamps, so readers can skip blocks by time.
+  uint64_t minTimestamp_;
+  uint64_t maxTimestamp_;
+};
+
+constexpr char Magic[8] = {'M', 'Y', 'E', 'V', 'E', 'N', 'T', 'S'};
+constexpr uint32_t Version = 1;
+
+// Columns in file order.
+extern const Column Columns[ColumnCount];
+
+} // namespace EventFile
+
+/**
+ * Writes QueryEvents to an event file. Events are staged column by column in memory and each
+ * full block goes out in a single writev, so the file is only ever appended to in large
+ * sequential writes. Not thread safe; concurrent producers each need a file of their own.
+ */
+class EventWriter {
+public:
+  // Creates or truncates <path>. @throw EnvoyException if it can't be opened.
+  EventWriter(const std::string& path, size_t block_events = DefaultBlockEvents);
+  // Closes the file if close() wasn't called, ignoring errors.
+  ~EventWriter();
+
+  EventWriter(const EventWriter&) = delete;
+  EventWriter& operator=(const EventWriter&) = delete;
+
+  // @throw SinkException if a full block can't be written, or one couldn't be before; the file
+  //        is not written to after a failure.
+  void append(const QueryEvent& event);
+
+  // Writes the last block and the footer, and closes the file. @throw SinkException on errors,
+  // including an earlier failed write, which leaves the file without its footer.
+  void close();
+
+  uint64_t events() const { return events_; }
+  uint64_t blocks() const { return index_.size(); }
+
+  static constexpr size_t DefaultBlockEvents = 65536;
+
+private:
+  void writeBlock();
+  void write(const void* data, size_t size);
+
+  const std::string path_;
+  const size_t blockEvents_;
+  int fd_;
+  bool failed_;
+  uint64_t offset_;
+  uint64_t events_;
+  // One staging array of blockEvents_ values per column.
+  std::vector<uint8_t> columns_[EventFile::ColumnCount];
+  size_t staged_;
+  EventFile::BlockIndex block_;
+  std::vector<EventFile::BlockIndex> index_;
+  std::vector<uint64_t> columnOffsets_;
+};
+
+/**
+ * Maps an event file and locates its blocks. Column arrays are read in place.
+ */
+class EventReader {
+public:
+  // @throw EnvoyException if <path> can't be mapped or is not a complete event file.
+  EventReader(const std::string& path);
+  ~EventReader();
+
+  EventReader(const EventReader&) = delete;
+  EventReader& operator=(const EventReader&) = delete;
+
+  size_t blocks() const { return index_.size(); }
+  uint64_t events() const { return events_; }
+  const EventFile::BlockIndex& block(size_t block) const { return index_[block]; }
+
+  // The values of <column> in <block>; block(block).events_ of them.
+  template <class T> const T* column(size_t block, EventFile::ColumnId column) const {
+    return reinterpret_cast<const T*>(
+        data_ + columnOffsets_[block * EventFile::ColumnCount + static_cast<size_t>(column)]);
+  }
+
+  // Gathers event <n> of <block>.
+  QueryEvent event(size_t block, uint64_t n) const;
+
+private:
+  const uint8_t* data_;
+  size_t size_;
+  uint64_t events_;
+  std::vector<EventFile::BlockIndex> index_;
+  std::vector<uint64_t> columnOffsets_;
+};
+
+}; // namespace MySQL
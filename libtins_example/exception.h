@@ -11,4 +11,13 @@ class EnvoyException : public std::runtime_error {
 public:
   EnvoyException(const std::string& message) : std::runtime_error(message) {}
 };
+
+/**
+ * Raised by what decoded data is handed to, e.g. an event file, from inside decoder callbacks.
+ * Decoders that recover from their own errors let these through.
+ */
+class SinkException : public EnvoyException {
+public:
+  SinkException(const std::string& message) : EnvoyException(message) {}
+};
 } // namespace Envoy
@@ -0,0 +1,325 @@
+#include "fingerprint.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace MySQL {
+
+namespace {
+
+bool isSpace(unsigned char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f'; }
+
+bool isDigit(unsigned char c) { return c >= '0' && c <= '9'; }
+
+bool isHexDigit(unsigned char c) {
+  return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+bool isWordChar(unsigned char c) {
+  return isDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$' ||
+         c >= 0x80;
+}
+
+// Tokens that get a space between them in the normalized text. Spacing is derived from the tokens
+// alone, not from the whitespace in the query, so "a = 1" and "a=1" normalize the same.
+bool isSpaced(unsigned char c) { return isWordChar(c) || c == '?' || c == '`' || c == '*'; }
+
+char toLower(char c) { return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c; }
+
+// Whether <c>, the last character written, ends an operand, after which a sign is an operator.
+bool endsOperand(unsigned char c) { return isWordChar(c) || c == '?' || c == '`' || c == ')'; }
+
+// Whether <s> ends with the word <word>.
+bool endsWithWord(const std::string& s, size_t end, std::string_view word) {
+  return end >= word.size() && s.compare(end - word.size(), word.size(), word) == 0 &&
+         (end == word.size() || !isWordChar(s[end - word.size() - 1]));
+}
+
+} // namespace
+
+void QueryNormalizer::emit(char c) {
+  // "?+" is a placeholder too.
+  size_t n = out_.size();
+  if (n > 0 && isSpaced(c) &&
+      (isSpaced(out_[n - 1]) || out_[n - 1] == ')' ||
+       (n >= 2 && out_[n - 1] == '+' && out_[n - 2] == '?'))) {
+    out_ += ' ';
+  }
+  out_ += c;
+}
+
+void QueryNormalizer::emitPlaceholder() {
+  // Fold lists of placeholders: "?,?" becomes "?+" and a further ",?" is absorbed by the "?+".
+  size_t n = out_.size();
+  if (lists_.empty() || !lists_.back()) {
+    emit('?');
+    return;
+  }
+  if (n >= 2 && out_[n - 1] == ',' && out_[n - 2] == '?') {
+    out_[n - 1] = '+';
+    return;
+  }
+  if (n >= 3 && out_[n - 1] == ',' && out_[n - 2] == '+' && out_[n - 3] == '?') {
+    out_.pop_back();
+    return;
+  }
+
+  emit('?');
+}
+
+bool QueryNormalizer::listStart(size_t paren) const {
+  static constexpr std::string_view Tuple = "(?+),";
+  return endsWithWord(out_, paren, "in") || endsWithWord(out_, paren, "values") ||
+         endsWithWord(out_, paren, "value") ||
+         (paren >= Tuple.size() && out_.compare(paren - Tuple.size(), Tuple.size(), Tuple) == 0);
+}
+
+void QueryNormalizer::openParen() {
+  // The tuples of a list of tuples, e.g. "(a, b) in ((1, 2), (3, 4))", are lists too, unlike the
+  // arguments of a function call within a list.
+  bool tuple = !lists_.empty() && lists_.back() && (out_.back() == '(' || out_.back() == ',');
+  lists_.push_back(tuple || listStart(out_.size()));
+  emit('(');
+}
+
+void QueryNormalizer::closeParen() {
+  bool list = !lists_.empty() && lists_.back();
+  if (!lists_.empty()) {
+    lists_.pop_back();
+  }
+
+  // A list of one placeholder reads as one of several, so "in (?)" becomes "in (?+)"...
+  size_t n = out_.size();
+  if (list && n >= 2 && out_[n - 1] == '?' && out_[n - 2] == '(') {
+    out_ += '+';
+  }
+  emit(')');
+
+  // ... and the tuples of a multi-row VALUES list collapse into the first one.
+  static constexpr std::string_view Repeat = "(?+),(?+)";
+  n = out_.size();
+  if (n >= Repeat.size() && out_.compare(n - Repeat.size(), Repeat.size(), Repeat) == 0) {
+    out_.resize(n - Repeat.size() + 4);
+  }
+}
+
+uint64_t QueryNormalizer::normalize(std::string_view sql) {
+  out_.clear();
+  lists_.clear();
+
+  const char* p = sql.data();
+  const char* end = p + sql.size();
+  while (p < end) {
+    unsigned char c = *p;
+
+    if (isSpace(c)) {
+      p++;
+    } else if (c == '#' || (c == '-' && end - p >= 2 && p[1] == '-' &&
+                            (end - p == 2 || isSpace(p[2])))) {
+      // Comment to the end of the line.
+      while (p < end && *p != '\n') {
+        p++;
+      }
+    } else if (c == '/' && end - p >= 2 && p[1] == '*') {
+      p += 2;
+      while (p < end && !(*p == '*' && end - p >= 2 && p[1] == '/')) {
+        p++;
+      }
+      p = std::min(p + 2, end);
+    } else if (c == '\'' || c == '"') {
+      // String literal; quotes are escaped with a backslash or by doubling them.
+      p++;
+      while (p < end) {
+        if (*p == '\\') {
+          p += 2;
+        } else if (*p == static_cast<char>(c)) {
+          if (end - p >= 2 && p[1] == static_cast<char>(c)) {
+            p += 2;
+          } else {
+            p++;
+            break;
+          }
+        } else {
+          p++;
+        }
+      }
+      p = std::min(p, end);
+      emitPlaceholder();
+    } else if (c == '`') {
+      // Quoted identifier, kept verbatim.
+      emit(*p++);
+      while (p < end && *p != '`') {
+        out_ += *p++;
+      }
+      if (p < end) {
+        out_ += *p++;
+      }
+    } else if (isDigit(c) || (c == '.' && end - p >= 2 && isDigit(p[1]))) {
+      if (c == '0' && end - p >= 2 && (p[1] == 'x' || p[1] == 'X')) {
+        p += 2;
+        while (p < end && isHexDigit(*p)) {
+          p++;
+        }
+      } else {
+        while (p < end && (isDigit(*p) || *p == '.')) {
+          p++;
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+          p++;
+          if (p < end && (*p == '+' || *p == '-')) {
+            p++;
+          }
+          while (p < end && isDigit(*p)) {
+            p++;
+          }
+        }
+      }
+      // A sign is part of the number unless it follows an operand: "x = -5" is "x=?" but "x - 5"
+      // stays "x-?".
+      size_t n = out_.size();
+      if (n >= 1 && (out_[n - 1] == '-' || out_[n - 1] == '+') &&
+          (n == 1 || !endsOperand(out_[n - 2]))) {
+        out_.pop_back();
+      }
+      emitPlaceholder();
+    } else if (isWordChar(c)) {
+      emit(toLower(*p++));
+      while (p < end && isWordChar(*p)) {
+        out_ += toLower(*p++);
+      }
+    } else if (c == '?') {
+      emitPlaceholder();
+      p++;
+    } else if (c == '(') {
+      openParen();
+      p++;
+    } else if (c == ')') {
+      closeParen();
+      p++;
+    } else {
+      emit(*p++);
+    }
+  }
+
+  // FNV-1a. 0 is reserved for "no fingerprint".
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char ch : out_) {
+    hash = (hash ^ ch) * 0x100000001b3ULL;
+  }
+  return hash ? hash : 1;
+}
+
+QueryTopN::QueryTopN(size_t capacity) : capacity_(std::max<size_t>(capacity, 8)), evictions_(0) {}
+
+QueryStats& QueryTopN::entry(uint64_t fingerprint, std::string_view query) {
+  auto it = entries_.find(fingerprint);
+  if (it != entries_.end()) {
+    return it->second;
+  }
+
+  if (entries_.size() >= capacity_) {
+    evict();
+  }
+
+  QueryStats& stats = entries_[fingerprint];
+  stats.fingerprint_ = fingerprint;
+  stats.query_ = std::string(query);
+  return stats;
+}
+
+void QueryTopN::evict() {
+  std::vector<std::pair<uint64_t, uint64_t>> counts;
+  counts.reserve(entries_.size());
+  for (const auto& e : entries_) {
+    counts.emplace_back(e.second.count_, e.first);
+  }
+
+  size_t n = std::max<size_t>(1, counts.size() / 8);
+  std::nth_element(counts.begin(), counts.begin() + n, counts.end());
+  for (size_t i = 0; i < n; i++) {
+    entries_.erase(counts[i].second);
+  }
+  evictions_ += n;
+}
+
+void QueryTopN::record(uint64_t fingerprint, std::string_view query, uint64_t latency_us,
+                       uint64_t rows, uint64_t bytes, bool error) {
+  QueryStats& stats = entry(fingerprint, query);
+  stats.count_++;
+  stats.errors_ += error;
+  stats.totalLatencyUs_ += latency_us;
+  stats.rows_ += rows;
+  stats.bytes_ += bytes;
+}
+
+void QueryTopN::merge(const QueryTopN& other) {
+  // Walk the other table in fingerprint order so that evictions, if any, are deterministic.
+  std::vector<const QueryStats*> others;
+  others.reserve(other.entries_.size());
+  for (const auto& e : other.entries_) {
+    others.push_back(&e.second);
+  }
+  std::sort(others.begin(), others.end(), [](const QueryStats* a, const QueryStats* b) {
+    return a->fingerprint_ < b->fingerprint_;
+  });
+
+  for (const QueryStats* o : others) {
+    QueryStats& stats = entry(o->fingerprint_, o->query_);
+    stats.count_ += o->count_;
+    stats.errors_ += o->errors_;
+    stats.totalLatencyUs_ += o->totalLatencyUs_;
+    stats.rows_ += o->rows_;
+    stats.bytes_ += o->bytes_;
+  }
+  evictions_ += other.evictions_;
+}
+
+std::vector<QueryStats> QueryTopN::top(size_t n, SortKey key) const {
+  auto value = [key](const QueryStats& s) {
+    switch (key) {
+    case SortKey::Latency:
+      return s.totalLatencyUs_;
+    case SortKey::Bytes:
+      return s.bytes_;
+    case SortKey::Count:
+    default:
+      return s.count_;
+    }
+  };
+
+  std::vector<QueryStats> all;
+  all.reserve(entries_.size());
+  for (const auto& e : entries_) {
+    all.push_back(e.second);
+  }
+
+  n = std::min(n, all.size());
+  std::partial_sort(all.begin(), all.begin() + n, all.end(),
+                    [&value](const QueryStats& a, const QueryStats& b) {
+                      uint64_t va = value(a), vb = value(b);
+                      return va != vb ? va > vb : a.fingerprint_ < b.fingerprint_;
+                    });
+  all.resize(n);
+  return all;
+}
+
+void printTopQueries(std::ostream& out, const QueryTopN& queries, size_t n) {
+  const std::pair<QueryTopN::SortKey, const char*> sections[] = {
+      {QueryTopN::SortKey::Count, "count"},
+      {QueryTopN::SortKey::Latency, "total latency"},
+      {QueryTopN::SortKey::Bytes, "bytes returned"}};
+
+  for (const auto& section : sections) {
+    out << "Top " << n << " queries by " << section.second << ":" << std::endl;
+    out << std::setw(18) << "Fingerprint" << std::setw(10) << "Count" << std::setw(8) << "Errors"
+        << std::setw(16) << "Latency(us)" << std::setw(12) << "Rows" << std::setw(14) << "Bytes"
+        << "  Query" << std::endl;
+    for (const auto& s : queries.top(n, section.first)) {
+      out << std::setw(18) << std::hex << s.fingerprint_ << std::dec << std::setw(10) << s.count_
+          << std::setw(8) << s.errors_ << std::setw(16) << s.totalLatencyUs_ << std::setw(12)
+          << s.rows_ << std::setw(14) << s.bytes_ << "  " << s.query_ << std::endl;
+    }
+  }
+}
+
+}; // namespace MySQL
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace MySQL {
+
+/**
+ * Single pass SQL normalizer. It replaces string and signed numeric literals with '?', collapses
+ * lists of placeholders such as IN (1, 2, 3) or IN (1) into '?+' and the rows of a multi-row
+ * VALUES list into one, lowercases unquoted words, drops comments and normalizes whitespace, then
+ * hashes the result into a 64-bit fingerprint. Queries that only differ in their literals, or in
+ * how many of them a list holds, get the same fingerprint. Literals elsewhere, such as function
+ * arguments or select list items, are kept one by one: f(1, 2) is f(?,?).
+ *
+ * The normalized text is written into a buffer owned by the normalizer, so a long-lived
+ * normalizer stops allocating once it has seen its longest query.
+ */
+class QueryNormalizer {
+public:
+  /**
+   * @return the fingerprint of <sql>. The normalized text is available from normalized() until
+   *         the next call.
+   */
+  uint64_t normalize(std::string_view sql);
+
+  const std::string& normalized() const { return out_; }
+
+private:
+  void emit(char c);
+  void emitPlaceholder();
+  // Whether the '(' at <paren> in the output opens a list of literals rather than, say, the
+  // arguments of a function.
+  bool listStart(size_t paren) const;
+  void openParen();
+  void closeParen();
+
+  std::string out_;
+  // Whether each open paren is a list, innermost last.
+  std::vector<bool> lists_;
+};
+
+/**
+ * Per fingerprint totals.
+ */
+struct QueryStats {
+  uint64_t fingerprint_ = 0;
+  std::string query_;
+  uint64_t count_ = 0;
+  uint64_t errors_ = 0;
+  uint64_t totalLatencyUs_ = 0;
+  uint64_t rows_ = 0;
+  uint64_t bytes_ = 0;
+};
+
+/**
+ * Aggregates query statistics by fingerprint in a table of bounded size. When the table is full,
+ * the least frequent eighth of the entries is evicted in one go, which keeps eviction cost
+ * amortized constant while the frequent fingerprints stay put.
+ */
+class QueryTopN {
+public:
+  enum class SortKey { Count, Latency, Bytes };
+
+  static constexpr size_t DefaultCapacity = 4096;
+
+  QueryTopN(size_t capacity = DefaultCapacity);
+
+  /**
+   * @param query supplies the normalized text; it is only copied the first time <fingerprint> is
+   *        seen.
+   */
+  void record(uint64_t fingerprint, std::string_view query, uint64_t latency_us, uint64_t rows,
+              uint64_t bytes, bool error);
+  void merge(const QueryTopN& other);
+
+  /**
+   * @return the <n> entries with the highest <key>. Ties are broken by fingerprint, so the order
+   *         does not depend on hash table iteration order.
+   */
+  std::vector<QueryStats> top(size_t n, SortKey key) const;
+
+  size_t size() const { return entries_.size(); }
+  uint64_t evictions() const { return evictions_; }
+
+private:
+  QueryStats& entry(uint64_t fingerprint, std::string_view query);
+  void evict();
+
+  size_t capacity_;
+  std::unordered_map<uint64_t, QueryStats> entries_;
+  uint64_t evictions_;
+};
+
+/**
+ * Writes the top <n> queries by count, total latency and bytes returned.
+ */
+void printTopQueries(std::ostream& out, const QueryTopN& queries, size_t n);
+
+}; // namespace MySQL
@@ -0,0 +1,118 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#include "codec.h"
+
+namespace MySQL {
+
+LatencyHistogram::LatencyHistogram()
+    : counts_(NumBuckets), count_(0), sum_(0), min_(UINT64_MAX), max_(0) {}
+
+size_t LatencyHistogram::bucketIndex(uint64_t value) {
+  if (value < 2 * SubBuckets) {
+    return value;
+  }
+
+  // Keep the top SubBucketBits + 1 bits of the value; the shift selects the power of two.
+  int shift = (63 - __builtin_clzll(value)) - SubBucketBits;
+  return (shift << SubBucketBits) + (value >> shift);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+  if (index < 2 * SubBuckets) {
+    return index;
+  }
+
+  int shift = (index >> SubBucketBits) - 1;
+  uint64_t top = (index & (SubBuckets - 1)) + SubBuckets;
+  return ((top + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+  counts_[bucketIndex(value)]++;
+  count_++;
+  sum_ += value;
+  min_ = std::min(min_, value);
+  max_ = std::max(max_, value);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < NumBuckets; i++) {
+    counts_[i] += other.counts_[i];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+}
+
+uint64_t LatencyHistogram::percentile(double quantile) const {
+  if (count_ == 0) {
+    return 0;
+  }
+
+  uint64_t rank = std::max<uint64_t>(1, std::ceil(std::clamp(quantile, 0.0, 1.0) * count_));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < NumBuckets; i++) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      return std::min(bucketUpperBound(i), max_);
+    }
+  }
+
+  return max_;
+}
+
+void CommandLatencies::record(uint8_t command, uint64_t latency_us) {
+  auto& histogram = histograms_[command];
+  if (!histogram) {
+    histogram = std::make_unique<LatencyHistogram>();
+  }
+  histogram->record(latency_us);
+}
+
+void CommandLatencies::merge(const CommandLatencies& other) {
+  for (size_t i = 0; i < histograms_.size(); i++) {
+    if (!other.histograms_[i]) {
+      continue;
+    }
+    if (!histograms_[i]) {
+      histograms_[i] = std::make_unique<LatencyHistogram>();
+    }
+    histograms_[i]->merge(*other.histograms_[i]);
+  }
+}
+
+void mergeLatencies(ServerLatencies& into, const ServerLatencies& from) {
+  for (const auto& server : from) {
+    into[server.first].merge(server.second);
+  }
+}
+
+void printLatencies(std::ostream& out, const ServerLatencies& latencies) {
+  out << std::left << std::setw(24) << "Server" << std::setw(24) << "Command" << std::right
+      << std::setw(10) << "Count" << std::setw(12) << "Mean(us)" << std::setw(12) << "p50(us)"
+      << std::setw(12) << "p99(us)" << std::setw(12) << "p999(us)" << std::setw(12) << "Max(us)"
+      << std::endl;
+
+  for (const auto& server : latencies) {
+    for (int command = 0; command < 256; command++) {
+      const LatencyHistogram* h = server.second.histogram(command);
+      if (h == nullptr) {
+        continue;
+      }
+
+      const char* name = QueryMessage::commandName(command);
+      out << std::left << std::setw(24) << server.first << std::setw(24)
+          << (name ? name : std::to_string(command)) << std::right << std::setw(10) << h->count()
+          << std::setw(12) << std::fixed << std::setprecision(1) << h->mean() << std::setw(12)
+          << h->percentile(0.5) << std::setw(12) << h->percentile(0.99) << std::setw(12)
+          << h->percentile(0.999) << std::setw(12) << h->max() << std::endl;
+    }
+  }
+}
+
+}; // namespace MySQL
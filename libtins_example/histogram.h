@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace MySQL {
+
+/**
+ * HDR-style log-linear histogram of non-negative integer values. Values below 128 are counted
+ * exactly; above that every power of two is split into 64 linear sub-buckets, which bounds the
+ * relative error of any reported value to under 1.6% over the whole uint64_t range. Recording is
+ * a couple of shifts and an increment.
+ */
+class LatencyHistogram {
+public:
+  LatencyHistogram();
+
+  void record(uint64_t value);
+  void merge(const LatencyHistogram& other);
+
+  uint64_t count() const { return count_; }
+  uint64_t min() const { return count_ ? min_ : 0; }
+  uint64_t max() const { return max_; }
+  double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0; }
+
+  /**
+   * @param quantile supplies a value in [0, 1], e.g. 0.99.
+   * @return the highest value equivalent to the one at <quantile>, clamped to the recorded max.
+   */
+  uint64_t percentile(double quantile) const;
+
+private:
+  static constexpr int SubBucketBits = 6;
+  static constexpr uint64_t SubBuckets = 1 << SubBucketBits;
+  // Exact buckets for [0, 2 * SubBuckets), then SubBuckets for each remaining power of two.
+  static constexpr size_t NumBuckets = (64 - SubBucketBits + 1) * SubBuckets;
+
+  static size_t bucketIndex(uint64_t value);
+  static uint64_t bucketUpperBound(size_t index);
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t min_;
+  uint64_t max_;
+};
+
+/**
+ * Latency histograms of one server, one per command byte. Histograms are only allocated for the
+ * commands actually seen.
+ */
+class CommandLatencies {
+public:
+  void record(uint8_t command, uint64_t latency_us);
+  void merge(const CommandLatencies& other);
+
+  // nullptr if <command> has not been recorded.
+  const LatencyHistogram* histogram(uint8_t command) const { return histograms_[command].get(); }
+
+private:
+  std::array<std::unique_ptr<LatencyHistogram>, 256> histograms_;
+};
+
+// Command latencies keyed by server endpoint ("address:port").
+typedef std::map<std::string, CommandLatencies> ServerLatencies;
+
+void mergeLatencies(ServerLatencies& into, const ServerLatencies& from);
+
+/**
+ * Writes a table with count, mean, p50, p99, p999 and max (in microseconds) per server and
+ * command.
+ */
+void printLatencies(std::ostream& out, const ServerLatencies& latencies);
+
+}; // namespace MySQL
@@ -1,8 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
 
-#define MAX_PAYLOAD_LEN (1 << 24 - 1)
+#define MAX_PAYLOAD_LEN ((1 << 24) - 1)
 
 #define OK_HEADER 0x00
 #define LOCAL_INFILE 0xfb
@@ -35,6 +36,8 @@
 /* Don't close the connection for a connection with expired password. */
 #define CLIENT_CAN_HANDLE_EXPIRED_PASSWORDS (1UL << 22)
 #define CLIENT_SESSION_TRACKING (1UL << 23)
+/* Client no longer needs EOF packets after column definitions. */
+#define CLIENT_DEPRECATE_EOF (1UL << 24)
 
 #define CLIENT_PROGRESS (1UL << 29) /* Client support progress indicator */
 #define CLIENT_SSL_VERIFY_SERVER_CERT (1UL << 30)
@@ -93,7 +96,41 @@ enum enum_server_command {
   COM_END
 };
 
-std::map<uint8_t, const char*> collations = {{1, "big5_chinese_ci"},
+enum enum_field_types {
+  MYSQL_TYPE_DECIMAL,
+  MYSQL_TYPE_TINY,
+  MYSQL_TYPE_SHORT,
+  MYSQL_TYPE_LONG,
+  MYSQL_TYPE_FLOAT,
+  MYSQL_TYPE_DOUBLE,
+  MYSQL_TYPE_NULL,
+  MYSQL_TYPE_TIMESTAMP,
+  MYSQL_TYPE_LONGLONG,
+  MYSQL_TYPE_INT24,
+  MYSQL_TYPE_DATE,
+  MYSQL_TYPE_TIME,
+  MYSQL_TYPE_DATETIME,
+  MYSQL_TYPE_YEAR,
+  MYSQL_TYPE_NEWDATE,
+  MYSQL_TYPE_VARCHAR,
+  MYSQL_TYPE_BIT,
+  MYSQL_TYPE_TIMESTAMP2,
+  MYSQL_TYPE_DATETIME2,
+  MYSQL_TYPE_TIME2,
+  MYSQL_TYPE_JSON = 245,
+  MYSQL_TYPE_NEWDECIMAL = 246,
+  MYSQL_TYPE_ENUM = 247,
+  MYSQL_TYPE_SET = 248,
+  MYSQL_TYPE_TINY_BLOB = 249,
+  MYSQL_TYPE_MEDIUM_BLOB = 250,
+  MYSQL_TYPE_LONG_BLOB = 251,
+  MYSQL_TYPE_BLOB = 252,
+  MYSQL_TYPE_VAR_STRING = 253,
+  MYSQL_TYPE_STRING = 254,
+  MYSQL_TYPE_GEOMETRY = 255
+};
+
+inline std::map<uint8_t, const char*> collations = {{1, "big5_chinese_ci"},
                                              {2, "latin2_czech_cs"},
                                              {3, "dec8_swedish_ci"},
                                              {4, "cp850_general_ci"},
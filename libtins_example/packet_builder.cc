@@ -0,0 +1,244 @@
+#include "packet_builder.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+
+#include "mysql.h"
+
+namespace MySQL {
+
+// Charset of the generated columns: utf8_general_ci.
+static constexpr uint16_t Utf8GeneralCi = 33;
+
+std::string PacketBuilder::fixedInt(uint64_t value, int bytes) {
+  std::string s;
+  for (int i = 0; i < bytes; i++) {
+    s += static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+  return s;
+}
+
+std::string PacketBuilder::lenEncInt(uint64_t value) {
+  if (value < 251) {
+    return fixedInt(value, 1);
+  } else if (value < (1 << 16)) {
+    return '\xfc' + fixedInt(value, 2);
+  } else if (value < (1 << 24)) {
+    return '\xfd' + fixedInt(value, 3);
+  }
+  return '\xfe' + fixedInt(value, 8);
+}
+
+std::string PacketBuilder::lenEncString(const std::string& s) { return lenEncInt(s.size()) + s; }
+
+std::string PacketBuilder::frame(uint8_t& seq, const std::string& payload) {
+  std::string out;
+  out.reserve(payload.size() + 4 * (payload.size() / MAX_PAYLOAD_LEN + 1));
+
+  size_t offset = 0;
+  while (true) {
+    size_t length = std::min<size_t>(payload.size() - offset, MAX_PAYLOAD_LEN);
+    out += fixedInt(length, 3);
+    out += static_cast<char>(seq++);
+    out.append(payload, offset, length);
+    offset += length;
+
+    // A maximum sized packet always announces another one, even if that one ends up empty.
+    if (length < MAX_PAYLOAD_LEN) {
+      return out;
+    }
+  }
+}
+
+std::string PacketBuilder::compress(uint8_t& seq, const std::string& data) {
+  std::string out;
+  size_t offset = 0;
+  do {
+    size_t length = std::min<size_t>(data.size() - offset, MAX_PAYLOAD_LEN);
+    std::string deflated;
+    if (length >= MinCompressLength) {
+      uLongf size = compressBound(length);
+      deflated.resize(size);
+      if (::compress(reinterpret_cast<Bytef*>(&deflated[0]), &size,
+                     reinterpret_cast<const Bytef*>(data.data() + offset), length) != Z_OK) {
+        size = length;
+      }
+      deflated.resize(size);
+    }
+
+    if (deflated.empty() || deflated.size() >= length) {
+      out += fixedInt(length, 3) + static_cast<char>(seq++) + fixedInt(0, 3);
+      out.append(data, offset, length);
+    } else {
+      out += fixedInt(deflated.size(), 3) + static_cast<char>(seq++) + fixedInt(length, 3);
+      out += deflated;
+    }
+    offset += length;
+  } while (offset < data.size());
+  return out;
+}
+
+std::string PacketBuilder::serverHandshake(uint32_t capabilities, uint32_t thread_id,
+                                           const std::string& auth_plugin) {
+  std::string s;
+  s += '\x0a';
+  s += std::string("5.7.30-log") + '\0';
+  s += fixedInt(thread_id, 4);
+  s += std::string("abcdefgh") + '\0';
+  s += fixedInt(capabilities & 0xffff, 2);
+  s += static_cast<char>(Utf8GeneralCi);
+  s += fixedInt(SERVER_STATUS_AUTOCOMMIT, 2);
+  s += fixedInt(capabilities >> 16, 2);
+  s += '\x15';
+  s += std::string(10, '\0');
+  s += std::string("ijklmnopqrst") + '\0';
+  if (capabilities & CLIENT_PLUGIN_AUTH) {
+    s += auth_plugin + '\0';
+  }
+  return s;
+}
+
+std::string PacketBuilder::clientHandshake(uint32_t capabilities, const std::string& user,
+                                           const std::string& db,
+                                           const std::string& auth_plugin) {
+  const std::string auth_response(20, 'p');
+
+  std::string s;
+  s += fixedInt(capabilities, 4);
+  s += fixedInt(MAX_PAYLOAD_LEN, 4);
+  s += static_cast<char>(Utf8GeneralCi);
+  s += std::string(23, '\0');
+  s += user + '\0';
+  if (capabilities & CLIENT_PLUGIN_AUTH_LENENC_CLIENT_DATA) {
+    s += lenEncString(auth_response);
+  } else if (capabilities & CLIENT_SECURE_CONNECTION) {
+    s += static_cast<char>(auth_response.size()) + auth_response;
+  } else {
+    s += auth_response + '\0';
+  }
+  if (capabilities & CLIENT_CONNECT_WITH_DB) {
+    s += db + '\0';
+  }
+  if (capabilities & CLIENT_PLUGIN_AUTH) {
+    s += auth_plugin + '\0';
+  }
+  if (capabilities & CLIENT_CONNECT_ATTRS) {
+    std::string attrs = lenEncString("_client_name") + lenEncString("pcapgen");
+    s += lenEncString(attrs);
+  }
+  return s;
+}
+
+std::string PacketBuilder::authSwitchRequest(const std::string& auth_plugin,
+                                             const std::string& data) {
+  return '\xfe' + auth_plugin + '\0' + data;
+}
+
+std::string PacketBuilder::ok(uint32_t capabilities, uint64_t affected_rows,
+                              uint64_t last_insert_id, uint16_t status) {
+  std::string s = '\0' + lenEncInt(affected_rows) + lenEncInt(last_insert_id);
+  if (capabilities & CLIENT_PROTOCOL_41) {
+    s += fixedInt(status, 2) + fixedInt(0, 2);
+  } else if (capabilities & CLIENT_TRANSACTIONS) {
+    s += fixedInt(status, 2);
+  }
+  if (capabilities & CLIENT_SESSION_TRACKING) {
+    // An empty info string; the session state is only there with SERVER_SESSION_STATE_CHANGED.
+    s += lenEncString("");
+  }
+  return s;
+}
+
+std::string PacketBuilder::err(uint32_t capabilities, uint16_t code, const std::string& state,
+                               const std::string& message) {
+  std::string s = '\xff' + fixedInt(code, 2);
+  if (capabilities & CLIENT_PROTOCOL_41) {
+    s += '#' + state;
+  }
+  return s + message;
+}
+
+std::string PacketBuilder::eof(uint32_t capabilities, uint16_t status) {
+  if (capabilities & CLIENT_PROTOCOL_41) {
+    return '\xfe' + fixedInt(0, 2) + fixedInt(status, 2);
+  }
+  return "\xfe";
+}
+
+std::string PacketBuilder::rowsEnd(uint32_t capabilities, uint16_t status) {
+  if (capabilities & CLIENT_DEPRECATE_EOF) {
+    std::string s = ok(capabilities, 0, 0, status);
+    s[0] = '\xfe';
+    return s;
+  }
+  return eof(capabilities, status);
+}
+
+std::string PacketBuilder::command(uint8_t command, const std::string& arg) {
+  return static_cast<char>(command) + arg;
+}
+
+std::string PacketBuilder::localInfileRequest(const std::string& filename) {
+  return '\xfb' + filename;
+}
+
+std::string PacketBuilder::columnDefinition(const std::string& schema, const std::string& table,
+                                            const std::string& name, uint8_t type) {
+  return lenEncString("def") + lenEncString(schema) + lenEncString(table) + lenEncString(table) +
+         lenEncString(name) + lenEncString(name) + '\x0c' + fixedInt(Utf8GeneralCi, 2) +
+         fixedInt(1024, 4) + static_cast<char>(type) + fixedInt(0, 2) + '\0' +
+         fixedInt(0, 2);
+}
+
+std::string PacketBuilder::textRow(const std::vector<std::string>& values) {
+  std::string s;
+  for (const auto& value : values) {
+    s += lenEncString(value);
+  }
+  return s;
+}
+
+std::string PacketBuilder::prepareOk(uint32_t statement_id, uint16_t columns, uint16_t params) {
+  return '\0' + fixedInt(statement_id, 4) + fixedInt(columns, 2) + fixedInt(params, 2) + '\0' +
+         fixedInt(0, 2);
+}
+
+std::string PacketBuilder::execute(uint32_t statement_id, const std::vector<uint64_t>& params) {
+  // No cursor, one iteration, no NULL parameters, then the types as they are bound for the first
+  // time.
+  std::string s = static_cast<char>(COM_STMT_EXECUTE) + fixedInt(statement_id, 4) + '\0' +
+                  fixedInt(1, 4) + std::string((params.size() + 7) / 8, '\0') + '\x01';
+  for (size_t i = 0; i < params.size(); i++) {
+    s += fixedInt(MYSQL_TYPE_LONGLONG, 2);
+  }
+  for (uint64_t param : params) {
+    s += fixedInt(param, 8);
+  }
+  return s;
+}
+
+std::string PacketBuilder::binaryRow(const std::vector<uint8_t>& types,
+                                     const std::vector<std::string>& values) {
+  std::string s = '\0' + std::string((types.size() + 7 + 2) / 8, '\0');
+  for (size_t i = 0; i < types.size(); i++) {
+    switch (types[i]) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_YEAR:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_DOUBLE:
+      s += values[i];
+      break;
+    default:
+      s += lenEncString(values[i]);
+      break;
+    }
+  }
+  return s;
+}
+
+}; // namespace MySQL
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace MySQL {
+
+/**
+ * Builds the wire format of MySQL protocol messages, for synthetic traffic in benchmarks and the
+ * pcap generator. Message builders return a bare payload; frame() adds the packet headers.
+ */
+class PacketBuilder {
+public:
+  static std::string fixedInt(uint64_t value, int bytes);
+  static std::string lenEncInt(uint64_t value);
+  static std::string lenEncString(const std::string& s);
+
+  /**
+   * Frames <payload> as one packet, or as a run of MAX_PAYLOAD_LEN packets followed by a shorter
+   * (possibly empty) one for payloads that don't fit. <seq> is advanced past the packets.
+   */
+  static std::string frame(uint8_t& seq, const std::string& payload);
+
+  /**
+   * Wraps <data>, framed packets, in compressed protocol packets of up to MAX_PAYLOAD_LEN bytes
+   * of it each. As with real clients, pieces shorter than MinCompressLength or that don't shrink
+   * are sent as they are. <seq> is the compressed sequence id, advanced past the packets.
+   */
+  static std::string compress(uint8_t& seq, const std::string& data);
+  static constexpr size_t MinCompressLength = 50;
+
+  static std::string serverHandshake(uint32_t capabilities, uint32_t thread_id,
+                                     const std::string& auth_plugin);
+  static std::string clientHandshake(uint32_t capabilities, const std::string& user,
+                                     const std::string& db, const std::string& auth_plugin);
+  static std::string authSwitchRequest(const std::string& auth_plugin, const std::string& data);
+  // OK, ERR and EOF packets carry the fields the negotiated <capabilities> call for.
+  static std::string ok(uint32_t capabilities, uint64_t affected_rows, uint64_t last_insert_id,
+                        uint16_t status);
+  static std::string err(uint32_t capabilities, uint16_t code, const std::string& state,
+                         const std::string& message);
+  static std::string eof(uint32_t capabilities, uint16_t status);
+  // The packet that ends the rows of a result set: an EOF packet, or with CLIENT_DEPRECATE_EOF an
+  // OK packet under the EOF header. The column definitions then aren't followed by an EOF either.
+  static std::string rowsEnd(uint32_t capabilities, uint16_t status);
+  static std::string command(uint8_t command, const std::string& arg);
+  static std::string localInfileRequest(const std::string& filename);
+  // <type> is a MYSQL_TYPE_*; VARCHAR by default.
+  static std::string columnDefinition(const std::string& schema, const std::string& table,
+                                      const std::string& name, uint8_t type = 0xfd);
+  static std::string textRow(const std::vector<std::string>& values);
+
+  // COM_STMT_PREPARE_OK, which the parameter and column definitions follow.
+  static std::string prepareOk(uint32_t statement_id, uint16_t columns, uint16_t params);
+  // COM_STMT_EXECUTE of <statement_id> with BIGINT <params>.
+  static std::string execute(uint32_t statement_id, const std::vector<uint64_t>& params);
+  // A binary protocol row without NULLs. Values of fixed size types are passed as their little
+  // endian bytes, see fixedInt(); the others get a length prefix.
+  static std::string binaryRow(const std::vector<uint8_t>& types,
+                               const std::vector<std::string>& values);
+};
+
+}; // namespace MySQL
@@ -0,0 +1,758 @@
+#include "pcap_reader.h"
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "tins/ethernetII.h"
+#include "tins/ip.h"
+#include "tins/ipv6.h"
+#include "tins/loopback.h"
+#include "tins/sll.h"
+
+#include "fmt/format.h"
+#include "exception.h"
+
+using namespace Envoy;
+
+namespace MySQL {
+
+namespace {
+
+// Link types, see https://www.tcpdump.org/linktypes.html.
+const uint32_t LinkTypeNull = 0;
+const uint32_t LinkTypeEthernet = 1;
+const uint32_t LinkTypeRaw = 101;
+const uint32_t LinkTypeLoop = 108;
+const uint32_t LinkTypeLinuxSll = 113;
+const uint32_t LinkTypeIpv4 = 228;
+const uint32_t LinkTypeIpv6 = 229;
+
+const uint32_t PcapMagic = 0xa1b2c3d4;
+const uint32_t PcapNanoMagic = 0xa1b23c4d;
+const uint32_t PcapNgSectionHeader = 0x0a0d0d0a;
+const uint32_t PcapNgByteOrderMagic = 0x1a2b3c4d;
+const uint32_t PcapNgInterfaceDescription = 1;
+const uint32_t PcapNgSimplePacket = 3;
+const uint32_t PcapNgEnhancedPacket = 6;
+
+// Larger records can only come from a corrupt file, and would be carried over chunk after chunk.
+const uint32_t MaxRecordLength = 1 << 28;
+
+const size_t PcapHeaderLength = 24;
+const size_t PcapRecordHeaderLength = 16;
+
+// Consecutive plausible record headers that make split() trust an offset.
+const int ResyncRecords = 8;
+// Records further apart than this in capture time are taken for a false match.
+const uint32_t ResyncMaxGapSeconds = 3600;
+
+/**
+ * What split() needs from the header of a pcap file to tell record headers from packet data.
+ */
+struct PcapFormat {
+  bool swapped_;
+  bool nanoseconds_;
+  uint32_t snapLength_;
+
+  uint32_t read32(const uint8_t* p) const {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return swapped_ ? __builtin_bswap32(v) : v;
+  }
+
+  uint64_t maxRecordLength() const { return PcapRecordHeaderLength + uint64_t(snapLength_); }
+
+  // Parses a file header, returning false if it is not the header of a pcap file.
+  bool parse(const uint8_t* header) {
+    uint32_t magic;
+    memcpy(&magic, header, sizeof(magic));
+    swapped_ = magic == __builtin_bswap32(PcapMagic) || magic == __builtin_bswap32(PcapNanoMagic);
+    if (!swapped_ && magic != PcapMagic && magic != PcapNanoMagic) {
+      return false;
+    }
+    nanoseconds_ = read32(header) == PcapNanoMagic;
+    snapLength_ = read32(header + 16);
+    if (snapLength_ == 0 || snapLength_ > MaxRecordLength) {
+      snapLength_ = MaxRecordLength;
+    }
+    return true;
+  }
+
+  /**
+   * The first offset in <data> where a run of plausible record headers starts that is at least
+   * ResyncRecords records long and longer than the largest packet, so that it can't be made up by
+   * the payload of one packet; or a shorter run that ends exactly at the end of the file, if
+   * <data> reaches it. Returns <size> if there is none whose run fits in <data>.
+   */
+  size_t resync(const uint8_t* data, size_t size, bool eof) const {
+    const uint32_t fraction_limit = nanoseconds_ ? 1000000000 : 1000000;
+    for (size_t candidate = 0; candidate + PcapRecordHeaderLength <= size; candidate++) {
+      size_t pos = candidate;
+      uint32_t first_seconds = read32(data + pos);
+      int records = 0;
+      while ((records < ResyncRecords || pos - candidate <= maxRecordLength()) &&
+             pos + PcapRecordHeaderLength <= size) {
+        const uint8_t* header = data + pos;
+        uint32_t seconds = read32(header);
+        uint32_t captured = read32(header + 8);
+        uint32_t original = read32(header + 12);
+        // Zeroed packet data would otherwise pass for a run of empty records.
+        if (read32(header + 4) >= fraction_limit || captured == 0 || captured > snapLength_ ||
+            captured > original || original > MaxRecordLength ||
+            seconds - first_seconds + ResyncMaxGapSeconds > 2 * ResyncMaxGapSeconds) {
+          break;
+        }
+        pos += PcapRecordHeaderLength + captured;
+        records++;
+      }
+      if ((records >= ResyncRecords && pos - candidate > maxRecordLength() && pos <= size) ||
+          (eof && pos == size && records > 0)) {
+        return candidate;
+      }
+    }
+    return size;
+  }
+};
+
+} // namespace
+
+Tins::PDU* PacketView::pdu() const {
+  switch (linkType_) {
+  case LinkTypeEthernet:
+    return new Tins::EthernetII(data_, length_);
+  case LinkTypeLinuxSll:
+    return new Tins::SLL(data_, length_);
+  case LinkTypeNull:
+  case LinkTypeLoop:
+    return new Tins::Loopback(data_, length_);
+  case LinkTypeRaw:
+  case LinkTypeIpv4:
+  case LinkTypeIpv6:
+    if (length_ > 0 && (data_[0] >> 4) == 6) {
+      return new Tins::IPv6(data_, length_);
+    }
+    return new Tins::IP(data_, length_);
+  default:
+    return nullptr;
+  }
+}
+
+/**
+ * The io_uring system calls, without liburing. Only what reading a file needs: queueing reads,
+ * submitting them and reaping their completions.
+ */
+class PcapReader::IoUring {
+public:
+  // Returns nullptr if io_uring is not available.
+  static std::unique_ptr<IoUring> create(uint32_t entries) {
+    std::unique_ptr<IoUring> ring(new IoUring());
+    if (!ring->setup(entries)) {
+      return nullptr;
+    }
+    return ring;
+  }
+
+  ~IoUring() {
+    if (sqes_ != nullptr) {
+      munmap(sqes_, sqesSize_);
+    }
+    if (cqMap_ != nullptr && cqMap_ != sqMap_) {
+      munmap(cqMap_, cqMapSize_);
+    }
+    if (sqMap_ != nullptr) {
+      munmap(sqMap_, sqMapSize_);
+    }
+    if (fd_ != -1) {
+      close(fd_);
+    }
+  }
+
+  // Queues a readv of <iov> at <offset>. <iov> must stay valid until the read completes.
+  void read(int fd, const iovec* iov, uint64_t offset, uint64_t tag) {
+    uint32_t tail = *sqTail_;
+    uint32_t index = tail & *sqMask_;
+    io_uring_sqe& sqe = sqes_[index];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READV;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(iov);
+    sqe.len = 1;
+    sqe.off = offset;
+    sqe.user_data = tag;
+    sqArray_[index] = index;
+    // The kernel reads the entry once it sees the new tail.
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    queued_++;
+  }
+
+  // Submits the queued reads, waiting for at least <wait> completions.
+  void submit(uint32_t wait) {
+    while (queued_ > 0 || wait > 0) {
+      int rc = syscall(__NR_io_uring_enter, fd_, queued_, wait,
+                       wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+      if (rc == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw EnvoyException(fmt::format("io_uring_enter failed: {}", strerror(errno)));
+      }
+      queued_ -= rc;
+      wait = 0;
+    }
+  }
+
+  // Pops the next completion, if there is one.
+  bool complete(uint64_t& tag, int32_t& result) {
+    uint32_t head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    const io_uring_cqe& cqe = cqes_[head & *cqMask_];
+    tag = cqe.user_data;
+    result = cqe.res;
+    __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  uint32_t entries() const { return entries_; }
+
+private:
+  IoUring() = default;
+
+  bool setup(uint32_t entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd_ == -1) {
+      return false;
+    }
+    entries_ = params.sq_entries;
+
+    sqMapSize_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cqMapSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      sqMapSize_ = cqMapSize_ = std::max(sqMapSize_, cqMapSize_);
+    }
+    sqMap_ = map(sqMapSize_, IORING_OFF_SQ_RING);
+    if (sqMap_ == nullptr) {
+      return false;
+    }
+    cqMap_ = params.features & IORING_FEAT_SINGLE_MMAP ? sqMap_
+                                                        : map(cqMapSize_, IORING_OFF_CQ_RING);
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(map(sqesSize_, IORING_OFF_SQES));
+    if (cqMap_ == nullptr || sqes_ == nullptr) {
+      return false;
+    }
+
+    uint8_t* sq = static_cast<uint8_t*>(sqMap_);
+    sqTail_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    sqMask_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    uint8_t* cq = static_cast<uint8_t*>(cqMap_);
+    cqHead_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    cqMask_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  void* map(size_t size, off_t offset) {
+    void* addr =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+    return addr == MAP_FAILED ? nullptr : addr;
+  }
+
+  int fd_ = -1;
+  uint32_t entries_ = 0;
+  uint32_t queued_ = 0;
+  void* sqMap_ = nullptr;
+  size_t sqMapSize_ = 0;
+  void* cqMap_ = nullptr;
+  size_t cqMapSize_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqesSize_ = 0;
+  uint32_t* sqTail_;
+  uint32_t* sqMask_;
+  uint32_t* sqArray_;
+  uint32_t* cqHead_;
+  uint32_t* cqTail_;
+  uint32_t* cqMask_;
+  io_uring_cqe* cqes_;
+};
+
+/**
+ * Splits the bytes of a file, fed in consecutive chunks, into records and hands out the packets
+ * among them. A pcap file is a 24 byte header followed by records with 16 byte headers; a pcapng
+ * file is a sequence of blocks that all start with their type and length.
+ */
+class PcapReader::Parser {
+public:
+  Parser(const std::string& path, const PacketCallback& callback, Stats& stats)
+      : path_(path), callback_(callback), stats_(stats), format_(Format::Unknown), swapped_(false),
+        nanoseconds_(false), linkType_(0) {}
+
+  // Returns false once the callback asked to stop.
+  bool feed(const uint8_t* data, size_t size) {
+    size_t pos = 0;
+
+    // Complete the record the last chunk ended in.
+    while (!carry_.empty() && pos < size) {
+      size_t length = recordLength(carry_.data(), carry_.size());
+      size_t wanted = length != 0 ? length : headerLength();
+      size_t n = std::min(wanted - carry_.size(), size - pos);
+      carry_.insert(carry_.end(), data + pos, data + pos + n);
+      pos += n;
+      if (length != 0 && carry_.size() == length) {
+        stats_.copiedRecords_++;
+        bool more = handle(carry_.data(), length);
+        carry_.clear();
+        if (!more) {
+          return false;
+        }
+      }
+    }
+
+    while (pos < size) {
+      size_t length = recordLength(data + pos, size - pos);
+      if (length == 0 || length > size - pos) {
+        carry_.assign(data + pos, data + size);
+        return true;
+      }
+      if (!handle(data + pos, length)) {
+        return false;
+      }
+      pos += length;
+    }
+    return true;
+  }
+
+  // @throw EnvoyException if the file didn't even have a header.
+  void finish() {
+    if (format_ == Format::Unknown) {
+      throw EnvoyException(fmt::format("{} is not a pcap or pcapng file", path_));
+    }
+  }
+
+private:
+  enum class Format { Unknown, Pcap, PcapNg };
+
+  struct Interface {
+    uint32_t linkType_;
+    // Timestamp units per second.
+    uint64_t resolution_;
+  };
+
+  uint32_t read32(const uint8_t* p) const {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return swapped_ ? __builtin_bswap32(v) : v;
+  }
+  uint16_t read16(const uint8_t* p) const {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return swapped_ ? __builtin_bswap16(v) : v;
+  }
+
+  // Bytes needed to tell the length of the next record. Every pcapng block is at least this
+  // long, and a section header needs it to find its byte order.
+  size_t headerLength() const { return format_ == Format::Pcap ? 16 : 12; }
+
+  // Length of the record at <data>, or 0 if <size> is too short to tell.
+  size_t recordLength(const uint8_t* data, size_t size) {
+    if (size < headerLength()) {
+      return 0;
+    }
+
+    uint64_t length;
+    uint32_t magic;
+    memcpy(&magic, data, sizeof(magic));
+    if (format_ == Format::Pcap) {
+      length = 16 + uint64_t(read32(data + 8));
+    } else if (magic == PcapNgSectionHeader) {
+      // A section can change the byte order, and its own length is already written in it.
+      uint32_t order;
+      memcpy(&order, data + 8, sizeof(order));
+      if (order != PcapNgByteOrderMagic && order != __builtin_bswap32(PcapNgByteOrderMagic)) {
+        throw EnvoyException(fmt::format("Corrupt pcapng section header in {}", path_));
+      }
+      uint32_t section_length;
+      memcpy(&section_length, data + 4, sizeof(section_length));
+      length = order == PcapNgByteOrderMagic ? section_length : __builtin_bswap32(section_length);
+    } else if (format_ == Format::PcapNg) {
+      length = read32(data + 4);
+    } else if (magic == PcapMagic || magic == PcapNanoMagic ||
+               magic == __builtin_bswap32(PcapMagic) || magic == __builtin_bswap32(PcapNanoMagic)) {
+      length = 24;
+    } else {
+      throw EnvoyException(fmt::format("{} is not a pcap or pcapng file", path_));
+    }
+
+    if (length > MaxRecordLength || length < headerLength() ||
+        (format_ != Format::Pcap && length % 4 != 0)) {
+      throw EnvoyException(fmt::format("Corrupt record of {} bytes in {}", length, path_));
+    }
+    return length;
+  }
+
+  bool handle(const uint8_t* data, size_t length) {
+    uint32_t magic;
+    memcpy(&magic, data, sizeof(magic));
+
+    if (format_ == Format::Unknown && magic != PcapNgSectionHeader) {
+      format_ = Format::Pcap;
+      swapped_ = magic == __builtin_bswap32(PcapMagic) || magic == __builtin_bswap32(PcapNanoMagic);
+      nanoseconds_ = read32(data) == PcapNanoMagic;
+      // The upper bits may hold the FCS length.
+      linkType_ = read32(data + 20) & 0x0fffffff;
+      return true;
+    }
+
+    if (format_ == Format::Pcap) {
+      PacketView view;
+      view.data_ = data + 16;
+      view.length_ = read32(data + 8);
+      view.wireLength_ = read32(data + 12);
+      uint64_t fraction = read32(data + 4);
+      view.timestamp_ = std::chrono::microseconds(uint64_t(read32(data)) * 1000000 +
+                                                  (nanoseconds_ ? fraction / 1000 : fraction));
+      view.linkType_ = linkType_;
+      return deliver(view);
+    }
+
+    if (magic == PcapNgSectionHeader) {
+      format_ = Format::PcapNg;
+      uint32_t order;
+      memcpy(&order, data + 8, sizeof(order));
+      swapped_ = order != PcapNgByteOrderMagic;
+      interfaces_.clear();
+      return true;
+    }
+
+    switch (read32(data)) {
+    case PcapNgInterfaceDescription:
+      interfaces_.push_back(Interface{read16(data + 8), interfaceResolution(data, length)});
+      return true;
+
+    case PcapNgEnhancedPacket: {
+      if (length < 32) {
+        throw EnvoyException(fmt::format("Corrupt pcapng packet block in {}", path_));
+      }
+      PacketView view;
+      const Interface& interface = this->interface(read32(data + 8));
+      view.length_ = read32(data + 20);
+      view.wireLength_ = read32(data + 24);
+      if (view.length_ > length - 32) {
+        throw EnvoyException(fmt::format("Corrupt pcapng packet block in {}", path_));
+      }
+      view.data_ = data + 28;
+      uint64_t ts = (uint64_t(read32(data + 12)) << 32) | read32(data + 16);
+      // The fraction times 10^6 overflows 64 bits for resolutions finer than 10^-13.
+      view.timestamp_ = std::chrono::microseconds(
+          ts / interface.resolution_ * 1000000 +
+          static_cast<uint64_t>(static_cast<unsigned __int128>(ts % interface.resolution_) *
+                                1000000 / interface.resolution_));
+      view.linkType_ = interface.linkType_;
+      return deliver(view);
+    }
+
+    case PcapNgSimplePacket: {
+      // Captured on the first interface, without a timestamp.
+      if (length < 16) {
+        throw EnvoyException(fmt::format("Corrupt pcapng packet block in {}", path_));
+      }
+      PacketView view;
+      view.wireLength_ = read32(data + 8);
+      view.length_ = std::min<uint32_t>(view.wireLength_, length - 16);
+      view.data_ = data + 12;
+      view.timestamp_ = std::chrono::microseconds(0);
+      view.linkType_ = interface(0).linkType_;
+      return deliver(view);
+    }
+
+    default:
+      // Statistics, name resolution and custom blocks.
+      return true;
+    }
+  }
+
+  // The if_tsresol option of an interface description block, 10^-6 by default.
+  // @throw EnvoyException if the units per second don't fit in 64 bits.
+  uint64_t interfaceResolution(const uint8_t* data, size_t length) const {
+    size_t pos = 16;
+    while (pos + 4 <= length - 4) {
+      uint16_t code = read16(data + pos);
+      uint16_t size = read16(data + pos + 2);
+      if (code == 0) {
+        break;
+      }
+      if (code == 9 && size == 1 && pos + 5 <= length - 4) {
+        uint8_t resolution = data[pos + 4];
+        bool binary = resolution & 0x80;
+        int exponent = resolution & 0x7f;
+        if (exponent > (binary ? 63 : 19)) {
+          throw EnvoyException(
+              fmt::format("Unsupported timestamp resolution {:#x} in {}", resolution, path_));
+        }
+        uint64_t units = 1;
+        for (int i = 0; i < exponent; i++) {
+          units *= binary ? 2 : 10;
+        }
+        return units;
+      }
+      pos += 4 + ((size + 3) & ~3);
+    }
+    return 1000000;
+  }
+
+  const Interface& interface(uint32_t id) const {
+    if (id >= interfaces_.size()) {
+      throw EnvoyException(fmt::format("Packet on undeclared interface {} in {}", id, path_));
+    }
+    return interfaces_[id];
+  }
+
+  bool deliver(const PacketView& view) {
+    stats_.packets_++;
+    return callback_(view);
+  }
+
+  const std::string& path_;
+  const PacketCallback& callback_;
+  Stats& stats_;
+  Format format_;
+  bool swapped_;
+  bool nanoseconds_;
+  uint32_t linkType_;
+  std::vector<Interface> interfaces_;
+  // The start of a record that continues in the next chunk.
+  std::vector<uint8_t> carry_;
+};
+
+PcapReader::PcapReader(const std::string& path, const Options& options)
+    : path_(path), options_(options), mode_(Mode::Mmap) {
+  fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ == -1) {
+    throw EnvoyException(fmt::format("Unable to open {}: {}", path, strerror(errno)));
+  }
+  struct stat st;
+  if (fstat(fd_, &st) == -1) {
+    int error = errno;
+    close(fd_);
+    throw EnvoyException(fmt::format("Unable to stat {}: {}", path, strerror(error)));
+  }
+  size_ = st.st_size;
+
+  if (!options_.mmap_) {
+    ring_ = IoUring::create(std::max<uint32_t>(options_.queueDepth_, 1));
+    if (ring_ != nullptr) {
+      mode_ = Mode::IoUring;
+    }
+  }
+}
+
+PcapReader::~PcapReader() { close(fd_); }
+
+void PcapReader::read(const PacketCallback& callback, const Range& range) {
+  if (range.begin_ > range.end_ || range.end_ > size_) {
+    throw EnvoyException(
+        fmt::format("Range [{}, {}) is not in {}", range.begin_, range.end_, path_));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  Parser parser(path_, callback, stats_);
+  if (range.begin_ > 0) {
+    // The records of a range are only understood with the file header.
+    uint8_t header[PcapHeaderLength];
+    parser.feed(header, readAt(header, std::min<uint64_t>(sizeof(header), range.begin_), 0));
+  }
+  if (mode_ == Mode::IoUring) {
+    readRing(parser, range);
+  } else {
+    readMap(parser, range);
+  }
+  stats_.elapsed_ = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  parser.finish();
+}
+
+std::vector<PcapReader::Range> PcapReader::split(size_t parts) const {
+  std::vector<Range> ranges;
+  uint8_t header[PcapHeaderLength];
+  PcapFormat format;
+  if (parts <= 1 || readAt(header, sizeof(header), 0) < sizeof(header) || !format.parse(header)) {
+    ranges.push_back(Range{0, size_});
+    return ranges;
+  }
+
+  // The window after each split point holds the first record after the point and the longest
+  // run resync() checks from there.
+  const size_t window =
+      std::min<uint64_t>((2 * ResyncRecords + 1) * format.maxRecordLength(), 64 << 20);
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[window]);
+
+  uint64_t begin = 0;
+  for (size_t i = 1; i < parts; i++) {
+    uint64_t point = std::max<uint64_t>(size_ / parts * i, sizeof(header));
+    if (point <= begin) {
+      continue;
+    }
+    size_t length = readAt(buffer.get(), window, point);
+    size_t offset = format.resync(buffer.get(), length, point + length == size_);
+    if (offset == length) {
+      continue;
+    }
+    ranges.push_back(Range{begin, point + offset});
+    begin = point + offset;
+  }
+  ranges.push_back(Range{begin, size_});
+  return ranges;
+}
+
+size_t PcapReader::readAt(uint8_t* buffer, size_t length, uint64_t offset) const {
+  size_t filled = 0;
+  while (filled < length) {
+    ssize_t n = pread(fd_, buffer + filled, length - filled, offset + filled);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1) {
+      throw EnvoyException(fmt::format("Unable to read {}: {}", path_, strerror(errno)));
+    }
+    if (n == 0) {
+      break;
+    }
+    filled += n;
+  }
+  return filled;
+}
+
+void PcapReader::readRing(Parser& parser, const Range& range) {
+  struct Chunk {
+    std::unique_ptr<uint8_t[]> buffer_;
+    iovec iov_;
+    uint64_t offset_;
+    uint32_t length_;
+    uint32_t filled_;
+  };
+
+  // Chunk n of the file is read into slot n % depth. Up to depth reads are in flight, while the
+  // chunks before them are parsed in order.
+  const uint64_t chunk_size = std::max<uint32_t>(options_.chunkSize_, 4096);
+  const uint32_t depth = ring_->entries();
+  std::vector<Chunk> chunks(depth);
+  uint32_t in_flight = 0;
+
+  auto submit = [&](Chunk& chunk) {
+    chunk.iov_.iov_base = chunk.buffer_.get() + chunk.filled_;
+    chunk.iov_.iov_len = chunk.length_ - chunk.filled_;
+    ring_->read(fd_, &chunk.iov_, chunk.offset_ + chunk.filled_, &chunk - chunks.data());
+    in_flight++;
+  };
+  auto start = [&](uint64_t n) {
+    Chunk& chunk = chunks[n % depth];
+    if (chunk.buffer_ == nullptr) {
+      chunk.buffer_.reset(new uint8_t[chunk_size]);
+    }
+    chunk.offset_ = range.begin_ + n * chunk_size;
+    chunk.length_ = std::min(chunk_size, range.end_ - chunk.offset_);
+    chunk.filled_ = 0;
+    submit(chunk);
+  };
+  auto reap = [&]() {
+    uint64_t tag;
+    int32_t result;
+    while (ring_->complete(tag, result)) {
+      in_flight--;
+      Chunk& chunk = chunks[tag];
+      if (result == -EINTR || result == -EAGAIN) {
+        submit(chunk);
+      } else if (result < 0) {
+        throw EnvoyException(fmt::format("Unable to read {}: {}", path_, strerror(-result)));
+      } else if (result == 0) {
+        // The file was truncated while being read.
+        chunk.length_ = chunk.filled_;
+      } else {
+        chunk.filled_ += result;
+        if (chunk.filled_ < chunk.length_) {
+          submit(chunk);
+        }
+      }
+    }
+  };
+
+  const uint64_t count = (range.end_ - range.begin_ + chunk_size - 1) / chunk_size;
+  try {
+    for (uint64_t n = 0; n < std::min<uint64_t>(depth, count); n++) {
+      start(n);
+    }
+    ring_->submit(0);
+
+    for (uint64_t n = 0; n < count; n++) {
+      Chunk& chunk = chunks[n % depth];
+      while (chunk.filled_ < chunk.length_) {
+        ring_->submit(1);
+        reap();
+      }
+      stats_.bytes_ += chunk.filled_;
+      if (!parser.feed(chunk.buffer_.get(), chunk.filled_)) {
+        break;
+      }
+      if (n + depth < count) {
+        start(n + depth);
+        ring_->submit(0);
+      }
+    }
+  } catch (...) {
+    // The kernel may still be writing into the buffers.
+    while (in_flight > 0) {
+      ring_->submit(1);
+      uint64_t tag;
+      int32_t result;
+      while (ring_->complete(tag, result)) {
+        in_flight--;
+      }
+    }
+    throw;
+  }
+
+  while (in_flight > 0) {
+    ring_->submit(1);
+    uint64_t tag;
+    int32_t result;
+    while (ring_->complete(tag, result)) {
+      in_flight--;
+    }
+  }
+}
+
+void PcapReader::readMap(Parser& parser, const Range& range) {
+  if (range.begin_ == range.end_) {
+    return;
+  }
+  void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (map == MAP_FAILED) {
+    throw EnvoyException(fmt::format("Unable to map {}: {}", path_, strerror(errno)));
+  }
+  madvise(map, size_, MADV_SEQUENTIAL);
+
+  try {
+    parser.feed(static_cast<const uint8_t*>(map) + range.begin_, range.end_ - range.begin_);
+  } catch (...) {
+    munmap(map, size_);
+    throw;
+  }
+  stats_.bytes_ += range.end_ - range.begin_;
+  munmap(map, size_);
+}
+
+}; // namespace MySQL
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Tins {
+class PDU;
+}
+
+namespace MySQL {
+
+/**
+ * A packet as stored in a capture file. The data points into the reader's buffers and is only
+ * valid during the callback it is passed to.
+ */
+struct PacketView {
+  const uint8_t* data_;
+  // Bytes captured, and the length of the packet on the wire.
+  uint32_t length_;
+  uint32_t wireLength_;
+  std::chrono::microseconds timestamp_;
+  // LINKTYPE_* value of the interface the packet was captured on.
+  uint32_t linkType_;
+
+  // Parses the packet with libtins, or returns nullptr for link types it isn't decoded for.
+  // @throw Tins::malformed_packet if the data doesn't parse.
+  Tins::PDU* pdu() const;
+};
+
+/**
+ * Reads pcap and pcapng files without libpcap. The file is read in large chunks, several of them
+ * in flight at a time through io_uring, and record headers are parsed in place; only a record
+ * that straddles two chunks is copied. Where io_uring is not available, e.g. blocked by a seccomp
+ * policy, the file is mapped with MADV_SEQUENTIAL instead and read without copying at all.
+ */
+class PcapReader {
+public:
+  enum class Mode { IoUring, Mmap };
+
+  struct Options {
+    // Bytes per read, and reads kept in flight.
+    uint32_t chunkSize_ = 4 << 20;
+    uint32_t queueDepth_ = 8;
+    // Skip io_uring and map the file.
+    bool mmap_ = false;
+  };
+
+  struct Stats {
+    uint64_t bytes_ = 0;
+    uint64_t packets_ = 0;
+    // Records straddling two chunks, which had to be copied.
+    uint64_t copiedRecords_ = 0;
+    std::chrono::microseconds elapsed_{0};
+
+    double megabytesPerSecond() const {
+      return elapsed_.count() > 0 ? static_cast<double>(bytes_) / elapsed_.count() : 0;
+    }
+  };
+
+  // Bytes [begin_, end_) of the file, starting and ending on a record boundary.
+  struct Range {
+    uint64_t begin_;
+    uint64_t end_;
+  };
+
+  typedef std::function<bool(const PacketView&)> PacketCallback;
+
+  // @throw EnvoyException if <path> can't be opened.
+  PcapReader(const std::string& path, const Options& options);
+  explicit PcapReader(const std::string& path) : PcapReader(path, Options()) {}
+  ~PcapReader();
+
+  PcapReader(const PcapReader&) = delete;
+  PcapReader& operator=(const PcapReader&) = delete;
+
+  /**
+   * Calls <callback> with every packet in file order, until it returns false or the file ends.
+   * @throw EnvoyException if the file can't be read or is not a pcap or pcapng file. A truncated
+   *   last record is ignored, as written by a capture that was cut short.
+   */
+  void read(const PacketCallback& callback) { read(callback, Range{0, size_}); }
+
+  /**
+   * Like read(), but only calls <callback> for the records in <range>, one of those returned by
+   * split(). Ranges of the same file may be read at once by separate readers.
+   */
+  void read(const PacketCallback& callback, const Range& range);
+
+  /**
+   * Splits a pcap file into up to <parts> ranges of about the same size. Each split point is moved
+   * to the first offset after it where several consecutive record headers are plausible: sane
+   * lengths and timestamps close to each other. A point without such an offset nearby is dropped,
+   * as is every point of a pcapng file, whose packets need the interface blocks before them.
+   * @throw EnvoyException if the file can't be read.
+   */
+  std::vector<Range> split(size_t parts) const;
+
+  uint64_t size() const { return size_; }
+
+  // How the file is read; io_uring unless it is unavailable or Options::mmap_ is set.
+  Mode mode() const { return mode_; }
+  const Stats& stats() const { return stats_; }
+
+private:
+  class IoUring;
+  class Parser;
+
+  void readRing(Parser& parser, const Range& range);
+  void readMap(Parser& parser, const Range& range);
+  // Reads up to <length> bytes at <offset> into <buffer>, returning how many were read.
+  // @throw EnvoyException if the read fails.
+  size_t readAt(uint8_t* buffer, size_t length, uint64_t offset) const;
+
+  const std::string path_;
+  const Options options_;
+  int fd_;
+  uint64_t size_;
+  Mode mode_;
+  // nullptr in Mode::Mmap.
+  std::unique_ptr<IoUring> ring_;
+  Stats stats_;
+};
+
+}; // namespace MySQL
@@ -0,0 +1,245 @@
+#include "tins/ethernetII.h"
+#include "tins/ip.h"
+#include "tins/packet_writer.h"
+#include "tins/rawpdu.h"
+#include "tins/tcp.h"
+
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "workload.h"
+
+using namespace Tins;
+
+namespace {
+
+const uint16_t ServerPort = 3306;
+
+/**
+ * TCP state of one synthetic connection between 10.x.y.z:port and the server at 10.1.0.1:3306.
+ */
+class Connection {
+public:
+  Connection(size_t index, std::vector<MySQL::WorkloadSegment> segments)
+      : segments_(std::move(segments)), next_(0), step_(Step::Syn),
+        clientAddr_(clientAddress(index)),
+        serverAddr_("10.1.0.1"), clientPort_(10000 + index % 50000),
+        clientSeq_(static_cast<uint32_t>(index * 7919 + 1)),
+        serverSeq_(static_cast<uint32_t>(index * 104729 + 1)) {}
+
+  bool done() const { return step_ == Step::Done; }
+
+  /**
+   * Writes the next step of the connection: one leg of the TCP handshake or teardown, or one
+   * segment of MySQL data split into <mss> sized TCP segments.
+   */
+  void writeNext(PacketWriter& writer, timeval& now, size_t mss) {
+    switch (step_) {
+    case Step::Syn:
+      write(writer, now, false, TCP::SYN, "");
+      clientSeq_++;
+      write(writer, now, true, TCP::SYN | TCP::ACK, "");
+      serverSeq_++;
+      write(writer, now, false, TCP::ACK, "");
+      step_ = Step::Data;
+      break;
+    case Step::Data: {
+      const MySQL::WorkloadSegment& segment = segments_[next_];
+      for (size_t offset = 0; offset < segment.data_.size(); offset += mss) {
+        write(writer, now, segment.fromServer_, TCP::PSH | TCP::ACK,
+              segment.data_.substr(offset, mss));
+      }
+      // Drop the data once written; large sessions would otherwise pile up.
+      std::string().swap(segments_[next_].data_);
+      if (++next_ == segments_.size()) {
+        step_ = Step::Fin;
+      }
+      break;
+    }
+    case Step::Fin:
+      write(writer, now, false, TCP::FIN | TCP::ACK, "");
+      clientSeq_++;
+      write(writer, now, true, TCP::FIN | TCP::ACK, "");
+      serverSeq_++;
+      write(writer, now, false, TCP::ACK, "");
+      step_ = Step::Done;
+      break;
+    case Step::Done:
+      break;
+    }
+  }
+
+private:
+  enum class Step { Syn, Data, Fin, Done };
+
+  static IPv4Address clientAddress(size_t index) {
+    size_t host = index + 1;
+    return IPv4Address("10." + std::to_string((host >> 16) & 0xff) + "." +
+                       std::to_string((host >> 8) & 0xff) + "." + std::to_string(host & 0xff));
+  }
+
+  void write(PacketWriter& writer, timeval& now, bool from_server, uint16_t flags,
+             const std::string& payload) {
+    EthernetII eth = from_server ? EthernetII("02:00:00:00:00:01", "02:00:00:00:00:02")
+                                 : EthernetII("02:00:00:00:00:02", "02:00:00:00:00:01");
+    IP ip = from_server ? IP(clientAddr_, serverAddr_) : IP(serverAddr_, clientAddr_);
+    TCP tcp = from_server ? TCP(clientPort_, ServerPort) : TCP(ServerPort, clientPort_);
+
+    uint32_t& seq = from_server ? serverSeq_ : clientSeq_;
+    tcp.seq(seq);
+    tcp.ack_seq(from_server ? clientSeq_ : serverSeq_);
+    tcp.flags(flags);
+    tcp.window(65535);
+
+    EthernetII pkt = payload.empty()
+                         ? eth / ip / tcp
+                         : eth / ip / tcp /
+                               RawPDU(reinterpret_cast<const uint8_t*>(payload.data()),
+                                      payload.size());
+    writer.write(pkt, now);
+    seq += payload.size();
+
+    // 10us between packets, so the decoder sees non-zero and reproducible query latencies.
+    now.tv_usec += 10;
+    if (now.tv_usec >= 1000000) {
+      now.tv_sec++;
+      now.tv_usec -= 1000000;
+    }
+  }
+
+  std::vector<MySQL::WorkloadSegment> segments_;
+  size_t next_;
+  Step step_;
+  IPv4Address clientAddr_;
+  IPv4Address serverAddr_;
+  uint16_t clientPort_;
+  uint32_t clientSeq_;
+  uint32_t serverSeq_;
+};
+
+void usage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [options] [output pcap]" << std::endl;
+  std::cerr << "Writes synthetic MySQL sessions to a pcap file (default /tmp/test.pcap)."
+            << std::endl;
+  std::cerr << "  -n sessions     number of sessions (default 1)" << std::endl;
+  std::cerr << "  -c concurrency  sessions interleaved at a time (default 1)" << std::endl;
+  std::cerr << "  -q queries      result set queries per session (default 10)" << std::endl;
+  std::cerr << "  -p              execute the queries as a prepared statement" << std::endl;
+  std::cerr << "  -z              use the compressed protocol (CLIENT_COMPRESS)" << std::endl;
+  std::cerr << "  -k columns      columns per result set (default 4)" << std::endl;
+  std::cerr << "  -r rows         rows per result set (default 100)" << std::endl;
+  std::cerr << "  -w width        bytes per column value (default 16)" << std::endl;
+  std::cerr << "  -l bytes        also upload a file of <bytes> with LOAD DATA LOCAL INFILE"
+            << std::endl;
+  std::cerr << "  -L bytes        also send and receive a <bytes> payload, e.g. 16777215 or"
+            << std::endl;
+  std::cerr << "                  33554432 to exercise multi-packet payloads" << std::endl;
+  std::cerr << "  -f flags        client capability flags (default 0x"
+            << std::hex << MySQL::WorkloadOptions().capabilities_ << std::dec << "), with"
+            << std::endl;
+  std::cerr << "                  CLIENT_PROTOCOL_41 always set and CLIENT_SSL never" << std::endl;
+  std::cerr << "  -a              have the server request an auth plugin switch (the decoder"
+            << std::endl;
+  std::cerr << "                  does not follow auth switches yet)" << std::endl;
+  std::cerr << "  -m mss          TCP segment payload size (default 1448)" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  MySQL::WorkloadOptions options;
+  size_t sessions = 1;
+  size_t concurrency = 1;
+  size_t mss = 1448;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:c:q:pzk:r:w:l:L:f:am:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      sessions = strtoull(optarg, nullptr, 0);
+      break;
+    case 'c':
+      concurrency = std::max(1ULL, strtoull(optarg, nullptr, 0));
+      break;
+    case 'q':
+      options.queries_ = strtoull(optarg, nullptr, 0);
+      break;
+    case 'p':
+      options.prepared_ = true;
+      break;
+    case 'z':
+      options.compress_ = true;
+      break;
+    case 'k':
+      options.columns_ = std::max(1ULL, strtoull(optarg, nullptr, 0));
+      break;
+    case 'r':
+      options.rows_ = strtoull(optarg, nullptr, 0);
+      break;
+    case 'w':
+      options.width_ = strtoull(optarg, nullptr, 0);
+      break;
+    case 'l':
+      options.localInfileBytes_ = strtoull(optarg, nullptr, 0);
+      break;
+    case 'L':
+      options.largePayloadBytes_ = strtoull(optarg, nullptr, 0);
+      break;
+    case 'f':
+      options.capabilities_ = strtoul(optarg, nullptr, 0);
+      break;
+    case 'a':
+      options.authSwitch_ = true;
+      break;
+    case 'm':
+      mss = std::max(1ULL, strtoull(optarg, nullptr, 0));
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  std::string file = optind < argc ? argv[optind] : "/tmp/test.pcap";
+
+  try {
+    PacketWriter writer(file, DataLinkType<EthernetII>());
+
+    // A fixed start time keeps the output byte for byte reproducible.
+    timeval now;
+    now.tv_sec = 1500000000;
+    now.tv_usec = 0;
+
+    // Round robin over up to <concurrency> open connections, one step each, replacing
+    // connections as they finish.
+    std::deque<std::unique_ptr<Connection>> open;
+    size_t started = 0;
+    while (started < sessions || !open.empty()) {
+      while (open.size() < concurrency && started < sessions) {
+        open.push_back(
+            std::make_unique<Connection>(started, MySQL::buildSession(options, started)));
+        started++;
+      }
+
+      std::unique_ptr<Connection> conn = std::move(open.front());
+      open.pop_front();
+      conn->writeNext(writer, now, mss);
+      if (!conn->done()) {
+        open.push_back(std::move(conn));
+      }
+    }
+  } catch (std::exception& ex) {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
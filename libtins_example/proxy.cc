@@ -0,0 +1,461 @@
+#include "proxy.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <limits.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "common/common/logger.h"
+#include "fmt/format.h"
+#include "exception.h"
+#include "stream_session.h"
+
+using namespace Envoy;
+
+namespace MySQL {
+
+namespace {
+
+// Resolves "host:port" or "[host]:port".
+void resolve(const std::string& address, bool passive, sockaddr_storage& addr,
+             socklen_t& length) {
+  size_t colon = address.rfind(':');
+  if (colon == std::string::npos) {
+    throw EnvoyException(fmt::format("Address {} has no port", address));
+  }
+  std::string host = address.substr(0, colon);
+  std::string port = address.substr(colon + 1);
+  if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+    host = host.substr(1, host.size() - 2);
+  }
+
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = passive ? AI_PASSIVE : 0;
+  addrinfo* result;
+  int rc = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+  if (rc != 0) {
+    throw EnvoyException(fmt::format("Unable to resolve {}: {}", address, gai_strerror(rc)));
+  }
+  memcpy(&addr, result->ai_addr, result->ai_addrlen);
+  length = result->ai_addrlen;
+  freeaddrinfo(result);
+}
+
+void setEndpoint(const sockaddr_storage& addr, std::array<uint8_t, 16>& out, uint16_t& port) {
+  if (addr.ss_family == AF_INET6) {
+    const auto& in6 = reinterpret_cast<const sockaddr_in6&>(addr);
+    memcpy(out.data(), &in6.sin6_addr, out.size());
+    port = ntohs(in6.sin6_port);
+  } else {
+    const auto& in = reinterpret_cast<const sockaddr_in&>(addr);
+    out = QueryEvent::ipv4(in.sin_addr.s_addr);
+    port = ntohs(in.sin_port);
+  }
+}
+
+// Appends the bytes of <data> from <offset> on to <out>.
+void addFrom(Buffer::Instance& out, const Buffer::Instance& data, uint64_t offset) {
+  uint64_t num_slices = data.getRawSlices(nullptr, 0);
+  Buffer::RawSlice slices[num_slices];
+  data.getRawSlices(slices, num_slices);
+  for (Buffer::RawSlice& slice : slices) {
+    if (offset >= slice.len_) {
+      offset -= slice.len_;
+      continue;
+    }
+    out.add(static_cast<uint8_t*>(slice.mem_) + offset, slice.len_ - offset);
+    offset = 0;
+  }
+}
+
+// Writes as much of <data> to the socket <fd> as it takes, returning the bytes written or -1. A
+// peer that reset the connection fails the write with EPIPE rather than raising SIGPIPE.
+ssize_t sendSlices(int fd, const Buffer::Instance& data) {
+  uint64_t num_slices = std::min<uint64_t>(data.getRawSlices(nullptr, 0), IOV_MAX);
+  Buffer::RawSlice slices[num_slices];
+  data.getRawSlices(slices, num_slices);
+  iovec iov[num_slices];
+  for (uint64_t i = 0; i < num_slices; i++) {
+    iov[i].iov_base = slices[i].mem_;
+    iov[i].iov_len = slices[i].len_;
+  }
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = num_slices;
+  ssize_t rc;
+  do {
+    rc = sendmsg(fd, &msg, MSG_NOSIGNAL);
+  } while (rc == -1 && errno == EINTR);
+  return rc;
+}
+
+} // namespace
+
+ProxyIngest::ProxyIngest(const Options& options)
+    : options_(options), listenFd_(-1), epollFd_(-1), stopped_(false) {
+  resolve(options_.upstream_, false, upstream_, upstreamLength_);
+
+  sockaddr_storage listen_addr;
+  socklen_t listen_length;
+  resolve(options_.listen_, true, listen_addr, listen_length);
+  listenFd_ = socket(listen_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listenFd_ == -1) {
+    throw EnvoyException(fmt::format("Unable to open listen socket: {}", strerror(errno)));
+  }
+  int one = 1;
+  setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(listenFd_, reinterpret_cast<sockaddr*>(&listen_addr), listen_length) == -1 ||
+      listen(listenFd_, SOMAXCONN) == -1) {
+    int error = errno;
+    ::close(listenFd_);
+    throw EnvoyException(
+        fmt::format("Unable to listen on {}: {}", options_.listen_, strerror(error)));
+  }
+
+  epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd_ == -1) {
+    int error = errno;
+    ::close(listenFd_);
+    throw EnvoyException(fmt::format("Unable to create epoll instance: {}", strerror(error)));
+  }
+  epoll_event event;
+  event.events = EPOLLIN;
+  // Connections register their endpoints; the listen socket is told apart by its nullptr.
+  event.data.ptr = nullptr;
+  epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &event);
+
+  if (!options_.sessions_.eventFile_.empty()) {
+    events_ = std::make_unique<EventWriter>(options_.sessions_.eventFile_);
+  }
+}
+
+ProxyIngest::~ProxyIngest() {
+  for (Connection& connection : connections_) {
+    close(connection);
+  }
+  ::close(epollFd_);
+  ::close(listenFd_);
+}
+
+void ProxyIngest::run() {
+  std::vector<epoll_event> events(std::max(options_.maxEvents_, 1));
+  while (!stopped_) {
+    int n = epoll_wait(epollFd_, events.data(), events.size(), 100);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw EnvoyException(fmt::format("epoll_wait failed: {}", strerror(errno)));
+    }
+    if (n > 0) {
+      stats_.wakeups_++;
+    }
+
+    for (int i = 0; i < n; i++) {
+      Endpoint* endpoint = static_cast<Endpoint*>(events[i].data.ptr);
+      if (endpoint == nullptr) {
+        accept();
+        continue;
+      }
+
+      Connection& connection = *endpoint->connection_;
+      uint32_t ready = events[i].events;
+      if (!connection.closed_ && (ready & EPOLLERR)) {
+        if (endpoint->connecting_) {
+          stats_.failedConnects_++;
+        }
+        close(connection);
+      }
+      if (!connection.closed_ && (ready & EPOLLOUT)) {
+        onWritable(*endpoint);
+      }
+      if (!connection.closed_ && (ready & (EPOLLIN | EPOLLHUP)) && !endpoint->eof_) {
+        onReadable(*endpoint);
+      }
+    }
+
+    // Closed connections are only dropped now, as later events of the batch may still have
+    // pointed into them.
+    if (connections_.size() != stats_.active_) {
+      connections_.remove_if([](const Connection& connection) { return connection.closed_; });
+    }
+  }
+
+  for (Connection& connection : connections_) {
+    close(connection);
+  }
+  connections_.clear();
+  if (events_ != nullptr) {
+    events_->close();
+  }
+}
+
+void ProxyIngest::accept() {
+  while (true) {
+    sockaddr_storage client_addr;
+    socklen_t client_length = sizeof(client_addr);
+    int client_fd = accept4(listenFd_, reinterpret_cast<sockaddr*>(&client_addr), &client_length,
+                            SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client_fd == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        ENVOY_LOG(warn, "Unable to accept a connection: {}\n", strerror(errno));
+      }
+      return;
+    }
+
+    int server_fd = socket(upstream_.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server_fd == -1 ||
+        (connect(server_fd, reinterpret_cast<sockaddr*>(&upstream_), upstreamLength_) == -1 &&
+         errno != EINPROGRESS)) {
+      ENVOY_LOG(warn, "Unable to connect to {}: {}\n", options_.upstream_, strerror(errno));
+      stats_.failedConnects_++;
+      ::close(client_fd);
+      if (server_fd != -1) {
+        ::close(server_fd);
+      }
+      continue;
+    }
+    // Relayed requests are usually small, and waiting to coalesce them only adds latency.
+    int one = 1;
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(server_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    connections_.emplace_back();
+    Connection& connection = connections_.back();
+    connection.client_.connection_ = &connection;
+    connection.client_.fd_ = client_fd;
+    connection.client_.server_ = false;
+    connection.server_.connection_ = &connection;
+    connection.server_.fd_ = server_fd;
+    connection.server_.server_ = true;
+    connection.server_.connecting_ = true;
+    stats_.connections_++;
+    stats_.active_++;
+
+    QueryEvent endpoints;
+    setEndpoint(client_addr, endpoints.clientAddr_, endpoints.clientPort_);
+    setEndpoint(upstream_, endpoints.serverAddr_, endpoints.serverPort_);
+    connection.session_ = std::make_unique<StreamSession>(
+        latencies_[options_.upstream_], topQueries_, events_.get(), endpoints);
+    connection.session_->decoder_.setResyncOnError(options_.sessions_.resync_);
+    connection.session_->decoder_.setBufferLimit(options_.sessions_.flowBufferLimit_);
+
+    for (Endpoint* endpoint : {&connection.client_, &connection.server_}) {
+      epoll_event event;
+      event.events = endpoint->events_ = wanted(*endpoint);
+      event.data.ptr = endpoint;
+      if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, endpoint->fd_, &event) == -1) {
+        ENVOY_LOG(warn, "Unable to watch a connection: {}\n", strerror(errno));
+        close(connection);
+        break;
+      }
+    }
+  }
+}
+
+void ProxyIngest::onReadable(Endpoint& endpoint) {
+  Connection& connection = *endpoint.connection_;
+  Endpoint& to = peer(endpoint);
+
+  // Read straight into the buffer that goes to the decoder.
+  DecoderBuffer data;
+  Buffer::RawSlice slices[2];
+  uint64_t num_slices = data.reserve(options_.readSize_, slices, 2);
+  iovec iov[2];
+  for (uint64_t i = 0; i < num_slices; i++) {
+    iov[i].iov_base = slices[i].mem_;
+    iov[i].iov_len = slices[i].len_;
+  }
+  ssize_t rc = readv(endpoint.fd_, iov, num_slices);
+  if (rc == -1) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      close(connection);
+    }
+    return;
+  }
+  stats_.reads_++;
+
+  if (rc == 0) {
+    endpoint.eof_ = true;
+    finishWrites(to);
+    update(endpoint);
+    return;
+  }
+
+  uint64_t left = rc;
+  for (uint64_t i = 0; i < num_slices; i++) {
+    slices[i].len_ = std::min<uint64_t>(slices[i].len_, left);
+    left -= slices[i].len_;
+  }
+  data.commit(slices, num_slices);
+  (endpoint.server_ ? stats_.serverBytes_ : stats_.clientBytes_) += rc;
+
+  // Relay the data from where it was read to. Whatever the peer can't take now, or whatever
+  // would overtake bytes already waiting for it, is copied and written once it can.
+  uint64_t relayed = 0;
+  if (to.out_.length() == 0) {
+    // A reset peer (EPIPE, ECONNRESET) closes the pair like any other error.
+    ssize_t written = sendSlices(to.fd_, data);
+    if (written == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      close(connection);
+      return;
+    }
+    relayed = std::max<ssize_t>(written, 0);
+  }
+  if (relayed < data.length()) {
+    addFrom(to.out_, data, relayed);
+    stats_.deferredBytes_ += data.length() - relayed;
+  }
+
+  decode(connection, endpoint.server_, data);
+  update(endpoint);
+  update(to);
+}
+
+void ProxyIngest::onWritable(Endpoint& endpoint) {
+  Connection& connection = *endpoint.connection_;
+  if (endpoint.connecting_) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    getsockopt(endpoint.fd_, SOL_SOCKET, SO_ERROR, &error, &length);
+    if (error != 0) {
+      ENVOY_LOG(warn, "Unable to connect to {}: {}\n", options_.upstream_, strerror(error));
+      stats_.failedConnects_++;
+      close(connection);
+      return;
+    }
+    endpoint.connecting_ = false;
+    update(endpoint);
+    update(peer(endpoint));
+    return;
+  }
+
+  if (endpoint.out_.length() > 0) {
+    ssize_t written = sendSlices(endpoint.fd_, endpoint.out_);
+    if (written == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      close(connection);
+      return;
+    }
+    endpoint.out_.drain(std::max<ssize_t>(written, 0));
+  }
+  if (endpoint.out_.length() == 0) {
+    finishWrites(endpoint);
+    if (connection.closed_) {
+      return;
+    }
+    // The sender may be read from again.
+    update(peer(endpoint));
+  }
+  update(endpoint);
+}
+
+void ProxyIngest::decode(Connection& connection, bool from_server, DecoderBuffer& data) {
+  if (connection.session_ == nullptr) {
+    return;
+  }
+
+  MySQLDecoder& decoder = connection.session_->decoder_;
+  decoder.setTime(std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()));
+  try {
+    if (from_server) {
+      decoder.onServerData(data);
+    } else {
+      decoder.onClientData(data);
+    }
+  } catch (SinkException&) {
+    throw;
+  } catch (EnvoyException& ex) {
+    // The connection is relayed all the same.
+    ENVOY_LOG(debug, "Giving up on decoding a connection: {}\n", ex.what());
+    stats_.decodeErrors_++;
+    connection.session_.reset();
+    return;
+  }
+
+  if (connection.session_->overLimit_) {
+    stats_.shed_++;
+    connection.session_.reset();
+  }
+}
+
+void ProxyIngest::finishWrites(Endpoint& endpoint) {
+  if (endpoint.shutdown_ || !peer(endpoint).eof_ || endpoint.out_.length() > 0) {
+    return;
+  }
+  ::shutdown(endpoint.fd_, SHUT_WR);
+  endpoint.shutdown_ = true;
+
+  Connection& connection = *endpoint.connection_;
+  if (connection.client_.shutdown_ && connection.server_.shutdown_) {
+    close(connection);
+  }
+}
+
+uint32_t ProxyIngest::wanted(Endpoint& endpoint) {
+  if (endpoint.connecting_) {
+    return EPOLLOUT;
+  }
+  Endpoint& to = peer(endpoint);
+  uint32_t events = 0;
+  // Nothing is read while the peer can't be written to, which pushes back on the sender.
+  if (!endpoint.eof_ && !to.connecting_ && to.out_.length() == 0) {
+    events |= EPOLLIN;
+  }
+  if (endpoint.out_.length() > 0) {
+    events |= EPOLLOUT;
+  }
+  return events;
+}
+
+void ProxyIngest::update(Endpoint& endpoint) {
+  if (endpoint.connection_->closed_) {
+    return;
+  }
+  uint32_t events = wanted(endpoint);
+  if (events == endpoint.events_) {
+    return;
+  }
+  epoll_event event;
+  event.events = events;
+  event.data.ptr = &endpoint;
+  if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, endpoint.fd_, &event) == -1) {
+    throw EnvoyException(fmt::format("Unable to update epoll registration: {}", strerror(errno)));
+  }
+  endpoint.events_ = events;
+}
+
+void ProxyIngest::close(Connection& connection) {
+  if (connection.closed_) {
+    return;
+  }
+  connection.closed_ = true;
+  for (Endpoint* endpoint : {&connection.client_, &connection.server_}) {
+    if (endpoint->fd_ != -1) {
+      ::close(endpoint->fd_);
+      endpoint->fd_ = -1;
+    }
+  }
+  connection.session_.reset();
+  stats_.active_--;
+}
+
+}; // namespace MySQL
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+
+#include "codec.h"
+#include "event_file.h"
+#include "fingerprint.h"
+#include "histogram.h"
+#include "session.h"
+
+namespace MySQL {
+
+/**
+ * Decodes connections relayed through a TCP proxy instead of captured ones. Clients connect to
+ * the listen address, each connection is relayed to the upstream server, and both directions are
+ * decoded on the way. This suits deployments where traffic is mirrored or routed into the tool
+ * rather than sniffed.
+ *
+ * Everything runs on one thread around epoll. Each wakeup handles every socket epoll reports
+ * ready, up to maxEvents_, so reads are batched across connections. A ready socket is read with
+ * readv() straight into space reserved in a DecoderBuffer, relayed from there with sendmsg(), and
+ * the buffer is then moved into the decoder, so payloads are not copied on the way. Only bytes
+ * the peer can't take right away are copied, to be written once it can; reading from their
+ * sender pauses until then.
+ *
+ * Writes don't raise SIGPIPE; a peer that resets closes its connection pair only.
+ *
+ * A connection whose decoder fails or goes over sessions_.flowBufferLimit_ is still relayed but
+ * no longer decoded.
+ */
+class ProxyIngest {
+public:
+  struct Options {
+    // host:port or [host]:port; the host may be a name.
+    std::string listen_;
+    std::string upstream_;
+    // Bytes reserved for each read.
+    uint64_t readSize_ = 64 * 1024;
+    // Ready sockets handled per wakeup.
+    int maxEvents_ = 256;
+    // Decoder settings and the event file; the flow table limits don't apply.
+    SessionManager::Options sessions_;
+  };
+
+  struct Stats {
+    uint64_t connections_ = 0;
+    uint64_t active_ = 0;
+    uint64_t failedConnects_ = 0;
+    // Bytes relayed in each direction.
+    uint64_t clientBytes_ = 0;
+    uint64_t serverBytes_ = 0;
+    uint64_t reads_ = 0;
+    uint64_t wakeups_ = 0;
+    // Bytes copied because the peer couldn't take them right away.
+    uint64_t deferredBytes_ = 0;
+    // Connections no longer decoded after an error, or for going over the buffer limit.
+    uint64_t decodeErrors_ = 0;
+    uint64_t shed_ = 0;
+  };
+
+  // Binds the listen address. @throw EnvoyException if an address can't be resolved or bound.
+  ProxyIngest(const Options& options);
+  ~ProxyIngest();
+
+  ProxyIngest(const ProxyIngest&) = delete;
+  ProxyIngest& operator=(const ProxyIngest&) = delete;
+
+  /**
+   * Relays and decodes connections until stop() is called, then closes them and the event file.
+   * @throw EnvoyException if epoll or the event file fails.
+   */
+  void run();
+
+  /**
+   * Asks run() to return. Only touches an atomic flag, so it may be called from a signal handler.
+   */
+  void stop() { stopped_ = true; }
+
+  const Stats& stats() const { return stats_; }
+  const ServerLatencies& latencies() const { return latencies_; }
+  const QueryTopN& topQueries() const { return topQueries_; }
+
+private:
+  struct Connection;
+
+  /**
+   * One socket of a connection, and the bytes waiting to be written to it.
+   */
+  struct Endpoint {
+    Connection* connection_;
+    int fd_ = -1;
+    bool server_;
+    // The server side until its non-blocking connect completes.
+    bool connecting_ = false;
+    // Whether the socket reached end of file, and whether our side of it was shut down, which
+    // happens once its peer reached end of file and out_ is flushed.
+    bool eof_ = false;
+    bool shutdown_ = false;
+    uint32_t events_ = 0;
+    DecoderBuffer out_;
+  };
+
+  struct Connection {
+    Endpoint client_;
+    Endpoint server_;
+    // nullptr once the connection is no longer decoded.
+    std::unique_ptr<StreamSession> session_;
+    bool closed_ = false;
+  };
+  typedef std::list<Connection> ConnectionList;
+
+  void accept();
+  void onReadable(Endpoint& endpoint);
+  void onWritable(Endpoint& endpoint);
+  void decode(Connection& connection, bool from_server, DecoderBuffer& data);
+  // Shuts down the write side of <endpoint> once its peer is done and out_ is flushed.
+  void finishWrites(Endpoint& endpoint);
+  // The events <endpoint> waits for now, and registering them.
+  uint32_t wanted(Endpoint& endpoint);
+  void update(Endpoint& endpoint);
+  void close(Connection& connection);
+  Endpoint& peer(Endpoint& endpoint) {
+    return endpoint.server_ ? endpoint.connection_->client_ : endpoint.connection_->server_;
+  }
+
+  const Options options_;
+  sockaddr_storage upstream_;
+  socklen_t upstreamLength_;
+  int listenFd_;
+  int epollFd_;
+  std::atomic<bool> stopped_;
+  ConnectionList connections_;
+  Stats stats_;
+  ServerLatencies latencies_;
+  QueryTopN topQueries_;
+  std::unique_ptr<EventWriter> events_;
+};
+
+}; // namespace MySQL
@@ -0,0 +1,144 @@
+#include "replay.h"
+
+#include "tins/exceptions.h"
+#include "tins/ip.h"
+#include "tins/ipv6.h"
+#include "tins/tcp.h"
+
+
+using namespace Tins;
+
+namespace MySQL {
+
+ShardedReplay::ShardedReplay(size_t workers, const SessionManager::Options& sessions,
+                             size_t queue_capacity)
+    : done_(false), failed_(false), readMode_(PcapReader::Mode::Mmap) {
+  for (size_t i = 0; i < workers; i++) {
+    workers_.push_back(std::make_unique<Worker>(queue_capacity, sessions.shard(i, workers)));
+  }
+}
+
+ShardedReplay::~ShardedReplay() { stop(); }
+
+void ShardedReplay::run(const std::string& file, const PcapReader::Options& options) {
+  for (auto& worker : workers_) {
+    Worker* w = worker.get();
+    w->thread_ = std::thread([this, w]() { work(*w); });
+  }
+
+  try {
+    PcapReader reader(file, options);
+    readMode_ = reader.mode();
+    reader.read([this](const PacketView& view) {
+      try {
+        if (PDU* pdu = view.pdu()) {
+          Packet packet(pdu, Timestamp(view.timestamp_));
+          dispatch(packet);
+        }
+      } catch (malformed_packet&) {
+        // Skipped, as libtins' own sniffers do.
+      }
+      return !failed_;
+    });
+    readStats_ = reader.stats();
+  } catch (...) {
+    stop();
+    throw;
+  }
+
+  stop();
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+}
+
+ServerLatencies ShardedReplay::latencies() const {
+  ServerLatencies latencies;
+  for (const auto& worker : workers_) {
+    mergeLatencies(latencies, worker->sessions_.latencies());
+  }
+  return latencies;
+}
+
+QueryTopN ShardedReplay::topQueries() const {
+  QueryTopN queries;
+  for (const auto& worker : workers_) {
+    queries.merge(worker->sessions_.topQueries());
+  }
+  return queries;
+}
+
+// Mixes the two endpoints of a connection so that both directions hash the same.
+static uint64_t hashFlow(uint64_t a, uint64_t b) {
+  uint64_t lo = std::min(a, b), hi = std::max(a, b);
+  uint64_t h = lo * 0x9e3779b97f4a7c15ULL ^ (hi + 0x632be59bd9b4e019ULL) * 0xbf58476d1ce4e5b9ULL;
+  return h ^ (h >> 31);
+}
+
+void ShardedReplay::dispatch(Packet& packet) {
+  const TCP* tcp = packet.pdu()->find_pdu<TCP>();
+  if (tcp == nullptr) {
+    return;
+  }
+
+  uint64_t h;
+  if (const IP* ip = packet.pdu()->find_pdu<IP>()) {
+    h = hashFlow((static_cast<uint64_t>(uint32_t(ip->src_addr())) << 16) | tcp->sport(),
+                 (static_cast<uint64_t>(uint32_t(ip->dst_addr())) << 16) | tcp->dport());
+  } else if (const IPv6* ip6 = packet.pdu()->find_pdu<IPv6>()) {
+    auto fold = [](const IPv6::address_type& addr) {
+      uint64_t v = 0;
+      for (auto it = addr.begin(); it != addr.end(); ++it) {
+        v = v * 131 + *it;
+      }
+      return v;
+    };
+    h = hashFlow(fold(ip6->src_addr()) * 65537 + tcp->sport(),
+                 fold(ip6->dst_addr()) * 65537 + tcp->dport());
+  } else {
+    return;
+  }
+
+  Worker& worker = *workers_[h % workers_.size()];
+  while (!worker.queue_.push(std::move(packet))) {
+    if (failed_) {
+      return;
+    }
+    std::this_thread::yield();
+  }
+}
+
+void ShardedReplay::work(Worker& worker) {
+  Packet packet;
+  try {
+    for (;;) {
+      if (worker.queue_.pop(packet)) {
+        worker.packets_++;
+        worker.sessions_.processPacket(packet);
+      } else if (done_) {
+        // done_ is set after the last push, so one more empty pop means we are finished.
+        if (worker.queue_.empty()) {
+          worker.sessions_.finish();
+          return;
+        }
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  } catch (...) {
+    if (!failed_.exchange(true)) {
+      error_ = std::current_exception();
+    }
+  }
+}
+
+void ShardedReplay::stop() {
+  done_ = true;
+  for (auto& worker : workers_) {
+    if (worker->thread_.joinable()) {
+      worker->thread_.join();
+    }
+  }
+}
+
+}; // namespace MySQL
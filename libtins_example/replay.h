@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tins/packet.h"
+
+#include "common/common/spsc_queue.h"
+
+#include "pcap_reader.h"
+#include "session.h"
+
+namespace MySQL {
+
+/**
+ * Replays a capture file across several decoding threads. The calling thread reads the file and
+ * hashes every TCP packet by its (direction independent) 4-tuple onto one of the workers, so both
+ * halves of a connection always end up on the same worker. Each worker owns a SessionManager and
+ * is fed through its own SpscQueue.
+ */
+class ShardedReplay {
+public:
+  // Each worker's flow table gets the limits in <sessions>; see SessionManager::Options::shard()
+  // for its event file.
+  ShardedReplay(size_t workers,
+                const SessionManager::Options& sessions = SessionManager::Options(),
+                size_t queue_capacity = DefaultQueueCapacity);
+  ~ShardedReplay();
+
+  /**
+   * Replays <file> and returns once every worker has drained its queue. Rethrows the first
+   * exception raised by a worker.
+   */
+  void run(const std::string& file,
+           const PcapReader::Options& reader = PcapReader::Options());
+
+  // Per worker counters, valid after run() returns.
+  uint64_t packets(size_t worker) const { return workers_[worker]->packets_; }
+  uint64_t streams(size_t worker) const { return workers_[worker]->sessions_.streams(); }
+  const SessionManager::FlowStats& flowStats(size_t worker) const {
+    return workers_[worker]->sessions_.flowStats();
+  }
+  size_t workers() const { return workers_.size(); }
+
+  // How the file was read, valid after run() returns.
+  PcapReader::Mode readMode() const { return readMode_; }
+  const PcapReader::Stats& readStats() const { return readStats_; }
+
+  // Query latencies merged across workers, valid after run() returns.
+  ServerLatencies latencies() const;
+  // Query statistics merged across workers, valid after run() returns.
+  QueryTopN topQueries() const;
+
+  static constexpr size_t DefaultQueueCapacity = 4096;
+
+private:
+  struct Worker {
+    Worker(size_t queue_capacity, const SessionManager::Options& sessions)
+        : queue_(queue_capacity), sessions_(sessions), packets_(0) {}
+
+    Envoy::SpscQueue<Tins::Packet> queue_;
+    SessionManager sessions_;
+    uint64_t packets_;
+    std::thread thread_;
+  };
+
+  void dispatch(Tins::Packet& packet);
+  void work(Worker& worker);
+  void stop();
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<bool> done_;
+  std::atomic<bool> failed_;
+  std::exception_ptr error_;
+  PcapReader::Mode readMode_;
+  PcapReader::Stats readStats_;
+};
+
+}; // namespace MySQL
@@ -0,0 +1,220 @@
+#include "session.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "stream_session.h"
+
+using Tins::TCPIP::Stream;
+using Tins::TCPIP::StreamFollower;
+
+namespace MySQL {
+
+namespace {
+
+const uint16_t MySQLPort = 3306;
+
+std::string serverName(const Stream& stream, bool swapped) {
+  if (swapped) {
+    if (stream.is_v6()) {
+      return "[" + stream.client_addr_v6().to_string() + "]:" +
+             std::to_string(stream.client_port());
+    }
+    return stream.client_addr_v4().to_string() + ":" + std::to_string(stream.client_port());
+  }
+  if (stream.is_v6()) {
+    return "[" + stream.server_addr_v6().to_string() + "]:" + std::to_string(stream.server_port());
+  }
+  return stream.server_addr_v4().to_string() + ":" + std::to_string(stream.server_port());
+}
+
+// The connection's endpoints, in an otherwise empty event.
+QueryEvent endpoints(const Stream& stream, bool swapped) {
+  QueryEvent event;
+  if (stream.is_v6()) {
+    auto client = stream.client_addr_v6(), server = stream.server_addr_v6();
+    std::copy(client.begin(), client.end(), event.clientAddr_.begin());
+    std::copy(server.begin(), server.end(), event.serverAddr_.begin());
+  } else {
+    // libtins keeps IPv4 addresses in network byte order.
+    event.clientAddr_ = QueryEvent::ipv4(uint32_t(stream.client_addr_v4()));
+    event.serverAddr_ = QueryEvent::ipv4(uint32_t(stream.server_addr_v4()));
+  }
+  event.clientPort_ = stream.client_port();
+  event.serverPort_ = stream.server_port();
+  if (swapped) {
+    std::swap(event.clientAddr_, event.serverAddr_);
+    std::swap(event.clientPort_, event.serverPort_);
+  }
+  return event;
+}
+
+} // namespace
+
+SessionManager::Options SessionManager::Options::shard(size_t index, size_t count) const {
+  Options options = *this;
+  if (count > 1 && !eventFile_.empty()) {
+    options.eventFile_ += "." + std::to_string(index);
+  }
+  return options;
+}
+
+SessionManager::SessionManager() : SessionManager(Options()) {}
+
+SessionManager::SessionManager(const Options& options) : options_(options), streams_(0) {
+  if (!options_.eventFile_.empty()) {
+    events_ = std::make_unique<EventWriter>(options_.eventFile_);
+  }
+  follower_.new_stream_callback([this](Stream& stream) { onNewStream(stream); });
+  follower_.stream_termination_callback(
+      [this](Stream& stream, StreamFollower::TerminationReason reason) {
+        // libtins gave up on the stream: it went quiet, or it buffered too much out of order data.
+        if (remove(stream)) {
+          if (reason == StreamFollower::TIMEOUT) {
+            flowStats_.idleEvictions_++;
+          } else {
+            flowStats_.memoryEvictions_++;
+          }
+        }
+      });
+  follower_.stream_keep_alive(options_.idleTimeout_);
+  follower_.follow_partial_streams(options_.resync_);
+}
+
+SessionManager::~SessionManager() {}
+
+void SessionManager::finish() {
+  if (events_ != nullptr) {
+    events_->close();
+  }
+}
+
+void SessionManager::processPacket(Tins::Packet& packet) {
+  follower_.process_packet(packet);
+
+  // Evicting a flow destroys its decoder, which mustn't happen while the decoder runs. The idle
+  // and memory limits are enforced here, once the stream callbacks returned; the callbacks evict
+  // too, but only where no decoder is running: onNewStream() before the new flow has one, and
+  // onData() once its decoder returned.
+  enforceLimits(std::chrono::microseconds(packet.timestamp()));
+}
+
+void SessionManager::onNewStream(Stream& stream) {
+  if (!flows_.empty() && flows_.size() >= options_.maxFlows_) {
+    evict(flows_.begin(), Eviction::Full);
+  }
+
+  // libtins takes whoever sent the first packet it saw for the client. Without the handshake to
+  // go by, the server is told apart by its port.
+  bool swapped = stream.is_partial_stream() && stream.client_port() == MySQLPort &&
+                 stream.server_port() != MySQLPort;
+
+  auto session = std::make_unique<StreamSession>(latencies_[serverName(stream, swapped)],
+                                                 topQueries_, events_.get(),
+                                                 endpoints(stream, swapped));
+  session->decoder_.setResyncOnError(options_.resync_);
+  session->decoder_.setBufferLimit(options_.flowBufferLimit_);
+  if (stream.is_partial_stream()) {
+    session->decoder_.resync();
+    flowStats_.partialFlows_++;
+    flowStats_.resyncs_++;
+  }
+  streams_++;
+
+  FlowList::iterator flow = flows_.insert(
+      flows_.end(), Flow{&stream, std::move(session), stream.last_seen(), swapped, 0});
+  flowIndex_[&stream] = flow;
+  flowStats_.flows_ = flows_.size();
+
+  stream.client_data_callback([this, flow](Stream&) { onData(flow, false); });
+  stream.server_data_callback([this, flow](Stream&) { onData(flow, true); });
+  stream.stream_closed_callback([this](Stream& stream) { remove(stream); });
+  stream.auto_cleanup_payloads(true);
+}
+
+void SessionManager::onData(FlowList::iterator flow, bool server_side) {
+  Stream& stream = *flow->stream_;
+  MySQLDecoder& decoder = flow->session_->decoder_;
+  uint64_t resyncs = decoder.resyncs();
+
+  flow->lastSeen_ = stream.last_seen();
+  flows_.splice(flows_.end(), flows_, flow);
+
+  // The payload vectors belong to libtins and are cleared once the callback returns, so the
+  // decoder frames packets on them in place and only copies what it has to keep.
+  decoder.setTime(stream.last_seen());
+  auto& p = server_side ? stream.server_payload() : stream.client_payload();
+  if (server_side != flow->swapped_) {
+    decoder.onServerData(p.data(), p.size());
+  } else {
+    decoder.onClientData(p.data(), p.size());
+  }
+  flowStats_.resyncs_ += decoder.resyncs() - resyncs;
+
+  // The decoder has returned, so its flow can go right away.
+  if (flow->session_->overLimit_) {
+    evict(flow, Eviction::Watermark);
+    return;
+  }
+
+  uint64_t bytes = decoder.bufferedBytes();
+  flowStats_.bufferedBytes_ = flowStats_.bufferedBytes_ - flow->bufferedBytes_ + bytes;
+  flowStats_.peakBufferedBytes_ = std::max(flowStats_.peakBufferedBytes_, flowStats_.bufferedBytes_);
+  flow->bufferedBytes_ = bytes;
+}
+
+void SessionManager::evict(FlowList::iterator flow, Eviction reason) {
+  switch (reason) {
+  case Eviction::Full:
+    flowStats_.fullEvictions_++;
+    break;
+  case Eviction::Idle:
+    flowStats_.idleEvictions_++;
+    break;
+  case Eviction::Memory:
+    flowStats_.memoryEvictions_++;
+    break;
+  case Eviction::Watermark:
+    flowStats_.watermarkEvictions_++;
+    break;
+  }
+
+  // libtins keeps following the stream until it ends, but stops buffering its payloads and
+  // calling back with them.
+  flow->stream_->ignore_client_data();
+  flow->stream_->ignore_server_data();
+  remove(*flow->stream_);
+}
+
+bool SessionManager::remove(const Stream& stream) {
+  auto it = flowIndex_.find(&stream);
+  if (it == flowIndex_.end()) {
+    return false;
+  }
+
+  FlowList::iterator flow = it->second;
+  flowStats_.bufferedBytes_ -= flow->bufferedBytes_;
+  flowIndex_.erase(it);
+  flows_.erase(flow);
+  flowStats_.flows_ = flows_.size();
+  return true;
+}
+
+void SessionManager::enforceLimits(std::chrono::microseconds now) {
+  while (!flows_.empty() && now - flows_.front().lastSeen_ > options_.idleTimeout_) {
+    evict(flows_.begin(), Eviction::Idle);
+  }
+
+  // Flows that hold nothing are skipped, evicting them would not free anything.
+  for (auto flow = flows_.begin();
+       flow != flows_.end() && flowStats_.bufferedBytes_ > options_.memoryBudget_;) {
+    auto next = std::next(flow);
+    if (flow->bufferedBytes_ > 0) {
+      evict(flow, Eviction::Memory);
+    }
+    flow = next;
+  }
+}
+
+}; // namespace MySQL
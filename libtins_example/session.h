@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "tins/packet.h"
+#include "tins/tcp_ip/stream_follower.h"
+
+#include "event_file.h"
+#include "fingerprint.h"
+#include "histogram.h"
+
+namespace MySQL {
+
+class StreamSession;
+
+/**
+ * Follows the TCP streams in a packet feed and runs a MySQLDecoder on each of them. A
+ * SessionManager is not thread safe; concurrent feeds each need their own.
+ *
+ * The decoders are kept in a flow table with a fixed number of slots, ordered by activity. A
+ * flow is evicted, and the rest of its stream ignored, when a new one needs its slot, when it has
+ * been idle too long, or when the bytes buffered by all decoders together exceed the budget. The
+ * least recently active flows go first. A flow whose decoder parks more unframed data than the
+ * per flow limit, which the decoder reports through its watermark callbacks, is shed right away.
+ */
+class SessionManager {
+public:
+  struct Options {
+    size_t maxFlows_ = 65536;
+    // Measured in capture time.
+    std::chrono::microseconds idleTimeout_ = std::chrono::minutes(5);
+    // Bytes all decoders together may buffer: partial and queued packets.
+    uint64_t memoryBudget_ = 1ULL << 30;
+    // Unframed bytes a single connection may park in either direction before it is shed; 0 for no
+    // limit. Legitimate packets are at most 16 MiB.
+    uint64_t flowBufferLimit_ = 32ULL << 20;
+    // Follow connections that were already open when the capture started, and have decoders
+    // resynchronize on errors rather than fail the whole feed.
+    bool resync_ = true;
+    // Every completed command is written to this event file, if set.
+    std::string eventFile_;
+
+    // The options of shard <index> of <count>, e.g. a replay worker: each shard writes an event
+    // file of its own, named after eventFile_ with the shard index appended.
+    Options shard(size_t index, size_t count) const;
+  };
+
+  struct FlowStats {
+    // Flows currently tracked, and the bytes their decoders buffer.
+    uint64_t flows_ = 0;
+    uint64_t bufferedBytes_ = 0;
+    uint64_t peakBufferedBytes_ = 0;
+    // Flows evicted to make room for a new one, for being idle, to stay within the budget, and
+    // for going over flowBufferLimit_.
+    uint64_t fullEvictions_ = 0;
+    uint64_t idleEvictions_ = 0;
+    uint64_t memoryEvictions_ = 0;
+    uint64_t watermarkEvictions_ = 0;
+    // Flows joined mid-stream, and decoder resynchronizations including theirs.
+    uint64_t partialFlows_ = 0;
+    uint64_t resyncs_ = 0;
+
+    uint64_t evictions() const {
+      return fullEvictions_ + idleEvictions_ + memoryEvictions_ + watermarkEvictions_;
+    }
+  };
+
+  SessionManager();
+  SessionManager(const Options& options);
+  ~SessionManager();
+
+  void processPacket(Tins::Packet& packet);
+
+  // Writes out the events still buffered and closes the event file, if there is one. Call once
+  // the feed is over; otherwise the destructor does, ignoring errors.
+  // @throw EnvoyException if the event file can't be written.
+  void finish();
+
+  // Number of streams followed so far.
+  uint64_t streams() const { return streams_; }
+
+  const FlowStats& flowStats() const { return flowStats_; }
+
+  // Latency of every completed command, per server and command.
+  const ServerLatencies& latencies() const { return latencies_; }
+
+  // Text protocol queries aggregated by fingerprint.
+  const QueryTopN& topQueries() const { return topQueries_; }
+
+private:
+  struct Flow {
+    Tins::TCPIP::Stream* stream_;
+    std::unique_ptr<StreamSession> session_;
+    std::chrono::microseconds lastSeen_;
+    // Whether libtins took the server for the client, which happens for partial streams.
+    bool swapped_;
+    // What the decoder held after its last call, as accounted for in flowStats_.
+    uint64_t bufferedBytes_;
+  };
+  // Least recently active first.
+  typedef std::list<Flow> FlowList;
+
+  enum class Eviction { Full, Idle, Memory, Watermark };
+
+  void onNewStream(Tins::TCPIP::Stream& stream);
+  // <server_side> is the side libtins calls the server.
+  void onData(FlowList::iterator flow, bool server_side);
+  void evict(FlowList::iterator flow, Eviction reason);
+  // Drops the flow of <stream>, if it is still tracked.
+  bool remove(const Tins::TCPIP::Stream& stream);
+  void enforceLimits(std::chrono::microseconds now);
+
+  const Options options_;
+  Tins::TCPIP::StreamFollower follower_;
+  uint64_t streams_;
+  FlowList flows_;
+  std::unordered_map<const Tins::TCPIP::Stream*, FlowList::iterator> flowIndex_;
+  FlowStats flowStats_;
+  ServerLatencies latencies_;
+  QueryTopN topQueries_;
+  std::unique_ptr<EventWriter> events_;
+};
+
+}; // namespace MySQL
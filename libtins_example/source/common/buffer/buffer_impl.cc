@@ -1,9 +1,12 @@
 #include "common/buffer/buffer_impl.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <string>
 #include <assert.h>
 
+#include "common/common/byte_search.h"
+
 //#include "common/common/assert.h"
 
 #include "event2/buffer.h"
@@ -77,21 +80,38 @@ void* OwnedImpl::linearize(uint32_t size) {
 }
 
 void OwnedImpl::move(Instance& rhs) {
-  // We do the static cast here because in practice we only have one buffer implementation right
-  // now and this is safe. Using the evbuffer move routines require having access to both evbuffers.
-  // This is a reasonable compromise in a high performance path where we want to maintain an
-  // abstraction in case we get rid of evbuffer later.
-  int rc = evbuffer_add_buffer(buffer_.get(), static_cast<LibEventInstance&>(rhs).buffer().get());
+  // Using the evbuffer move routines requires having access to both evbuffers. Any other buffer
+  // implementation is copied out and drained instead.
+  LibEventInstance* other = dynamic_cast<LibEventInstance*>(&rhs);
+  if (other == nullptr) {
+    add(rhs);
+    rhs.drain(rhs.length());
+    return;
+  }
+  int rc = evbuffer_add_buffer(buffer_.get(), other->buffer().get());
   assert(rc == 0);
-  static_cast<LibEventInstance&>(rhs).postProcess();
+  other->postProcess();
 }
 
 void OwnedImpl::move(Instance& rhs, uint64_t length) {
-  // See move() above for why we do the static cast.
-  int rc = evbuffer_remove_buffer(static_cast<LibEventInstance&>(rhs).buffer().get(), buffer_.get(),
-                                  length);
+  // See move() above.
+  LibEventInstance* other = dynamic_cast<LibEventInstance*>(&rhs);
+  if (other == nullptr) {
+    uint64_t num_slices = rhs.getRawSlices(nullptr, 0);
+    RawSlice slices[num_slices];
+    rhs.getRawSlices(slices, num_slices);
+    uint64_t left = length;
+    for (uint64_t i = 0; i < num_slices && left > 0; i++) {
+      uint64_t n = std::min<uint64_t>(left, slices[i].len_);
+      add(slices[i].mem_, n);
+      left -= n;
+    }
+    rhs.drain(length);
+    return;
+  }
+  int rc = evbuffer_remove_buffer(other->buffer().get(), buffer_.get(), length);
   assert(static_cast<uint64_t>(rc) == length);
-  static_cast<LibEventInstance&>(rhs).postProcess();
+  other->postProcess();
 }
 
 int OwnedImpl::read(int fd, uint64_t max_length) {
@@ -106,6 +126,10 @@ uint64_t OwnedImpl::reserve(uint64_t length, RawSlice* iovecs, uint64_t num_iove
 }
 
 ssize_t OwnedImpl::search(const void* data, uint64_t size, size_t start) const {
+  if (size == 1) {
+    return searchByte(*static_cast<const uint8_t*>(data), start);
+  }
+
   evbuffer_ptr start_ptr;
   if (-1 == evbuffer_ptr_set(buffer_.get(), &start_ptr, start, EVBUFFER_PTR_SET)) {
     return -1;
@@ -116,6 +140,43 @@ ssize_t OwnedImpl::search(const void* data, uint64_t size, size_t start) const {
   return result_ptr.pos;
 }
 
+ssize_t OwnedImpl::searchByte(uint8_t byte, size_t start) const {
+  // evbuffer_search() looks for the first byte slice by slice with memchr() and then compares the
+  // rest; for a single byte, scan the slices with the vectorized kernel directly. The common case
+  // is a search from the front, which needs no evbuffer_ptr (and no walk over the chain) at all.
+  static constexpr int MaxSlices = 16;
+  evbuffer_iovec slices[MaxSlices];
+  evbuffer_ptr start_ptr;
+  evbuffer_ptr* from = nullptr;
+  size_t pos = start;
+  if (start != 0) {
+    if (-1 == evbuffer_ptr_set(buffer_.get(), &start_ptr, start, EVBUFFER_PTR_SET)) {
+      return -1;
+    }
+    from = &start_ptr;
+  }
+
+  while (true) {
+    int num_slices = evbuffer_peek(buffer_.get(), -1, from, slices, MaxSlices);
+    for (int i = 0; i < num_slices; i++) {
+      const void* found = ByteSearch::find(slices[i].iov_base, slices[i].iov_len, byte);
+      if (found != nullptr) {
+        return pos + (static_cast<const uint8_t*>(found) -
+                      static_cast<const uint8_t*>(slices[i].iov_base));
+      }
+      pos += slices[i].iov_len;
+    }
+
+    // With an unbounded length evbuffer_peek() fills at most MaxSlices, so a full batch means
+    // there may be more.
+    if (num_slices < MaxSlices ||
+        -1 == evbuffer_ptr_set(buffer_.get(), &start_ptr, pos, EVBUFFER_PTR_SET)) {
+      return -1;
+    }
+    from = &start_ptr;
+  }
+}
+
 int OwnedImpl::write(int fd) { return evbuffer_write(buffer_.get(), fd); }
 
 OwnedImpl::OwnedImpl() : buffer_(evbuffer_new()) {}
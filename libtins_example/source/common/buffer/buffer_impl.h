@@ -57,8 +57,8 @@ public:
 /**
  * Wraps an allocated and owned evbuffer.
  *
- * Note that due to the internals of move() accessing buffer(), OwnedImpl is not
- * compatible with non-LibEventInstance buffers.
+ * Note that move() only avoids copying between LibEventInstance buffers, whose evbuffers it
+ * accesses through buffer(); data moved from any other buffer is copied.
  */
 class OwnedImpl : public LibEventInstance {
 public:
@@ -89,6 +89,8 @@ public:
   Event::Libevent::BufferPtr& buffer() override { return buffer_; }
 
 private:
+  ssize_t searchByte(uint8_t byte, size_t start) const;
+
   Event::Libevent::BufferPtr buffer_;
 };
 
@@ -0,0 +1,459 @@
+#include "common/buffer/slab_impl.h"
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <assert.h>
+
+#include "common/common/byte_search.h"
+
+namespace Envoy {
+namespace Buffer {
+
+namespace {
+
+// Free standard slabs of the current thread. Slabs go back to the list of whichever thread
+// releases them last.
+class SlabPool {
+public:
+  ~SlabPool() {
+    destroyed_ = true;
+    for (void* mem : free_) {
+      ::operator delete(mem);
+    }
+  }
+
+  void* get() {
+    if (free_.empty()) {
+      return ::operator new(AllocationSize);
+    }
+    void* mem = free_.back();
+    free_.pop_back();
+    return mem;
+  }
+
+  void put(void* mem) {
+    if (free_.size() < MaxFree) {
+      free_.push_back(mem);
+    } else {
+      ::operator delete(mem);
+    }
+  }
+
+  static constexpr size_t AllocationSize = sizeof(Slab) + Slab::Size;
+  // 4MB per thread.
+  static constexpr size_t MaxFree = 256;
+
+  // Buffers destroyed after the thread's pool, e.g. in static destructors, free their slabs.
+  static thread_local bool destroyed_;
+
+private:
+  std::vector<void*> free_;
+};
+
+thread_local bool SlabPool::destroyed_ = false;
+thread_local SlabPool pool;
+
+} // namespace
+
+Slab* Slab::create(uint64_t capacity) {
+  capacity = std::max(capacity, Size);
+  void* mem = capacity == Size && !SlabPool::destroyed_ ? pool.get()
+                                                        : ::operator new(sizeof(Slab) + capacity);
+  return new (mem) Slab(capacity, nullptr);
+}
+
+Slab* Slab::wrap(BufferFragment& fragment) {
+  return new (::operator new(sizeof(Slab))) Slab(0, &fragment);
+}
+
+void Slab::unref() {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+
+  BufferFragment* fragment = fragment_;
+  uint64_t capacity = capacity_;
+  this->~Slab();
+  if (fragment != nullptr) {
+    ::operator delete(this);
+    fragment->done();
+  } else if (capacity == Size && !SlabPool::destroyed_) {
+    pool.put(this);
+  } else {
+    ::operator delete(this);
+  }
+}
+
+void SlabImpl::SliceDeque::grow() {
+  Slice* ring = new Slice[capacity_ * 2];
+  for (size_t i = 0; i < size_; i++) {
+    ring[i] = (*this)[i];
+  }
+  if (ring_ != inline_) {
+    delete[] ring_;
+  }
+  ring_ = ring;
+  start_ = 0;
+  capacity_ *= 2;
+}
+
+SlabImpl::SlabImpl() : length_(0), reservation_(nullptr) {}
+
+SlabImpl::SlabImpl(const std::string& data) : SlabImpl() { add(data); }
+
+SlabImpl::SlabImpl(const Instance& data) : SlabImpl() { add(data); }
+
+SlabImpl::SlabImpl(const void* data, uint64_t size) : SlabImpl() { add(data, size); }
+
+SlabImpl::~SlabImpl() {
+  for (size_t i = 0; i < slices_.size(); i++) {
+    release(slices_[i]);
+  }
+  releaseReservation();
+}
+
+SlabImpl::Slice& SlabImpl::tail(uint64_t size_hint) {
+  if (slices_.empty()) {
+    // Nothing can refer to the inline storage any more.
+    slices_.push_back(Slice{nullptr, inline_, 0, InlineSize});
+  } else if (slices_.back().capacity_ == 0) {
+    // One slab for the whole write if it's large, to keep the chain short.
+    Slab* slab = Slab::create(size_hint > 4 * Slab::Size ? size_hint : Slab::Size);
+    slices_.push_back(Slice{slab, slab->data(), 0, slab->capacity()});
+  }
+  return slices_.back();
+}
+
+void SlabImpl::add(const void* data, uint64_t size) {
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  length_ += size;
+  while (size > 0) {
+    Slice& slice = tail(size);
+    uint64_t n = std::min(size, slice.capacity_);
+    memcpy(slice.data_ + slice.size_, src, n);
+    slice.size_ += n;
+    slice.capacity_ -= n;
+    src += n;
+    size -= n;
+  }
+}
+
+void SlabImpl::addBufferFragment(BufferFragment& fragment) {
+  if (fragment.size() == 0) {
+    fragment.done();
+    return;
+  }
+  slices_.push_back(Slice{Slab::wrap(fragment),
+                          static_cast<uint8_t*>(const_cast<void*>(fragment.data())),
+                          fragment.size(), 0});
+  length_ += fragment.size();
+}
+
+void SlabImpl::add(const std::string& data) { add(data.data(), data.size()); }
+
+void SlabImpl::add(const Instance& data) {
+  uint64_t num_slices = data.getRawSlices(nullptr, 0);
+  if (num_slices == 0) {
+    return;
+  }
+  RawSlice slices[num_slices];
+  data.getRawSlices(slices, num_slices);
+  for (RawSlice& slice : slices) {
+    add(slice.mem_, slice.len_);
+  }
+}
+
+uint64_t SlabImpl::reserve(uint64_t length, RawSlice* iovecs, uint64_t num_iovecs) {
+  if (num_iovecs == 0 || length == 0) {
+    return 0;
+  }
+
+  releaseReservation();
+  if (!slices_.empty() && slices_.back().capacity_ >= length) {
+    Slice& slice = slices_.back();
+    iovecs[0].mem_ = slice.data_ + slice.size_;
+    iovecs[0].len_ = slice.capacity_;
+    return 1;
+  }
+
+  reservation_ = Slab::create(length);
+  iovecs[0].mem_ = reservation_->data();
+  iovecs[0].len_ = reservation_->capacity();
+  return 1;
+}
+
+void SlabImpl::commit(RawSlice* iovecs, uint64_t num_iovecs) {
+  for (uint64_t i = 0; i < num_iovecs; i++) {
+    uint8_t* mem = static_cast<uint8_t*>(iovecs[i].mem_);
+    uint64_t len = iovecs[i].len_;
+    if (len == 0) {
+      continue;
+    }
+
+    if (!slices_.empty()) {
+      Slice& slice = slices_.back();
+      if (mem == slice.data_ + slice.size_ && len <= slice.capacity_) {
+        slice.size_ += len;
+        slice.capacity_ -= len;
+        length_ += len;
+        continue;
+      }
+    }
+    assert(reservation_ != nullptr && mem == reservation_->data() &&
+           len <= reservation_->capacity());
+    slices_.push_back(Slice{reservation_, mem, len, reservation_->capacity() - len});
+    reservation_ = nullptr;
+    length_ += len;
+  }
+  releaseReservation();
+}
+
+void SlabImpl::releaseReservation() {
+  if (reservation_ != nullptr) {
+    reservation_->unref();
+    reservation_ = nullptr;
+  }
+}
+
+void SlabImpl::copyOut(size_t start, uint64_t size, void* data) const {
+  assert(start + size <= length());
+
+  uint8_t* dest = static_cast<uint8_t*>(data);
+  for (size_t i = 0; i < slices_.size() && size > 0; i++) {
+    const Slice& slice = slices_[i];
+    if (start >= slice.size_) {
+      start -= slice.size_;
+      continue;
+    }
+    uint64_t n = std::min(size, slice.size_ - start);
+    memcpy(dest, slice.data_ + start, n);
+    dest += n;
+    size -= n;
+    start = 0;
+  }
+}
+
+void SlabImpl::drain(uint64_t size) {
+  assert(size <= length());
+
+  length_ -= size;
+  while (size > 0) {
+    Slice& slice = slices_.front();
+    if (size < slice.size_) {
+      slice.data_ += size;
+      slice.size_ -= size;
+      return;
+    }
+    size -= slice.size_;
+    release(slice);
+    slices_.pop_front();
+  }
+}
+
+uint64_t SlabImpl::getRawSlices(RawSlice* out, uint64_t out_size) const {
+  uint64_t n = std::min<uint64_t>(out_size, slices_.size());
+  for (uint64_t i = 0; i < n; i++) {
+    out[i].mem_ = slices_[i].data_;
+    out[i].len_ = slices_[i].size_;
+  }
+  return slices_.size();
+}
+
+void* SlabImpl::linearize(uint32_t size) {
+  assert(size <= length());
+
+  if (slices_.empty()) {
+    return nullptr;
+  }
+  if (slices_.front().size_ >= size) {
+    return slices_.front().data_;
+  }
+
+  Slab* slab = Slab::create(size);
+  copyOut(0, size, slab->data());
+  // The length is unchanged in the end, so subclasses need not see this drain.
+  SlabImpl::drain(size);
+  // Only the last slice may append.
+  uint64_t capacity = slices_.empty() ? slab->capacity() - size : 0;
+  slices_.push_front(Slice{slab, slab->data(), size, capacity});
+  length_ += size;
+  return slab->data();
+}
+
+void SlabImpl::append(const Slice& slice) {
+  // Small slices are copied into the room left at the tail, which keeps the chain short and the
+  // slab they came from free to be recycled. The inline storage of another buffer can only be
+  // copied.
+  bool copy = slice.slab_ == nullptr;
+  if (!copy && slice.size_ <= CopyThreshold) {
+    copy = slices_.empty() ? slice.size_ <= InlineSize : slice.size_ <= slices_.back().capacity_;
+  }
+  if (copy) {
+    add(slice.data_, slice.size_);
+    release(slice);
+    return;
+  }
+
+  if (!slices_.empty()) {
+    slices_.back().capacity_ = 0;
+  }
+  slices_.push_back(slice);
+  length_ += slice.size_;
+}
+
+void SlabImpl::move(Instance& rhs) {
+  SlabImpl* other = dynamic_cast<SlabImpl*>(&rhs);
+  if (other == nullptr) {
+    add(rhs);
+    rhs.drain(rhs.length());
+    return;
+  }
+  if (other == this) {
+    return;
+  }
+
+  for (size_t i = 0; i < other->slices_.size(); i++) {
+    append(other->slices_[i]);
+  }
+  other->slices_.clear();
+  other->length_ = 0;
+  other->postProcess();
+}
+
+void SlabImpl::move(Instance& rhs, uint64_t length) {
+  assert(length <= rhs.length());
+
+  SlabImpl* other = dynamic_cast<SlabImpl*>(&rhs);
+  if (other == nullptr) {
+    if (length == 0) {
+      return;
+    }
+    uint64_t num_slices = rhs.getRawSlices(nullptr, 0);
+    RawSlice slices[num_slices];
+    rhs.getRawSlices(slices, num_slices);
+    uint64_t left = length;
+    for (uint64_t i = 0; i < num_slices && left > 0; i++) {
+      uint64_t n = std::min<uint64_t>(left, slices[i].len_);
+      add(slices[i].mem_, n);
+      left -= n;
+    }
+    rhs.drain(length);
+    return;
+  }
+
+  other->length_ -= length;
+  while (length > 0) {
+    Slice& slice = other->slices_.front();
+    if (slice.size_ <= length) {
+      length -= slice.size_;
+      Slice whole = slice;
+      other->slices_.pop_front();
+      append(whole);
+      continue;
+    }
+
+    // Split the slice: copy the front part out, or share the slab with it. The part that stays
+    // keeps the room to append to.
+    if (slice.slab_ == nullptr || length <= CopyThreshold) {
+      add(slice.data_, length);
+    } else {
+      slice.slab_->ref();
+      append(Slice{slice.slab_, slice.data_, length, 0});
+    }
+    slice.data_ += length;
+    slice.size_ -= length;
+    length = 0;
+  }
+  other->postProcess();
+}
+
+int SlabImpl::read(int fd, uint64_t max_length) {
+  if (max_length == 0) {
+    return 0;
+  }
+  RawSlice slice;
+  reserve(std::min(max_length, Slab::Size), &slice, 1);
+  ssize_t n = ::read(fd, slice.mem_, std::min<uint64_t>(slice.len_, max_length));
+  if (n > 0) {
+    slice.len_ = n;
+    commit(&slice, 1);
+  } else {
+    releaseReservation();
+  }
+  return n;
+}
+
+int SlabImpl::write(int fd) {
+  static constexpr size_t MaxSlices = 16;
+  iovec iov[MaxSlices];
+  size_t n = std::min(MaxSlices, slices_.size());
+  for (size_t i = 0; i < n; i++) {
+    iov[i].iov_base = slices_[i].data_;
+    iov[i].iov_len = slices_[i].size_;
+  }
+  ssize_t written = ::writev(fd, iov, n);
+  if (written > 0) {
+    drain(written);
+  }
+  return written;
+}
+
+ssize_t SlabImpl::search(const void* data, uint64_t size, size_t start) const {
+  const uint8_t* needle = static_cast<const uint8_t*>(data);
+  if (size == 0) {
+    return start <= length_ ? start : -1;
+  }
+
+  size_t pos = 0;
+  for (size_t i = 0; i < slices_.size(); i++) {
+    const Slice& slice = slices_[i];
+    if (start >= pos + slice.size_) {
+      pos += slice.size_;
+      continue;
+    }
+
+    uint64_t offset = start > pos ? start - pos : 0;
+    while (offset < slice.size_) {
+      const void* found =
+          ByteSearch::find(slice.data_ + offset, slice.size_ - offset, needle[0]);
+      if (found == nullptr) {
+        break;
+      }
+      offset = static_cast<const uint8_t*>(found) - slice.data_;
+      if (pos + offset + size > length_) {
+        return -1;
+      }
+      if (size == 1 || matches(i, offset + 1, needle + 1, size - 1)) {
+        return pos + offset;
+      }
+      offset++;
+    }
+    pos += slice.size_;
+  }
+  return -1;
+}
+
+bool SlabImpl::matches(size_t index, uint64_t offset, const uint8_t* data, uint64_t size) const {
+  for (; index < slices_.size() && size > 0; index++, offset = 0) {
+    const Slice& slice = slices_[index];
+    if (offset >= slice.size_) {
+      offset -= slice.size_;
+      continue;
+    }
+    uint64_t n = std::min(size, slice.size_ - offset);
+    if (memcmp(slice.data_ + offset, data, n) != 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return size == 0;
+}
+
+} // namespace Buffer
+} // namespace Envoy
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "envoy/buffer/buffer.h"
+
+#include "common/common/non_copyable.h"
+
+namespace Envoy {
+namespace Buffer {
+
+/**
+ * Reference counted block of buffer memory, shared by the slices of every buffer that holds part
+ * of it. Slabs of the standard Size come from a per-thread free list; larger ones, made for big
+ * contiguous writes and linearize(), go straight to the heap. A slab can also stand in for a
+ * BufferFragment, in which case it holds no memory and calls done() on the fragment once the
+ * last reference is gone.
+ */
+class Slab : NonCopyable {
+public:
+  static Slab* create(uint64_t capacity);
+  static Slab* wrap(BufferFragment& fragment);
+
+  void ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+  void unref();
+
+  uint8_t* data() { return reinterpret_cast<uint8_t*>(this + 1); }
+  uint64_t capacity() const { return capacity_; }
+
+  static constexpr uint64_t Size = 16384;
+
+private:
+  Slab(uint64_t capacity, BufferFragment* fragment)
+      : refs_(1), capacity_(capacity), fragment_(fragment) {}
+
+  std::atomic<uint32_t> refs_;
+  uint64_t capacity_;
+  BufferFragment* fragment_;
+};
+
+/**
+ * Buffer::Instance on a chain of slab slices, without evbuffer. Draining and moving whole slices
+ * only passes slab references around, so both are O(1) per slice, and a move of part of a slice
+ * either copies the bytes, when there are few, or shares the slab. The first bytes added to an
+ * empty buffer go to storage inside the object, so the small packets the decoder frames by the
+ * million never touch a slab, and the slice list itself lives inline until it outgrows a few
+ * entries.
+ *
+ * move() from another SlabImpl transfers slices; from any other Instance it falls back to copying
+ * the data out. A buffer is not thread safe, but slabs may be shared by buffers on different
+ * threads.
+ */
+class SlabImpl : NonCopyable, public Instance {
+public:
+  SlabImpl();
+  SlabImpl(const std::string& data);
+  SlabImpl(const Instance& data);
+  SlabImpl(const void* data, uint64_t size);
+  ~SlabImpl();
+
+  // Buffer::Instance
+  void add(const void* data, uint64_t size) override;
+  void addBufferFragment(BufferFragment& fragment) override;
+  void add(const std::string& data) override;
+  void add(const Instance& data) override;
+  void commit(RawSlice* iovecs, uint64_t num_iovecs) override;
+  void copyOut(size_t start, uint64_t size, void* data) const override;
+  void drain(uint64_t size) override;
+  uint64_t getRawSlices(RawSlice* out, uint64_t out_size) const override;
+  uint64_t length() const override { return length_; }
+  void* linearize(uint32_t size) override;
+  void move(Instance& rhs) override;
+  void move(Instance& rhs, uint64_t length) override;
+  int read(int fd, uint64_t max_length) override;
+  uint64_t reserve(uint64_t length, RawSlice* iovecs, uint64_t num_iovecs) override;
+  ssize_t search(const void* data, uint64_t size, size_t start) const override;
+  int write(int fd) override;
+
+  // Called on a SlabImpl after move() took data out of it directly.
+  virtual void postProcess() {}
+
+  static constexpr uint64_t InlineSize = 128;
+  // Parts of a slice up to this size are copied rather than shared by a partial move.
+  static constexpr uint64_t CopyThreshold = 512;
+
+private:
+  struct Slice {
+    // nullptr for the inline storage.
+    Slab* slab_;
+    uint8_t* data_;
+    uint64_t size_;
+    // Free bytes right after the data that this slice, and no other, may append to.
+    uint64_t capacity_;
+  };
+
+  /**
+   * Ring of slices, inline up to InlineSlices entries.
+   */
+  class SliceDeque : NonCopyable {
+  public:
+    SliceDeque() : ring_(inline_), start_(0), size_(0), capacity_(InlineSlices) {}
+    ~SliceDeque() {
+      if (ring_ != inline_) {
+        delete[] ring_;
+      }
+    }
+
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+    Slice& operator[](size_t i) { return ring_[(start_ + i) & (capacity_ - 1)]; }
+    const Slice& operator[](size_t i) const { return ring_[(start_ + i) & (capacity_ - 1)]; }
+    Slice& front() { return (*this)[0]; }
+    Slice& back() { return (*this)[size_ - 1]; }
+
+    void push_back(const Slice& slice) {
+      if (size_ == capacity_) {
+        grow();
+      }
+      (*this)[size_++] = slice;
+    }
+    void push_front(const Slice& slice) {
+      if (size_ == capacity_) {
+        grow();
+      }
+      start_ = (start_ - 1) & (capacity_ - 1);
+      size_++;
+      front() = slice;
+    }
+    void pop_front() {
+      start_ = (start_ + 1) & (capacity_ - 1);
+      size_--;
+    }
+    void clear() { start_ = size_ = 0; }
+
+  private:
+    void grow();
+
+    static constexpr size_t InlineSlices = 4;
+
+    Slice inline_[InlineSlices];
+    Slice* ring_;
+    size_t start_;
+    size_t size_;
+    size_t capacity_;
+  };
+
+  // The slice to append to, adding one if the last has no room left.
+  Slice& tail(uint64_t size_hint);
+  // Appends <slice>, which no longer belongs to its buffer, copying it if it's small enough.
+  void append(const Slice& slice);
+  void releaseReservation();
+  static void release(const Slice& slice) {
+    if (slice.slab_ != nullptr) {
+      slice.slab_->unref();
+    }
+  }
+  bool matches(size_t index, uint64_t offset, const uint8_t* data, uint64_t size) const;
+
+  SliceDeque slices_;
+  uint64_t length_;
+  // Handed out by reserve() and not committed yet.
+  Slab* reservation_;
+  uint8_t inline_[InlineSize];
+};
+
+} // namespace Buffer
+} // namespace Envoy
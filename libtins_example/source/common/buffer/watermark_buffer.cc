@@ -0,0 +1,99 @@
+#include "common/buffer/watermark_buffer.h"
+
+#include <assert.h>
+
+namespace Envoy {
+namespace Buffer {
+
+template <class BufferImpl>
+void WatermarkBufferImpl<BufferImpl>::add(const void* data, uint64_t size) {
+  BufferImpl::add(data, size);
+  checkHighWatermark();
+}
+
+template <class BufferImpl>
+void WatermarkBufferImpl<BufferImpl>::addBufferFragment(BufferFragment& fragment) {
+  BufferImpl::addBufferFragment(fragment);
+  checkHighWatermark();
+}
+
+template <class BufferImpl> void WatermarkBufferImpl<BufferImpl>::add(const std::string& data) {
+  BufferImpl::add(data);
+  checkHighWatermark();
+}
+
+template <class BufferImpl> void WatermarkBufferImpl<BufferImpl>::add(const Instance& data) {
+  BufferImpl::add(data);
+  checkHighWatermark();
+}
+
+template <class BufferImpl>
+void WatermarkBufferImpl<BufferImpl>::commit(RawSlice* iovecs, uint64_t num_iovecs) {
+  BufferImpl::commit(iovecs, num_iovecs);
+  checkHighWatermark();
+}
+
+template <class BufferImpl> void WatermarkBufferImpl<BufferImpl>::drain(uint64_t size) {
+  BufferImpl::drain(size);
+  checkLowWatermark();
+}
+
+template <class BufferImpl> void WatermarkBufferImpl<BufferImpl>::move(Instance& rhs) {
+  BufferImpl::move(rhs);
+  checkHighWatermark();
+}
+
+template <class BufferImpl>
+void WatermarkBufferImpl<BufferImpl>::move(Instance& rhs, uint64_t length) {
+  BufferImpl::move(rhs, length);
+  checkHighWatermark();
+}
+
+template <class BufferImpl> int WatermarkBufferImpl<BufferImpl>::read(int fd, uint64_t max_length) {
+  int bytes_read = BufferImpl::read(fd, max_length);
+  checkHighWatermark();
+  return bytes_read;
+}
+
+template <class BufferImpl> int WatermarkBufferImpl<BufferImpl>::write(int fd) {
+  int bytes_written = BufferImpl::write(fd);
+  checkLowWatermark();
+  return bytes_written;
+}
+
+template <class BufferImpl>
+void WatermarkBufferImpl<BufferImpl>::setWatermarks(uint64_t low_watermark,
+                                                    uint64_t high_watermark) {
+  assert(low_watermark < high_watermark || (high_watermark == 0 && low_watermark == 0));
+  lowWatermark_ = low_watermark;
+  highWatermark_ = high_watermark;
+  checkHighWatermark();
+  checkLowWatermark();
+}
+
+template <class BufferImpl> void WatermarkBufferImpl<BufferImpl>::checkLowWatermark() {
+  // Disabling the watermarks releases a buffer above the high watermark as well.
+  if (!aboveHighWatermarkCalled_ ||
+      (highWatermark_ != 0 && BufferImpl::length() >= lowWatermark_)) {
+    return;
+  }
+
+  aboveHighWatermarkCalled_ = false;
+  belowLowWatermark_();
+}
+
+template <class BufferImpl> void WatermarkBufferImpl<BufferImpl>::checkHighWatermark() {
+  if (aboveHighWatermarkCalled_ || highWatermark_ == 0 ||
+      BufferImpl::length() <= highWatermark_) {
+    return;
+  }
+
+  aboveHighWatermarkCalled_ = true;
+  aboveHighWatermark_();
+}
+
+template class WatermarkBufferImpl<OwnedImpl>;
+template class WatermarkBufferImpl<SlabImpl>;
+
+} // namespace Buffer
+} // namespace Envoy
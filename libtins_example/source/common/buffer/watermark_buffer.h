@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "envoy/buffer/buffer.h"
+
+#include "common/buffer/buffer_impl.h"
+#include "common/buffer/slab_impl.h"
+
+namespace Envoy {
+namespace Buffer {
+
+/**
+ * A buffer which calls above_high_watermark when its length goes over the high watermark, and
+ * below_low_watermark once it has drained under the low watermark again. Until setWatermarks() is
+ * called both are 0, which disables the callbacks.
+ *
+ * Defined for OwnedImpl and SlabImpl. When a buffer of the same implementation moves data out of
+ * this one, it does so behind its back and calls postProcess() afterwards, which is where the low
+ * watermark is checked.
+ */
+template <class BufferImpl> class WatermarkBufferImpl : public BufferImpl {
+public:
+  WatermarkBufferImpl(std::function<void()> below_low_watermark,
+                      std::function<void()> above_high_watermark)
+      : belowLowWatermark_(below_low_watermark), aboveHighWatermark_(above_high_watermark),
+        highWatermark_(0), lowWatermark_(0), aboveHighWatermarkCalled_(false) {}
+
+  // Buffer::Instance
+  void add(const void* data, uint64_t size) override;
+  void addBufferFragment(BufferFragment& fragment) override;
+  void add(const std::string& data) override;
+  void add(const Instance& data) override;
+  void commit(RawSlice* iovecs, uint64_t num_iovecs) override;
+  void drain(uint64_t size) override;
+  void move(Instance& rhs) override;
+  void move(Instance& rhs, uint64_t length) override;
+  int read(int fd, uint64_t max_length) override;
+  int write(int fd) override;
+  void postProcess() override { checkLowWatermark(); }
+
+  // The low watermark is half the high one.
+  void setWatermarks(uint64_t watermark) { setWatermarks(watermark / 2, watermark); }
+  void setWatermarks(uint64_t low_watermark, uint64_t high_watermark);
+  uint64_t highWatermark() const { return highWatermark_; }
+  // Whether above_high_watermark was called last.
+  bool highWatermarkTriggered() const { return aboveHighWatermarkCalled_; }
+
+private:
+  void checkHighWatermark();
+  void checkLowWatermark();
+
+  const std::function<void()> belowLowWatermark_;
+  const std::function<void()> aboveHighWatermark_;
+  uint64_t highWatermark_;
+  uint64_t lowWatermark_;
+  bool aboveHighWatermarkCalled_;
+};
+
+typedef WatermarkBufferImpl<OwnedImpl> WatermarkBuffer;
+typedef std::unique_ptr<WatermarkBuffer> WatermarkBufferPtr;
+
+/**
+ * Creates WatermarkBuffers. The buffers it returns need their watermarks set, e.g.
+ * static_cast<WatermarkBuffer&>(*buffer).setWatermarks(limit).
+ */
+class WatermarkBufferFactory : public WatermarkFactory {
+public:
+  // Buffer::WatermarkFactory
+  InstancePtr create(std::function<void()> below_low_watermark,
+                     std::function<void()> above_high_watermark) override {
+    return InstancePtr{new WatermarkBuffer(below_low_watermark, above_high_watermark)};
+  }
+};
+
+} // namespace Buffer
+} // namespace Envoy
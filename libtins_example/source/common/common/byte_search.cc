@@ -0,0 +1,143 @@
+#include "common/common/byte_search.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace Envoy {
+namespace ByteSearch {
+
+namespace {
+
+typedef const void* (*Kernel)(const void*, size_t, uint8_t);
+
+struct Dispatch {
+  Kernel kernel_;
+  const char* name_;
+};
+
+Dispatch select() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {findAvx2, "avx2"};
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return {findSse2, "sse2"};
+  }
+#endif
+  return {findScalar, "scalar"};
+}
+
+const Dispatch& dispatch() {
+  static const Dispatch selected = select();
+  return selected;
+}
+
+} // namespace
+
+const void* find(const void* data, size_t size, uint8_t byte) {
+  return dispatch().kernel_(data, size, byte);
+}
+
+const char* implementation() { return dispatch().name_; }
+
+const void* findScalar(const void* data, size_t size, uint8_t byte) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    if (p[i] == byte) {
+      return p + i;
+    }
+  }
+  return nullptr;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Both vector kernels only issue aligned loads. An aligned load never crosses a page boundary, so
+// reading the whole block around the first and last byte of the input cannot fault, even though
+// it touches bytes outside of it; those bytes are masked off. The same trick is what libc memchr()
+// relies on, and it is also why the kernels opt out of AddressSanitizer.
+
+__attribute__((target("sse2"), no_sanitize_address)) const void*
+findSse2(const void* data, size_t size, uint8_t byte) {
+  if (size == 0) {
+    return nullptr;
+  }
+
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  const uint8_t* end = p + size;
+  const __m128i needle = _mm_set1_epi8(static_cast<char>(byte));
+
+  size_t misalign = reinterpret_cast<uintptr_t>(p) & 15;
+  const uint8_t* block = p - misalign;
+  uint32_t mask = _mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(block)), needle));
+  mask >>= misalign;
+  if (mask != 0) {
+    const uint8_t* found = p + __builtin_ctz(mask);
+    return found < end ? found : nullptr;
+  }
+
+  for (block += 16; block < end; block += 16) {
+    mask = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(block)), needle));
+    if (mask != 0) {
+      const uint8_t* found = block + __builtin_ctz(mask);
+      return found < end ? found : nullptr;
+    }
+  }
+  return nullptr;
+}
+
+__attribute__((target("avx2"), no_sanitize_address)) const void*
+findAvx2(const void* data, size_t size, uint8_t byte) {
+  if (size == 0) {
+    return nullptr;
+  }
+
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  const uint8_t* end = p + size;
+  const __m256i needle = _mm256_set1_epi8(static_cast<char>(byte));
+
+  size_t misalign = reinterpret_cast<uintptr_t>(p) & 31;
+  const uint8_t* block = p - misalign;
+  uint32_t mask = _mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(_mm256_load_si256(reinterpret_cast<const __m256i*>(block)), needle));
+  mask >>= misalign;
+  if (mask != 0) {
+    const uint8_t* found = p + __builtin_ctz(mask);
+    return found < end ? found : nullptr;
+  }
+  block += 32;
+
+  // Two vectors per iteration for long inputs, so the loop overhead is spread over 64 bytes.
+  for (; end - block > 32; block += 64) {
+    __m256i a =
+        _mm256_cmpeq_epi8(_mm256_load_si256(reinterpret_cast<const __m256i*>(block)), needle);
+    __m256i b = _mm256_cmpeq_epi8(
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(block + 32)), needle);
+    __m256i any = _mm256_or_si256(a, b);
+    if (!_mm256_testz_si256(any, any)) {
+      uint64_t wide = static_cast<uint32_t>(_mm256_movemask_epi8(a)) |
+                      static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(b))) << 32;
+      const uint8_t* found = block + __builtin_ctzll(wide);
+      return found < end ? found : nullptr;
+    }
+  }
+
+  if (block < end) {
+    mask = _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_load_si256(reinterpret_cast<const __m256i*>(block)), needle));
+    if (mask != 0) {
+      const uint8_t* found = block + __builtin_ctz(mask);
+      return found < end ? found : nullptr;
+    }
+  }
+  return nullptr;
+}
+
+#endif
+
+} // namespace ByteSearch
+} // namespace Envoy
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Envoy {
+namespace ByteSearch {
+
+/**
+ * Finds the first occurrence of <byte> in [data, data + size). Dispatches once, on first use, to
+ * the widest kernel the CPU supports (AVX2, then SSE2, then scalar).
+ * @return a pointer to the byte, or nullptr if it does not occur.
+ */
+const void* find(const void* data, size_t size, uint8_t byte);
+
+// The individual kernels, exposed for benchmarks. They return the same results as find(), but
+// calling one the CPU does not support is undefined.
+const void* findScalar(const void* data, size_t size, uint8_t byte);
+#if defined(__x86_64__) || defined(__i386__)
+const void* findSse2(const void* data, size_t size, uint8_t byte);
+const void* findAvx2(const void* data, size_t size, uint8_t byte);
+#endif
+
+// Name of the kernel find() dispatches to, e.g. "avx2".
+const char* implementation();
+
+} // namespace ByteSearch
+} // namespace Envoy
@@ -0,0 +1,107 @@
+#include "common/common/logger.h"
+
+#include <chrono>
+
+namespace Envoy {
+namespace Logger {
+
+// How long the writer sleeps when the ring is empty.
+static constexpr std::chrono::milliseconds IdleWait(1);
+
+std::atomic<Level> AsyncLog::level_{Level::info};
+std::atomic<bool> AsyncLog::started_{false};
+
+AsyncLog::AsyncLog()
+    : slots_(new Slot[Capacity]), out_(stdout), stopping_(false), tail_(0), head_(0),
+      dropped_(0), droppedReported_(0) {
+  for (size_t i = 0; i < Capacity; i++) {
+    slots_[i].sequence_.store(i, std::memory_order_relaxed);
+  }
+  writer_ = std::thread([this]() { run(); });
+  started_.store(true, std::memory_order_release);
+}
+
+AsyncLog::~AsyncLog() {
+  stopping_.store(true, std::memory_order_release);
+  writer_.join();
+}
+
+AsyncLog& AsyncLog::get() {
+  static AsyncLog log;
+  return log;
+}
+
+void AsyncLog::flush() {
+  if (!started_.load(std::memory_order_acquire)) {
+    return;
+  }
+  AsyncLog& log = get();
+  const uint64_t tail = log.tail_.load(std::memory_order_acquire);
+  while (log.head_.load(std::memory_order_acquire) < tail) {
+    std::this_thread::sleep_for(IdleWait);
+  }
+}
+
+AsyncLog::Slot* AsyncLog::claim() {
+  uint64_t pos = tail_.load(std::memory_order_relaxed);
+  for (;;) {
+    Slot& slot = slots_[pos % Capacity];
+    const uint64_t sequence = slot.sequence_.load(std::memory_order_acquire);
+    if (sequence == pos) {
+      if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        slot.claimed_ = pos;
+        return &slot;
+      }
+    } else if (sequence < pos) {
+      // The writer hasn't got to the message logged in this slot a lap ago.
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      pos = tail_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+size_t AsyncLog::drain() {
+  uint64_t head = head_.load(std::memory_order_relaxed);
+  size_t written = 0;
+  for (;; head++, written++) {
+    Slot& slot = slots_[head % Capacity];
+    if (slot.sequence_.load(std::memory_order_acquire) != head + 1) {
+      break;
+    }
+    fwrite(slot.text_, 1, slot.length_, out_);
+    if (slot.truncated_) {
+      fputs("...\n", out_);
+    }
+    slot.sequence_.store(head + Capacity, std::memory_order_release);
+  }
+
+  const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+  if (dropped != droppedReported_) {
+    fprintf(out_, "[%llu log messages dropped]\n",
+            static_cast<unsigned long long>(dropped - droppedReported_));
+    droppedReported_ = dropped;
+  }
+  if (written > 0) {
+    fflush(out_);
+    head_.store(head, std::memory_order_release);
+  }
+  return written;
+}
+
+void AsyncLog::run() {
+  for (;;) {
+    // Read the flag first, so a final drain catches everything published before shutdown.
+    const bool stopping = stopping_.load(std::memory_order_acquire);
+    if (drain() == 0) {
+      if (stopping) {
+        return;
+      }
+      std::this_thread::sleep_for(IdleWait);
+    }
+  }
+}
+
+} // namespace Logger
+} // namespace Envoy
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+#include "common/common/non_copyable.h"
+#include "fmt/format.h"
+
+// Messages below this level are compiled out: their ENVOY_LOG calls expand to nothing and their
+// arguments are never evaluated. Build with e.g. -DENVOY_LOG_MIN_LEVEL=info for production.
+#ifndef ENVOY_LOG_MIN_LEVEL
+#define ENVOY_LOG_MIN_LEVEL trace
+#endif
+
+namespace Envoy {
+namespace Logger {
+
+enum class Level { trace, debug, info, warn, error, off };
+
+constexpr Level MinLevel = Level::ENVOY_LOG_MIN_LEVEL;
+
+/**
+ * Asynchronous log backend. Threads format their messages straight into the slots of a bounded
+ * lock-free ring, and a background thread writes them to stdout in batches, so logging never
+ * waits on I/O. When the ring is full messages are dropped rather than blocking the caller; the
+ * writer notes how many were lost. Messages longer than a slot are truncated.
+ *
+ * The ring takes any number of producers: a producer claims a slot by advancing tail_, formats
+ * into it, then publishes it through the slot's sequence number, which the writer waits on.
+ * The writer thread and the ring only exist once a message has been logged.
+ */
+class AsyncLog : NonCopyable {
+public:
+  ~AsyncLog();
+
+  static AsyncLog& get();
+
+  // Messages below <level> are discarded at runtime. The default is info.
+  static void setLevel(Level level) { level_.store(level, std::memory_order_relaxed); }
+  static Level level() { return level_.load(std::memory_order_relaxed); }
+  static bool enabled(Level level) { return level >= level_.load(std::memory_order_relaxed); }
+
+  // Waits until every message logged so far has been written. A no-op if nothing was logged.
+  static void flush();
+
+  /**
+   * Logs one message. <format>(char* out, size_t size) writes up to <size> bytes to <out> and
+   * returns the full length of the message.
+   */
+  template <class Format> void log(Format format) {
+    Slot* slot = claim();
+    if (slot == nullptr) {
+      return;
+    }
+    size_t length = 0;
+    try {
+      length = format(slot->text_, SlotSize);
+    } catch (...) {
+      // The slot is published regardless, or the writer would wait on it forever.
+    }
+    slot->length_ = std::min(length, SlotSize);
+    slot->truncated_ = length > SlotSize;
+    slot->sequence_.store(slot->claimed_ + 1, std::memory_order_release);
+  }
+
+  // Messages dropped because the ring was full.
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  static constexpr size_t Capacity = 2048;
+  static constexpr size_t SlotSize = 2048;
+
+private:
+  struct Slot {
+    // claimed_ + 1 once published; the writer sets it to the position of the slot's next use.
+    std::atomic<uint64_t> sequence_;
+    uint64_t claimed_;
+    size_t length_;
+    bool truncated_;
+    char text_[SlotSize];
+  };
+
+  AsyncLog();
+
+  Slot* claim();
+  // Writes the published messages; returns how many.
+  size_t drain();
+  void run();
+
+  static constexpr size_t CacheLineSize = 64;
+
+  static std::atomic<Level> level_;
+  static std::atomic<bool> started_;
+
+  std::unique_ptr<Slot[]> slots_;
+  FILE* out_;
+  std::thread writer_;
+  std::atomic<bool> stopping_;
+  alignas(CacheLineSize) std::atomic<uint64_t> tail_;
+  alignas(CacheLineSize) std::atomic<uint64_t> head_;
+  std::atomic<uint64_t> dropped_;
+  uint64_t droppedReported_;
+};
+
+} // namespace Logger
+} // namespace Envoy
+
+// The arguments, typically toString() calls, are only evaluated when LEVEL is compiled in and
+// enabled at runtime.
+#define ENVOY_LOG(LEVEL, ...)                                                                    \
+  do {                                                                                           \
+    if constexpr (Envoy::Logger::Level::LEVEL >= Envoy::Logger::MinLevel) {                      \
+      if (Envoy::Logger::AsyncLog::enabled(Envoy::Logger::Level::LEVEL)) {                       \
+        Envoy::Logger::AsyncLog::get().log([&](char* out_, size_t size_) {                       \
+          return fmt::format_to_n(out_, size_, __VA_ARGS__).size;                                \
+        });                                                                                      \
+      }                                                                                          \
+    }                                                                                            \
+  } while (0)
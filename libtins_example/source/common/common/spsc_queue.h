@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "common/common/non_copyable.h"
+
+namespace Envoy {
+
+/**
+ * Bounded lock-free queue for exactly one producer thread and one consumer thread. The capacity
+ * is rounded up to a power of two. The producer only writes tail_ and the consumer only writes
+ * head_, and the two live on separate cache lines so the threads don't false-share them.
+ */
+template <class T> class SpscQueue : NonCopyable {
+public:
+  SpscQueue(size_t capacity) : head_(0), tail_(0) {
+    size_t n = 1;
+    while (n < capacity) {
+      n <<= 1;
+    }
+    slots_.resize(n);
+    mask_ = n - 1;
+  }
+
+  /**
+   * Called by the producer.
+   * @return false if the queue is full, in which case <item> is left untouched.
+   */
+  bool push(T&& item) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+      return false;
+    }
+
+    slots_[tail & mask_] = std::move(item);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Called by the consumer.
+   * @return false if the queue is empty.
+   */
+  bool pop(T& item) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    item = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+  }
+
+private:
+  static constexpr size_t CacheLineSize = 64;
+
+  std::vector<T> slots_;
+  size_t mask_;
+  alignas(CacheLineSize) std::atomic<size_t> head_;
+  alignas(CacheLineSize) std::atomic<size_t> tail_;
+};
+
+} // namespace Envoy
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+#include "codec.h"
+#include "event_file.h"
+#include "fingerprint.h"
+#include "histogram.h"
+
+namespace MySQL {
+
+/**
+ * Per stream state: the decoder, and the histograms, query table and event file its results go
+ * to. Used for captured streams by SessionManager, and for proxied connections by ProxyIngest.
+ */
+class StreamSession : public DecoderCallbacks {
+public:
+  // <events> is optional; <endpoints> has the connection's addresses and ports filled in.
+  StreamSession(CommandLatencies& latencies, QueryTopN& top_queries, EventWriter* events,
+                const QueryEvent& endpoints)
+      : latencies_(latencies), topQueries_(top_queries), events_(events), event_(endpoints) {
+    decoder_.setCallbacks(*this);
+  }
+
+  // DecoderCallbacks
+  void onQueryResult(const QueryResult& result) override {
+    auto latency = std::max(result.end_ - result.start_, std::chrono::microseconds(0));
+    latencies_.record(result.command_, latency.count());
+    if (result.fingerprint_ != 0) {
+      topQueries_.record(result.fingerprint_, result.query_, latency.count(), result.rows_,
+                         result.rowBytes_, result.errorCode_ != 0);
+    }
+    if (events_ != nullptr) {
+      event_.timestamp_ = result.start_;
+      event_.command_ = result.command_;
+      event_.fingerprint_ = result.fingerprint_;
+      event_.latency_ = latency;
+      event_.rows_ = result.rows_;
+      event_.rowBytes_ = result.rowBytes_;
+      event_.errorCode_ = result.errorCode_;
+      events_->append(event_);
+    }
+  }
+
+  void onAboveHighWatermark() override { overLimit_ = true; }
+  void onBelowLowWatermark() override { overLimit_ = false; }
+
+  MySQLDecoder decoder_;
+  // Whether the decoder holds more unframed data than the flow buffer limit.
+  bool overLimit_ = false;
+
+private:
+  CommandLatencies& latencies_;
+  QueryTopN& topQueries_;
+  EventWriter* events_;
+  QueryEvent event_;
+};
+
+}; // namespace MySQL
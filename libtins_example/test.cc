@@ -1,21 +1,113 @@
-#include "tins/sniffer.h"
-#include "tins/tcp_ip/stream_follower.h"
+#include "tins/exceptions.h"
 
+#include <signal.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <stdexcept>
 #include <string>
 
+#include "batch.h"
+#include "capture.h"
 #include "codec.h"
+#include "event_file.h"
+#include "common/common/logger.h"
+#include "pcap_reader.h"
+#include "proxy.h"
+#include "replay.h"
+#include "session.h"
 
 using Tins::Packet;
-using Tins::Sniffer;
-using Tins::TCPIP::Stream;
-using Tins::TCPIP::StreamFollower;
 
-using namespace Tins;
-using namespace Envoy;
+static MySQL::LiveCapture* live_capture;
+static MySQL::ProxyIngest* proxy;
+
+static void onSignal(int) {
+  if (live_capture != nullptr) {
+    live_capture->stop();
+  }
+  if (proxy != nullptr) {
+    proxy->stop();
+  }
+}
+
+static void usage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [-j workers] [-i interface] [-F flows] [-T seconds]"
+            << " [-M MB] [-B MB] [-L address -U address] [-o events] [-m] [-b] [-S MB]"
+            << " [-l list] [-v] [pcap file...]" << std::endl;
+  std::cerr << "  -j workers    decode on <workers> threads, sharded by TCP 4-tuple" << std::endl;
+  std::cerr << "  -i interface  capture live from <interface> into <workers> TPACKET_V3 rings"
+            << std::endl;
+  std::cerr << "  -L address    relay connections accepted on <address> (host:port) to the"
+            << " server at -U, decoding them on the way" << std::endl;
+  std::cerr << "  -F flows      connections tracked per worker (default 65536)" << std::endl;
+  std::cerr << "  -T seconds    evict connections idle for <seconds> (default 300)" << std::endl;
+  std::cerr << "  -M MB         bytes buffered by all decoders, split across workers"
+            << " (default 1024)" << std::endl;
+  std::cerr << "  -B MB         unframed bytes a connection may hold before it is dropped,"
+            << " 0 for no limit (default 32)" << std::endl;
+  std::cerr << "  -o events     write completed commands to the columnar file <events>"
+            << " (<events>.<worker> with several workers, <events>.<task> in batch mode)"
+            << std::endl;
+  std::cerr << "  -m            map the capture file instead of reading it through io_uring"
+            << std::endl;
+  std::cerr << "  -b            batch mode: decode every file, or range of a large one, separately"
+            << " on <workers> threads; implied by several files" << std::endl;
+  std::cerr << "  -S MB         in batch mode, split larger files into ranges of about <MB>,"
+            << " 0 to never split (default 256)" << std::endl;
+  std::cerr << "  -l list       add the files named in <list>, one per line" << std::endl;
+  std::cerr << "  -v            trace every decoded packet to stdout, unless compiled out"
+            << std::endl;
+}
+
+static void printReadStats(MySQL::PcapReader::Mode mode,
+                           const MySQL::PcapReader::Stats& stats) {
+  std::cerr << "Read " << stats.packets_ << " packets, " << (stats.bytes_ >> 20) << " MB at "
+            << static_cast<uint64_t>(stats.megabytesPerSecond()) << " MB/s via "
+            << (mode == MySQL::PcapReader::Mode::IoUring ? "io_uring" : "mmap") << ", "
+            << stats.copiedRecords_ << " records copied across reads" << std::endl;
+}
+
+static void printFlowStats(const std::string& name,
+                           const MySQL::SessionManager::FlowStats& stats) {
+  std::cerr << name << ": " << stats.flows_ << " flows open, " << stats.evictions()
+            << " evicted (" << stats.fullEvictions_ << " table full, " << stats.idleEvictions_
+            << " idle, " << stats.memoryEvictions_ << " over budget, "
+            << stats.watermarkEvictions_ << " over the flow limit), peak "
+            << stats.peakBufferedBytes_ << " bytes buffered, " << stats.partialFlows_
+            << " joined mid-stream, " << stats.resyncs_ << " resyncs" << std::endl;
+}
+
+// Reads back the event files of <shards> session managers through EventReader, so a file whose
+// footer or block index doesn't match its blocks fails the run rather than its first reader.
+static void printEventFiles(const MySQL::SessionManager::Options& sessions, size_t shards) {
+  if (sessions.eventFile_.empty()) {
+    return;
+  }
+  for (size_t i = 0; i < shards; i++) {
+    const std::string path = sessions.shard(i, shards).eventFile_;
+    MySQL::EventReader reader(path);
+    uint64_t events = 0, rows = 0;
+    for (size_t block = 0; block < reader.blocks(); block++) {
+      const uint64_t count = reader.block(block).events_;
+      const auto* values = reader.column<uint64_t>(block, MySQL::EventFile::ColumnId::Rows);
+      for (uint64_t n = 0; n < count; n++) {
+        rows += values[n];
+      }
+      events += count;
+    }
+    if (events != reader.events()) {
+      throw std::runtime_error(path + ": blocks hold " + std::to_string(events) +
+                               " events, the footer " + std::to_string(reader.events()));
+    }
+    std::cerr << path << ": " << events << " events in " << reader.blocks() << " blocks, "
+              << rows << " rows" << std::endl;
+  }
+}
 
-int main() {
+int main(int argc, char** argv) {
 
   // TODO: Tests
   //  - Initial handshake
@@ -33,51 +125,206 @@ int main() {
   //  - Query: Prepared statements
   //  
   
+  size_t workers = 1;
+  std::string interface;
+  std::string listen, upstream;
+  MySQL::SessionManager::Options sessions;
+  MySQL::PcapReader::Options reader;
+  bool batch = false;
+  uint64_t split_size = 256ULL << 20;
+  std::vector<std::string> files;
+  int opt;
+  while ((opt = getopt(argc, argv, "j:i:F:T:M:B:L:U:o:mbS:l:vh")) != -1) {
+    switch (opt) {
+    case 'j':
+      workers = std::max(1, atoi(optarg));
+      break;
+    case 'i':
+      interface = optarg;
+      break;
+    case 'F':
+      sessions.maxFlows_ = std::max(1ULL, strtoull(optarg, nullptr, 0));
+      break;
+    case 'T':
+      sessions.idleTimeout_ = std::chrono::seconds(strtoull(optarg, nullptr, 0));
+      break;
+    case 'M':
+      sessions.memoryBudget_ = strtoull(optarg, nullptr, 0) << 20;
+      break;
+    case 'B':
+      sessions.flowBufferLimit_ = strtoull(optarg, nullptr, 0) << 20;
+      break;
+    case 'L':
+      listen = optarg;
+      break;
+    case 'U':
+      upstream = optarg;
+      break;
+    case 'o':
+      sessions.eventFile_ = optarg;
+      break;
+    case 'm':
+      reader.mmap_ = true;
+      break;
+    case 'b':
+      batch = true;
+      break;
+    case 'S':
+      split_size = strtoull(optarg, nullptr, 0) << 20;
+      break;
+    case 'l': {
+      std::ifstream list(optarg);
+      if (!list) {
+        std::cerr << "Error: unable to open " << optarg << std::endl;
+        return 1;
+      }
+      for (std::string line; std::getline(list, line);) {
+        if (!line.empty()) {
+          files.push_back(line);
+        }
+      }
+      batch = true;
+      break;
+    }
+    case 'v':
+      Envoy::Logger::AsyncLog::setLevel(Envoy::Logger::Level::trace);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (!listen.empty() && upstream.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // Patterns are expanded here as well, for lists too long for the command line.
+  files.insert(files.end(), argv + optind, argv + argc);
+  files = MySQL::BatchReplay::expand(files);
+  batch = batch || files.size() > 1;
+  std::string file = files.empty() ? "/tmp/test.pcap" : files.front();
+  sessions.memoryBudget_ /= workers;
+
   try {
-    FileSniffer sniffer("/tmp/test.pcap");
-
-    StreamFollower follower;
-    follower.new_stream_callback([](Stream& stream) {
-        std::shared_ptr<MySQL::MySQLDecoder> decoder = std::make_shared<MySQL::MySQLDecoder>();
-
-        std::shared_ptr<Envoy::Buffer::OwnedImpl> rb = std::make_shared<Envoy::Buffer::OwnedImpl>();
-        stream.client_data_callback([decoder, rb](Stream& stream) {
-            auto p = stream.client_payload();
-            rb->add(&p[0], p.size());
-            decoder->onClientData(*rb);
-            rb->drain(rb->length());
-
-            // // Feed one byte at a time.
-            // for (int i=0; i < p.size(); i++) {
-            //   rb->add(&p[i], 1);
-            //   decoder->onClientData(*rb);
-            //   rb->drain(rb->length());
-            // }
-          });
-
-        std::shared_ptr<Envoy::Buffer::OwnedImpl> wb = std::make_shared<Envoy::Buffer::OwnedImpl>();
-        stream.server_data_callback([decoder, wb](Stream& stream){
-            auto p = stream.server_payload();
-            wb->add(&p[0], p.size());
-            decoder->onServerData(*wb);
-            wb->drain(wb->length());
-
-            // // Feed one byte at a time.
-            // for (int i=0; i < p.size(); i++) {
-            //   wb->add(&p[i], 1);
-            //   decoder->onServerData(*wb);
-            //   wb->drain(wb->length());
-            // }
-          });
-
-
-        stream.auto_cleanup_payloads(true);
-      });
+    if (!listen.empty()) {
+      MySQL::ProxyIngest::Options options;
+      options.listen_ = listen;
+      options.upstream_ = upstream;
+      options.sessions_ = sessions;
+
+      MySQL::ProxyIngest ingest(options);
+      proxy = &ingest;
+      signal(SIGINT, onSignal);
+      signal(SIGTERM, onSignal);
+      ingest.run();
+      proxy = nullptr;
+
+      const auto& stats = ingest.stats();
+      std::cerr << "Proxy: " << stats.connections_ << " connections (" << stats.failedConnects_
+                << " failed to connect), " << stats.clientBytes_ << " bytes from clients, "
+                << stats.serverBytes_ << " from the server, " << stats.reads_ << " reads in "
+                << stats.wakeups_ << " wakeups, " << stats.deferredBytes_ << " bytes deferred, "
+                << stats.decodeErrors_ << " decode errors, " << stats.shed_ << " shed"
+                << std::endl;
+      printEventFiles(sessions, 1);
+      Envoy::Logger::AsyncLog::flush();
+      MySQL::printLatencies(std::cout, ingest.latencies());
+      MySQL::printTopQueries(std::cout, ingest.topQueries(), 20);
+      return 0;
+    }
+
+    if (!interface.empty()) {
+      MySQL::LiveCapture::Options options;
+      options.interface_ = interface;
+      options.rings_ = workers;
+      options.sessions_ = sessions;
+
+      MySQL::LiveCapture capture(options);
+      live_capture = &capture;
+      signal(SIGINT, onSignal);
+      signal(SIGTERM, onSignal);
+      capture.run();
+      live_capture = nullptr;
+
+      for (size_t i = 0; i < capture.rings(); i++) {
+        const auto& stats = capture.stats(i);
+        std::cerr << "Ring " << i << ": " << stats.packets_ << " packets, " << stats.drops_
+                  << " drops, " << stats.freezes_ << " freezes" << std::endl;
+        printFlowStats("Ring " + std::to_string(i), capture.flowStats(i));
+      }
+      printEventFiles(sessions, capture.rings());
+      Envoy::Logger::AsyncLog::flush();
+      MySQL::printLatencies(std::cout, capture.latencies());
+      MySQL::printTopQueries(std::cout, capture.topQueries(), 20);
+      return 0;
+    }
+
+    if (batch) {
+      MySQL::BatchReplay::Options options;
+      options.workers_ = workers;
+      options.splitSize_ = split_size;
+      options.reader_ = reader;
+      options.sessions_ = sessions;
+
+      MySQL::BatchReplay replay(files, options);
+      replay.run();
+      for (const auto& stats : replay.files()) {
+        std::cerr << stats.path_ << ": " << stats.packets_ << " packets, " << stats.streams_
+                  << " streams in " << stats.ranges_ << " ranges";
+        if (!stats.error_.empty()) {
+          std::cerr << ", " << stats.error_;
+        }
+        std::cerr << std::endl;
+      }
+      std::cerr << "Batch: " << replay.files().size() << " files in " << replay.tasks()
+                << " tasks on " << workers << " workers, " << replay.steals() << " stolen, "
+                << static_cast<uint64_t>(replay.megabytesPerSecond()) << " MB/s" << std::endl;
+      printEventFiles(sessions, replay.tasks());
+      printFlowStats("Batch", replay.flowStats());
+      Envoy::Logger::AsyncLog::flush();
+      MySQL::printLatencies(std::cout, replay.latencies());
+      MySQL::printTopQueries(std::cout, replay.topQueries(), 20);
+      return 0;
+    }
+
+    if (workers > 1) {
+      MySQL::ShardedReplay replay(workers, sessions);
+      replay.run(file, reader);
+      printReadStats(replay.readMode(), replay.readStats());
+      for (size_t i = 0; i < replay.workers(); i++) {
+        std::cerr << "Worker " << i << ": " << replay.packets(i) << " packets, "
+                  << replay.streams(i) << " streams" << std::endl;
+        printFlowStats("Worker " + std::to_string(i), replay.flowStats(i));
+      }
+      printEventFiles(sessions, replay.workers());
+      Envoy::Logger::AsyncLog::flush();
+      MySQL::printLatencies(std::cout, replay.latencies());
+      MySQL::printTopQueries(std::cout, replay.topQueries(), 20);
+      return 0;
+    }
 
-    sniffer.sniff_loop([&](Packet& packet) {
-        follower.process_packet(packet);
+    MySQL::PcapReader capture(file, reader);
+    MySQL::SessionManager manager(sessions);
+    capture.read([&](const MySQL::PacketView& view) {
+        try {
+          if (Tins::PDU* pdu = view.pdu()) {
+            Packet packet(pdu, Tins::Timestamp(view.timestamp_));
+            manager.processPacket(packet);
+          }
+        } catch (Tins::malformed_packet&) {
+          // Skipped, as libtins' own sniffers do.
+        }
         return true;
       });
+    manager.finish();
+    printReadStats(capture.mode(), capture.stats());
+    printFlowStats("Sessions", manager.flowStats());
+    printEventFiles(sessions, 1);
+    Envoy::Logger::AsyncLog::flush();
+    MySQL::printLatencies(std::cout, manager.latencies());
+    MySQL::printTopQueries(std::cout, manager.topQueries(), 20);
   } catch (std::exception& ex) {
     std::cerr << "Error: " << ex.what() << std::endl;
     return 1;
@@ -0,0 +1,162 @@
+#include "workload.h"
+
+#include "mysql.h"
+#include "packet_builder.h"
+
+namespace MySQL {
+
+WorkloadOptions::WorkloadOptions()
+    : capabilities_(CLIENT_LONG_PASSWORD | CLIENT_CONNECT_WITH_DB | CLIENT_LOCAL_FILES |
+                    CLIENT_PROTOCOL_41 | CLIENT_TRANSACTIONS | CLIENT_SECURE_CONNECTION |
+                    CLIENT_PLUGIN_AUTH | CLIENT_CONNECT_ATTRS) {}
+
+namespace {
+
+class SessionBuilder {
+public:
+  SessionBuilder(std::vector<WorkloadSegment>& segments, uint32_t capabilities)
+      : segments_(segments), capabilities_(capabilities), seq_(0) {}
+
+  uint32_t capabilities() const { return capabilities_; }
+
+  // Starts a new command; sequence ids restart at 0.
+  void command(uint8_t command, const std::string& arg) {
+    this->command(PacketBuilder::command(command, arg));
+  }
+  void command(const std::string& payload) {
+    seq_ = 0;
+    append(false, payload);
+  }
+
+  // Appends a packet to the current segment of <from_server>, so that consecutive packets in one
+  // direction go out together, as a server writes a result set.
+  void append(bool from_server, const std::string& payload) {
+    if (segments_.empty() || segments_.back().fromServer_ != from_server) {
+      segments_.push_back({from_server, ""});
+    }
+    segments_.back().data_ += PacketBuilder::frame(seq_, payload);
+  }
+
+private:
+  std::vector<WorkloadSegment>& segments_;
+  const uint32_t capabilities_;
+  uint8_t seq_;
+};
+
+void columnDefinitions(SessionBuilder& b, const std::vector<uint8_t>& types) {
+  for (size_t c = 0; c < types.size(); c++) {
+    b.append(true, PacketBuilder::columnDefinition("shop", "orders", "col" + std::to_string(c),
+                                                   types[c]));
+  }
+  if (!(b.capabilities() & CLIENT_DEPRECATE_EOF)) {
+    b.append(true, PacketBuilder::eof(b.capabilities(), SERVER_STATUS_AUTOCOMMIT));
+  }
+}
+
+// A text protocol result set, or a binary one when <types> are given.
+void resultSet(SessionBuilder& b, const std::vector<uint8_t>& types,
+               const std::vector<std::vector<std::string>>& rows, bool binary = false) {
+  b.append(true, PacketBuilder::lenEncInt(types.size()));
+  columnDefinitions(b, types);
+  for (const auto& row : rows) {
+    b.append(true, binary ? PacketBuilder::binaryRow(types, row) : PacketBuilder::textRow(row));
+  }
+  b.append(true, PacketBuilder::rowsEnd(b.capabilities(), SERVER_STATUS_AUTOCOMMIT));
+}
+
+} // namespace
+
+std::vector<WorkloadSegment> buildSession(const WorkloadOptions& options, size_t session) {
+  std::vector<WorkloadSegment> segments;
+  // The handshakes are always the 4.1 ones, and nothing is encrypted.
+  const uint32_t capabilities = (options.capabilities_ | CLIENT_PROTOCOL_41 |
+                                 (options.compress_ ? CLIENT_COMPRESS : 0)) &
+                                ~static_cast<uint32_t>(CLIENT_SSL);
+  SessionBuilder b(segments, capabilities);
+  const std::string plugin = "mysql_native_password";
+
+  b.append(true, PacketBuilder::serverHandshake(capabilities, session + 1, plugin));
+  b.append(false, PacketBuilder::clientHandshake(capabilities, "app_user", "shop",
+                                                 options.authSwitch_ ? "sha256_password" : plugin));
+  if (options.authSwitch_) {
+    b.append(true, PacketBuilder::authSwitchRequest(plugin, "ijklmnopqrstuvwxyzab"));
+    b.append(false, std::string(20, 'p'));
+  }
+  b.append(true, PacketBuilder::ok(capabilities, 0, 0, SERVER_STATUS_AUTOCOMMIT));
+  const size_t handshake = segments.size();
+
+  // Prepared, the first column is the BIGINT id.
+  std::vector<uint8_t> types(options.columns_, MYSQL_TYPE_VAR_STRING);
+  const uint32_t statement_id = 1;
+  if (options.prepared_) {
+    types[0] = MYSQL_TYPE_LONGLONG;
+    b.command(COM_STMT_PREPARE, "SELECT * FROM orders WHERE id >= ? LIMIT ?");
+    b.append(true, PacketBuilder::prepareOk(statement_id, types.size(), 2));
+    columnDefinitions(b, {MYSQL_TYPE_LONGLONG, MYSQL_TYPE_LONGLONG});
+    columnDefinitions(b, types);
+  }
+
+  for (size_t q = 0; q < options.queries_; q++) {
+    uint64_t first = (session * options.queries_ + q) * options.rows_;
+    if (options.prepared_) {
+      b.command(PacketBuilder::execute(statement_id, {first, options.rows_}));
+    } else {
+      b.command(COM_QUERY, "SELECT * FROM orders WHERE id >= " + std::to_string(first) +
+                               " LIMIT " + std::to_string(options.rows_));
+    }
+
+    std::vector<std::vector<std::string>> rows(options.rows_);
+    for (size_t r = 0; r < options.rows_; r++) {
+      for (size_t c = 0; c < options.columns_; c++) {
+        rows[r].push_back(types[c] == MYSQL_TYPE_LONGLONG
+                              ? PacketBuilder::fixedInt(first + r, 8)
+                              : std::string(options.width_, 'a' + (first + r + c) % 26));
+      }
+    }
+    resultSet(b, types, rows, options.prepared_);
+  }
+
+  if (options.prepared_) {
+    b.command(COM_STMT_CLOSE, PacketBuilder::fixedInt(statement_id, 4));
+  }
+
+  if (options.localInfileBytes_ > 0) {
+    b.command(COM_QUERY, "LOAD DATA LOCAL INFILE '/tmp/orders.csv' INTO TABLE orders");
+    b.append(true, PacketBuilder::localInfileRequest("/tmp/orders.csv"));
+
+    // Clients send the file in chunks and finish with an empty packet.
+    static constexpr size_t ChunkSize = 1 << 16;
+    std::string file(options.localInfileBytes_, 'x');
+    for (size_t offset = 0; offset < file.size(); offset += ChunkSize) {
+      b.append(false, file.substr(offset, ChunkSize));
+    }
+    b.append(false, "");
+    b.append(true,
+             PacketBuilder::ok(capabilities, file.size() / 64, 0, SERVER_STATUS_AUTOCOMMIT));
+  }
+
+  if (options.largePayloadBytes_ > 0) {
+    std::string blob(options.largePayloadBytes_, 'b');
+    b.command(COM_QUERY, "INSERT INTO blobs VALUES (1, '" + blob + "')");
+    b.append(true, PacketBuilder::ok(capabilities, 1, 1, SERVER_STATUS_AUTOCOMMIT));
+
+    b.command(COM_QUERY, "SELECT data FROM blobs WHERE id = 1");
+    resultSet(b, {MYSQL_TYPE_VAR_STRING}, {{blob}});
+  }
+
+  b.command(COM_QUIT, "");
+
+  if (options.compress_) {
+    // Compressed sequence ids restart with each client write; the decoder doesn't check them.
+    uint8_t seq = 0;
+    for (size_t i = handshake; i < segments.size(); i++) {
+      if (!segments[i].fromServer_) {
+        seq = 0;
+      }
+      segments[i].data_ = PacketBuilder::compress(seq, segments[i].data_);
+    }
+  }
+  return segments;
+}
+
+}; // namespace MySQL
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace MySQL {
+
+/**
+ * Shape of a synthetic MySQL session: a handshake, <queries_> result set queries and, optionally,
+ * a LOCAL INFILE upload and a round trip of one large payload in each direction. The queries are
+ * text protocol COM_QUERYs, or executions of one prepared statement.
+ */
+struct WorkloadOptions {
+  // Negotiated by both sides. The session follows CLIENT_DEPRECATE_EOF and
+  // CLIENT_SESSION_TRACKING; CLIENT_PROTOCOL_41 is always set and CLIENT_SSL never is.
+  uint32_t capabilities_;
+  // Have the server ask the client to switch auth plugins during the handshake.
+  bool authSwitch_ = false;
+  size_t queries_ = 10;
+  // Prepare the query once and COM_STMT_EXECUTE it, for binary protocol rows.
+  bool prepared_ = false;
+  // Negotiate CLIENT_COMPRESS and compress everything after the handshake, one compressed packet
+  // per segment.
+  bool compress_ = false;
+  size_t columns_ = 4;
+  size_t rows_ = 100;
+  // Bytes per column value.
+  size_t width_ = 16;
+  // Size of the file uploaded with LOAD DATA LOCAL INFILE; 0 to skip.
+  size_t localInfileBytes_ = 0;
+  // Size of one INSERT sent by the client and of one column returned by the server, spread over
+  // multiple packets once past MAX_PAYLOAD_LEN; 0 to skip.
+  size_t largePayloadBytes_ = 0;
+
+  WorkloadOptions();
+};
+
+/**
+ * One direction's worth of a session, as written by a single send().
+ */
+struct WorkloadSegment {
+  bool fromServer_;
+  std::string data_;
+};
+
+/**
+ * @return the wire data of synthetic session <session>, in order. The result is a pure function
+ *         of its arguments; <session> only varies thread ids and literals.
+ */
+std::vector<WorkloadSegment> buildSession(const WorkloadOptions& options, size_t session);
+
+}; // namespace MySQL